@@ -0,0 +1,11 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+/**
+ * @brief Each suite runs through QTest::qExec() and returns its number of failures
+ */
+int runPacketBenchmarks(int argc, char *argv[]);
+int runRequestBenchmarks(int argc, char *argv[]);
+int runUserSocketMapBenchmarks(int argc, char *argv[]);
+
+#endif // BENCHMARKS_H
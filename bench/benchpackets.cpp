@@ -0,0 +1,193 @@
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest>
+
+#include "benchmarks.h"
+#include "chatserver.h"
+#include "jsonwriter.h"
+#include "overlaymessage.h"
+#include "textescape.h"
+
+/**
+ * @brief Compares outbound packet generation against the QJsonDocument path it replaced
+ *
+ * The legacy* functions reproduce the previous serialization, including the indented toJson()
+ * and the implicit conversion back to QString that sendTextMessage() forced.
+ */
+class BenchPackets : public QObject
+{
+  Q_OBJECT
+private:
+  static QString legacyChatMessage(qint64 msgId, qint64 time, qint64 replyId, const QString &author, qint64 authorId, const QString &authorColor, QString msg, Authorization auth, const QString &donateValue)
+  {
+    msg = msg.toHtmlEscaped();
+
+    QJsonObject data;
+    data.insert(QStringLiteral("id"), msgId);
+    data.insert(QStringLiteral("time"), time);
+    data.insert(QStringLiteral("author"), author);
+    data.insert(QStringLiteral("author_id"), authorId);
+    data.insert(QStringLiteral("author_color"), authorColor);
+    data.insert(QStringLiteral("author_level"), int(auth));
+    data.insert(QStringLiteral("message"), msg);
+    data.insert(QStringLiteral("auth"), int(auth));
+    data.insert(QStringLiteral("donate_value"), donateValue);
+    data.insert(QStringLiteral("reply"), replyId);
+
+    QJsonObject o;
+    o.insert(QStringLiteral("type"), QStringLiteral("chat"));
+    o.insert(QStringLiteral("data"), data);
+    return QJsonDocument(o).toJson();
+  }
+
+  static QString legacyJoin(const QString &name)
+  {
+    QJsonObject d;
+    d.insert(QStringLiteral("name"), name);
+
+    QJsonObject o;
+    o.insert(QStringLiteral("type"), QStringLiteral("join"));
+    o.insert(QStringLiteral("data"), d);
+    return QJsonDocument(o).toJson();
+  }
+
+  static QString legacyAlert(const QString &title, const QString &subtitle)
+  {
+    QJsonObject d;
+    d.insert(QStringLiteral("title"), title);
+    d.insert(QStringLiteral("subtitle"), subtitle);
+
+    QJsonObject o;
+    o.insert(QStringLiteral("type"), QStringLiteral("alert"));
+    o.insert(QStringLiteral("data"), d);
+    return QJsonDocument(o).toJson();
+  }
+
+  QString m_author = QStringLiteral("SomeChatter");
+  QString m_color = QStringLiteral("#1e90ff");
+  QString m_message = QStringLiteral("hello there, did anyone catch the \"bonus\" part of the stream? <3 éè");
+
+private slots:
+  void chatMessageMatchesLegacy()
+  {
+    QJsonDocument legacy = QJsonDocument::fromJson(legacyChatMessage(1234, 1700000000, 0, m_author, 99, m_color, m_message, Authorization::AUTH_USER, QString()).toUtf8());
+    QJsonDocument current = QJsonDocument::fromJson(ChatServer::generateChatMessageForClient(1234, 1700000000, 0, m_author, 99, m_color, m_message, Authorization::AUTH_USER, QString()).toUtf8());
+    QVERIFY(!current.isNull());
+    QCOMPARE(current, legacy);
+  }
+
+  void chatMessageLegacy()
+  {
+    QBENCHMARK {
+      QString s = legacyChatMessage(1234, 1700000000, 0, m_author, 99, m_color, m_message, Authorization::AUTH_USER, QString());
+      Q_UNUSED(s);
+    }
+  }
+
+  void chatMessage()
+  {
+    QBENCHMARK {
+      QString s = ChatServer::generateChatMessageForClient(1234, 1700000000, 0, m_author, 99, m_color, m_message, Authorization::AUTH_USER, QString());
+      Q_UNUSED(s);
+    }
+  }
+
+  void joinLegacy()
+  {
+    QBENCHMARK {
+      QString s = legacyJoin(m_author);
+      Q_UNUSED(s);
+    }
+  }
+
+  void join()
+  {
+    QBENCHMARK {
+      QString s = ChatServer::generateJoinPacket(m_author);
+      Q_UNUSED(s);
+    }
+  }
+
+  void htmlEscapeLegacy()
+  {
+    QString text = m_message.repeated(8);
+    JsonWriter w;
+    QBENCHMARK {
+      w.clear();
+      w.value(text.toHtmlEscaped());
+    }
+  }
+
+  void htmlEscape()
+  {
+    QString text = m_message.repeated(8);
+    JsonWriter w;
+    QBENCHMARK {
+      w.clear();
+      w.htmlValue(text);
+    }
+  }
+
+  void htmlEscapeMatchesLegacy()
+  {
+    QString text = m_message + QStringLiteral("\\ \t & <b>bold</b> \x01");
+    JsonWriter legacy;
+    legacy.value(text.toHtmlEscaped());
+    JsonWriter current;
+    current.htmlValue(text);
+    QCOMPARE(current.buffer(), legacy.buffer());
+  }
+
+  void overlayAlertMatchesLegacy()
+  {
+    OverlayMessage m = OverlayMessage::Alert(m_author, m_message);
+    QCOMPARE(QJsonDocument::fromJson(m.toJson().toUtf8()), QJsonDocument::fromJson(legacyAlert(m_author, m_message).toUtf8()));
+  }
+
+  void overlayAlertLegacy()
+  {
+    QBENCHMARK {
+      QString s = legacyAlert(m_author, m_message);
+      Q_UNUSED(s);
+    }
+  }
+
+  void overlayAlert()
+  {
+    OverlayMessage m = OverlayMessage::Alert(m_author, m_message);
+    QBENCHMARK {
+      QString s = m.toJson();
+      Q_UNUSED(s);
+    }
+  }
+
+  void overlayCommand()
+  {
+    OverlayMessage m = OverlayMessage::Command(OverlayMessage::CMD_SKIP_TTS);
+    QBENCHMARK {
+      QString s = m.toJson();
+      Q_UNUSED(s);
+    }
+  }
+
+  void escapePlainText()
+  {
+    // The common case, nothing to escape, so this is the scan kernel alone
+    QString text = QStringLiteral("just a perfectly ordinary chat message with nothing special in it ").repeated(8);
+    QString out;
+    out.reserve(text.size() * 2);
+    QBENCHMARK {
+      out.clear();
+      TextEscape::appendJson(&out, text, true);
+    }
+  }
+
+};
+
+int runPacketBenchmarks(int argc, char *argv[])
+{
+  BenchPackets b;
+  return QTest::qExec(&b, argc, argv);
+}
+
+#include "benchpackets.moc"
@@ -0,0 +1,87 @@
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include "benchmarks.h"
+#include "chatserver.h"
+
+/**
+ * @brief Inbound chat handling that runs for every message before anything is published
+ */
+class BenchRequests : public QObject
+{
+  Q_OBJECT
+private:
+  /**
+   * @brief Deterministic list of lowercase words of 4 to 12 letters, standing in for a moderation list
+   */
+  static QStringList makeBannedWords(int count)
+  {
+    QRandomGenerator rng(42);
+    QStringList words;
+    words.reserve(count);
+    for (int i = 0; i < count; i++) {
+      QString w;
+      int length = rng.bounded(4, 13);
+      for (int j = 0; j < length; j++) {
+        w.append(QChar('a' + rng.bounded(26)));
+      }
+      words.append(w);
+    }
+    return words;
+  }
+
+  QString m_author = QStringLiteral("SomeChatter");
+
+private slots:
+  void parseRequest_data()
+  {
+    QTest::addColumn<QString>("line");
+
+    QTest::newRow("short") << QStringLiteral("time");
+    QTest::newRow("args") << QStringLiteral("timer 5m  make some tea please");
+    QTest::newRow("long") << QStringLiteral("say ") + QStringLiteral("lorem ipsum dolor sit amet ").repeated(16);
+  }
+
+  void parseRequest()
+  {
+    QFETCH(QString, line);
+    QBENCHMARK {
+      ChatServer::Request r(line, m_author, 99, Authorization::AUTH_USER);
+      bool matched = r.equals("timer");
+      Q_UNUSED(matched);
+    }
+  }
+
+  void bannedWords_data()
+  {
+    QTest::addColumn<int>("words");
+
+    QTest::newRow("50") << 50;
+    QTest::newRow("500") << 500;
+    QTest::newRow("5000") << 5000;
+  }
+
+  void bannedWords()
+  {
+    QFETCH(int, words);
+
+    // An acceptable message is the worst case, since every word has to be checked
+    QStringList bannedWords = makeBannedWords(words);
+    QString msg = QStringLiteral("hello there, did anyone catch the bonus part of the stream? 123");
+    QVERIFY(ChatServer::isMessageAcceptable(msg, bannedWords));
+
+    QBENCHMARK {
+      bool acceptable = ChatServer::isMessageAcceptable(msg, bannedWords);
+      Q_UNUSED(acceptable);
+    }
+  }
+
+};
+
+int runRequestBenchmarks(int argc, char *argv[])
+{
+  BenchRequests b;
+  return QTest::qExec(&b, argc, argv);
+}
+
+#include "benchrequests.moc"
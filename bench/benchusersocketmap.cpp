@@ -0,0 +1,113 @@
+#include <memory>
+#include <QtTest>
+#include <vector>
+
+#include "benchmarks.h"
+#include "chatserver.h"
+#include "usersocketmap.h"
+
+/**
+ * @brief Socket bookkeeping and fan-out at the sizes of a busy stream
+ *
+ * The sockets are never connected, so broadcast measures the per-recipient cost inside kcchat and
+ * QWebSocket (including its UTF-8 conversion) but not the kernel write.
+ */
+class BenchUserSocketMap : public QObject
+{
+  Q_OBJECT
+private:
+  void makeSockets(int count)
+  {
+    m_sockets.clear();
+    m_sockets.reserve(count);
+    for (int i = 0; i < count; i++) {
+      m_sockets.emplace_back(new QWebSocket());
+    }
+  }
+
+  // Roughly half the sockets belong to logged-in users, some with more than one tab open
+  static qint64 authorFor(int i)
+  {
+    return (i % 2) ? (i / 3) + 1 : 0;
+  }
+
+  void fill(UserSocketMap *map)
+  {
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+      map->insertSocket(authorFor(int(i)), m_sockets[i].get());
+    }
+  }
+
+  static void sizes()
+  {
+    QTest::addColumn<int>("sockets");
+
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+  }
+
+  std::vector<std::unique_ptr<QWebSocket> > m_sockets;
+
+private slots:
+  void cleanup()
+  {
+    m_sockets.clear();
+  }
+
+  void insert_data() { sizes(); }
+  void insert()
+  {
+    QFETCH(int, sockets);
+    makeSockets(sockets);
+
+    QBENCHMARK {
+      UserSocketMap map;
+      fill(&map);
+    }
+  }
+
+  void churn_data() { sizes(); }
+  void churn()
+  {
+    QFETCH(int, sockets);
+    makeSockets(sockets);
+
+    UserSocketMap map;
+    fill(&map);
+
+    // A thousand clients leaving and rejoining a full room
+    const int churned = 1000;
+    QBENCHMARK {
+      for (int i = 0; i < churned; i++) {
+        map.removeSocket(m_sockets[i].get());
+      }
+      for (int i = 0; i < churned; i++) {
+        map.insertSocket(authorFor(i), m_sockets[i].get());
+      }
+    }
+  }
+
+  void broadcast_data() { sizes(); }
+  void broadcast()
+  {
+    QFETCH(int, sockets);
+    makeSockets(sockets);
+
+    UserSocketMap map;
+    fill(&map);
+
+    QString packet = ChatServer::generateChatMessageForClient(1234, 1700000000, 0, QStringLiteral("SomeChatter"), 99, QStringLiteral("#1e90ff"), QStringLiteral("hello there, did anyone catch the bonus part of the stream?"), Authorization::AUTH_USER, QString());
+    QBENCHMARK {
+      map.broadcastTextMessage(packet);
+    }
+  }
+
+};
+
+int runUserSocketMapBenchmarks(int argc, char *argv[])
+{
+  BenchUserSocketMap b;
+  return QTest::qExec(&b, argc, argv);
+}
+
+#include "benchusersocketmap.moc"
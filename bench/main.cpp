@@ -0,0 +1,49 @@
+#include <cstring>
+#include <QCoreApplication>
+#include <QVector>
+
+#include "benchmarks.h"
+
+namespace
+{
+
+struct Suite
+{
+  const char *name;
+  int (*run)(int argc, char *argv[]);
+};
+
+const Suite SUITES[] = {
+  {"packets", runPacketBenchmarks},
+  {"requests", runRequestBenchmarks},
+  {"usersocketmap", runUserSocketMapBenchmarks}
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  // A leading suite name runs just that suite, with the rest of the arguments (such as test
+  // functions to run) passed to it alone. They would be unknown to every other suite.
+  if (argc > 1) {
+    for (const Suite &s : SUITES) {
+      if (strcmp(argv[1], s.name) == 0) {
+        QVector<char*> args;
+        args.append(argv[0]);
+        for (int i = 2; i < argc; i++) {
+          args.append(argv[i]);
+        }
+        return s.run(args.size(), args.data());
+      }
+    }
+  }
+
+  int failures = 0;
+  for (const Suite &s : SUITES) {
+    failures += s.run(argc, argv);
+  }
+
+  return failures;
+}
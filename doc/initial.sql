@@ -95,6 +95,7 @@ DROP TABLE IF EXISTS `history`;
 /*!40101 SET character_set_client = utf8 */;
 CREATE TABLE `history` (
   `id` bigint(20) NOT NULL AUTO_INCREMENT,
+  `room` varchar(32) NOT NULL DEFAULT 'main',
   `user_id` bigint(20) NOT NULL,
   `time` bigint(20) NOT NULL,
   `message` text NOT NULL,
@@ -102,7 +103,8 @@ CREATE TABLE `history` (
   `host` tinytext NOT NULL,
   `donate_value` tinytext NOT NULL,
   `reply_id` bigint(20) NOT NULL,
-  PRIMARY KEY (`id`)
+  PRIMARY KEY (`id`),
+  KEY `room_id` (`room`,`id`)
 ) ENGINE=InnoDB AUTO_INCREMENT=21372 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
@@ -114,12 +116,27 @@ DROP TABLE IF EXISTS `responses`;
 /*!40101 SET @saved_cs_client     = @@character_set_client */;
 /*!40101 SET character_set_client = utf8 */;
 CREATE TABLE `responses` (
+  `room` varchar(32) NOT NULL DEFAULT 'main',
   `command` varchar(16) NOT NULL,
   `response` text NOT NULL,
-  UNIQUE KEY `command` (`command`)
+  UNIQUE KEY `command` (`room`,`command`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `test_users`
+--
+
+DROP TABLE IF EXISTS `test_users`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+/*!40101 SET character_set_client = utf8 */;
+CREATE TABLE `test_users` (
+  `token` varchar(32) CHARACTER SET utf8 COLLATE utf8_bin NOT NULL,
+  `user_id` bigint(20) NOT NULL,
+  PRIMARY KEY (`token`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `transactions`
 --
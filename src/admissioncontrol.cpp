@@ -0,0 +1,159 @@
+#include "admissioncontrol.h"
+
+#include <QDebug>
+
+#include "startupconfig.h"
+
+AdmissionControl::AdmissionControl() :
+  m_maxPerIp(20),
+  m_maxPerSubnet(200),
+  m_acceptRate{50, 200},
+  m_handshakeTimeout(10000),  // 10 seconds
+  m_maxFrameSize(65536),      // 64 KiB
+  m_maxMessageSize(262144),   // 256 KiB
+  m_connectionCount(0),
+  m_counters{}
+{
+  m_clock.start();
+}
+
+void AdmissionControl::loadConfig(int shares)
+{
+  auto readInt = [](const QString &key, qint64 fallback){
+    QVariant v = CONFIG[key];
+    return v.isValid() ? v.toLongLong() : fallback;
+  };
+  auto readDouble = [](const QString &key, double fallback){
+    QVariant v = CONFIG[key];
+    return v.isValid() ? v.toDouble() : fallback;
+  };
+
+  m_maxPerIp = readInt(QStringLiteral("max_connections_per_ip"), m_maxPerIp);
+  m_maxPerSubnet = readInt(QStringLiteral("max_connections_per_subnet"), m_maxPerSubnet);
+  m_acceptRate.rate = readDouble(QStringLiteral("accept_rate"), m_acceptRate.rate);
+  m_acceptRate.burst = readDouble(QStringLiteral("accept_burst"), m_acceptRate.burst);
+  m_handshakeTimeout = readInt(QStringLiteral("handshake_timeout"), m_handshakeTimeout);
+  m_maxFrameSize = readInt(QStringLiteral("max_frame_size"), m_maxFrameSize);
+  m_maxMessageSize = readInt(QStringLiteral("max_message_size"), m_maxMessageSize);
+
+  if (shares > 1) {
+    // Rounded up so a limit never drops to 0, which would turn it off
+    m_maxPerIp = (m_maxPerIp + shares - 1) / shares;
+    m_maxPerSubnet = (m_maxPerSubnet + shares - 1) / shares;
+    m_acceptRate.rate /= shares;
+    m_acceptRate.burst = qMax(1.0, m_acceptRate.burst / shares);
+  }
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+  // Static so the chat and overlay servers only warn once between them
+  static const bool warned = []{
+    qWarning() << "Qt" << QT_VERSION_STR << "can't enforce max_frame_size and only checks max_message_size once a whole message has arrived, Qt 5.15 is needed for both";
+    return true;
+  }();
+  Q_UNUSED(warned)
+#endif
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(const QHostAddress &address)
+{
+  Verdict v = ADMITTED;
+
+  QHostAddress ip = normalize(address);
+  QHostAddress subnet = getSubnet(ip);
+
+  if (!m_acceptBucket.consume(m_acceptRate, m_clock.elapsed())) {
+    v = REJECTED_ACCEPT_RATE;
+  } else if (m_maxPerIp > 0 && m_perIp.value(ip) >= m_maxPerIp) {
+    v = REJECTED_IP_LIMIT;
+  } else if (m_maxPerSubnet > 0 && m_perSubnet.value(subnet) >= m_maxPerSubnet) {
+    v = REJECTED_SUBNET_LIMIT;
+  }
+
+  m_counters[v]++;
+
+  if (v == ADMITTED) {
+    m_perIp[ip]++;
+    m_perSubnet[subnet]++;
+    m_connectionCount++;
+  }
+
+  return v;
+}
+
+void AdmissionControl::release(const QHostAddress &address)
+{
+  QHostAddress ip = normalize(address);
+
+  decrement(m_perIp, ip);
+  decrement(m_perSubnet, getSubnet(ip));
+  m_connectionCount--;
+}
+
+void AdmissionControl::configureSocket(QWebSocket *skt) const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+  skt->setMaxAllowedIncomingFrameSize(m_maxFrameSize);
+  skt->setMaxAllowedIncomingMessageSize(m_maxMessageSize);
+#else
+  Q_UNUSED(skt)
+#endif
+}
+
+QString AdmissionControl::getSummary() const
+{
+  return QStringLiteral("Open: %1, admitted: %2, rejected per-IP: %3, rejected per-subnet: %4, rejected accept rate: %5").arg(
+        QString::number(m_connectionCount),
+        QString::number(m_counters[ADMITTED]),
+        QString::number(m_counters[REJECTED_IP_LIMIT]),
+        QString::number(m_counters[REJECTED_SUBNET_LIMIT]),
+        QString::number(m_counters[REJECTED_ACCEPT_RATE]));
+}
+
+const char *AdmissionControl::getVerdictName(Verdict v)
+{
+  switch (v) {
+  case ADMITTED: return "admitted";
+  case REJECTED_IP_LIMIT: return "ip_limit";
+  case REJECTED_SUBNET_LIMIT: return "subnet_limit";
+  case REJECTED_ACCEPT_RATE: return "accept_rate";
+  case VERDICT_COUNT:
+    break;
+  }
+
+  return "";
+}
+
+QHostAddress AdmissionControl::normalize(const QHostAddress &address)
+{
+  // Servers listening on QHostAddress::Any see IPv4 clients as IPv4-mapped IPv6 addresses
+  bool isIPv4;
+  quint32 ipv4 = address.toIPv4Address(&isIPv4);
+  if (isIPv4) {
+    return QHostAddress(ipv4);
+  }
+
+  return address;
+}
+
+QHostAddress AdmissionControl::getSubnet(const QHostAddress &address)
+{
+  if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+    return QHostAddress(address.toIPv4Address() & 0xFFFFFF00);
+  }
+
+  Q_IPV6ADDR ipv6 = address.toIPv6Address();
+  for (int i = 8; i < 16; i++) {
+    ipv6[i] = 0;
+  }
+  return QHostAddress(ipv6);
+}
+
+void AdmissionControl::decrement(QHash<QHostAddress, int> &counts, const QHostAddress &key)
+{
+  auto it = counts.find(key);
+  if (it != counts.end()) {
+    if (--(*it) <= 0) {
+      counts.erase(it);
+    }
+  }
+}
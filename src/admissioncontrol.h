@@ -0,0 +1,87 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QWebSocket>
+
+#include "tokenbucket.h"
+
+/**
+ * @brief Decides whether newly accepted connections are allowed to stay open
+ *
+ * Enforces concurrent connection limits per IP and per subnet (/24 for IPv4, /64 for IPv6) and a
+ * global accept rate, and holds the handshake and frame size limits for AdmissionServer.
+ */
+class AdmissionControl
+{
+public:
+  enum Verdict
+  {
+    ADMITTED,
+    REJECTED_IP_LIMIT,
+    REJECTED_SUBNET_LIMIT,
+    REJECTED_ACCEPT_RATE,
+
+    VERDICT_COUNT
+  };
+
+  AdmissionControl();
+
+  /**
+   * @brief Reads the limits from CONFIG, giving this process a 1/shares part of each
+   *
+   * Workers sharing a port with SO_REUSEPORT each only see their share of the connections, so
+   * together they enforce the configured limits instead of a multiple of them.
+   */
+  void loadConfig(int shares = 1);
+
+  Verdict admit(const QHostAddress &address);
+
+  void release(const QHostAddress &address);
+
+  /**
+   * @brief Applies the frame and message size limits, which needs Qt 5.15
+   *
+   * Older Qt can only check max_message_size once a message has arrived, with maxMessageSize().
+   */
+  void configureSocket(QWebSocket *skt) const;
+
+  int handshakeTimeout() const { return m_handshakeTimeout; }
+
+  qint64 maxMessageSize() const { return m_maxMessageSize; }
+
+  quint64 count(Verdict v) const { return m_counters[v]; }
+
+  int connectionCount() const { return m_connectionCount; }
+
+  QString getSummary() const;
+
+  static const char *getVerdictName(Verdict v);
+
+private:
+  static QHostAddress normalize(const QHostAddress &address);
+  static QHostAddress getSubnet(const QHostAddress &address);
+
+  static void decrement(QHash<QHostAddress, int> &counts, const QHostAddress &key);
+
+  int m_maxPerIp;
+  int m_maxPerSubnet;
+  RateLimit m_acceptRate;
+  int m_handshakeTimeout;
+  qint64 m_maxFrameSize;
+  qint64 m_maxMessageSize;
+
+  QHash<QHostAddress, int> m_perIp;
+  QHash<QHostAddress, int> m_perSubnet;
+  int m_connectionCount;
+
+  TokenBucket m_acceptBucket;
+  QElapsedTimer m_clock;
+
+  quint64 m_counters[VERDICT_COUNT];
+
+};
+
+#endif // ADMISSIONCONTROL_H
@@ -0,0 +1,105 @@
+#include "admissionserver.h"
+
+#include <QSslSocket>
+
+AdmissionServer::AdmissionServer(QWebSocketServer *target, const QSslConfiguration &ssl, QObject *parent) :
+  QTcpServer(parent),
+  m_target(target),
+  m_ssl(ssl)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  // The deadline here covers the TLS handshake too, so the target's own timeout isn't needed
+  m_target->setHandshakeTimeout(-1);
+#endif
+
+  m_deadlineTimer = new QTimer(this);
+  m_deadlineTimer->setSingleShot(true);
+  connect(m_deadlineTimer, &QTimer::timeout, this, &AdmissionServer::expireHandshakes);
+
+  m_clock.start();
+}
+
+void AdmissionServer::upgraded(QWebSocket *skt)
+{
+  m_handshaking.remove(PeerKey(skt->peerAddress(), skt->peerPort()));
+  m_admission.configureSocket(skt);
+}
+
+void AdmissionServer::incomingConnection(qintptr fd)
+{
+  QTcpSocket *skt = m_ssl.isNull() ? new QTcpSocket(this) : new QSslSocket(this);
+  if (!skt->setSocketDescriptor(fd)) {
+    delete skt;
+    return;
+  }
+
+  QHostAddress address = skt->peerAddress();
+
+  AdmissionControl::Verdict v = m_admission.admit(address);
+  if (v != AdmissionControl::ADMITTED) {
+    emit rejected(address, v);
+
+    // Don't bother with a TLS or WebSocket handshake, this is most likely a flood
+    skt->abort();
+    skt->deleteLater();
+    return;
+  }
+
+  // Once upgraded the socket belongs to its QWebSocket, and goes away along with it
+  PeerKey peer(address, skt->peerPort());
+  connect(skt, &QObject::destroyed, this, [this, peer, address](QObject *obj){
+    if (m_handshaking.value(peer) == obj) {
+      m_handshaking.remove(peer);
+    }
+    m_admission.release(address);
+  });
+
+  startDeadline(skt, peer);
+
+  if (QSslSocket *sslSkt = qobject_cast<QSslSocket*>(skt)) {
+    sslSkt->setSslConfiguration(m_ssl);
+    connect(sslSkt, &QSslSocket::encrypted, this, [this, sslSkt]{
+      m_target->handleConnection(sslSkt);
+    });
+    connect(sslSkt, QOverload<const QList<QSslError> &>::of(&QSslSocket::sslErrors), this, &AdmissionServer::sslErrors);
+    connect(sslSkt, &QSslSocket::peerVerifyError, this, &AdmissionServer::peerVerifyError);
+    sslSkt->startServerEncryption();
+  } else {
+    m_target->handleConnection(skt);
+  }
+}
+
+void AdmissionServer::startDeadline(QTcpSocket *skt, const PeerKey &peer)
+{
+  int timeout = m_admission.handshakeTimeout();
+  if (timeout <= 0) {
+    return;
+  }
+
+  m_handshaking.insert(peer, skt);
+  m_deadlines.enqueue(Deadline{skt, peer, m_clock.elapsed() + timeout});
+
+  if (!m_deadlineTimer->isActive()) {
+    m_deadlineTimer->start(timeout);
+  }
+}
+
+void AdmissionServer::expireHandshakes()
+{
+  qint64 now = m_clock.elapsed();
+
+  while (!m_deadlines.isEmpty() && m_deadlines.head().expiry <= now) {
+    Deadline d = m_deadlines.dequeue();
+
+    // Sockets that were upgraded or already closed have left m_handshaking
+    if (d.socket && m_handshaking.value(d.peer) == d.socket) {
+      m_handshaking.remove(d.peer);
+      d.socket->abort();
+      d.socket->deleteLater();
+    }
+  }
+
+  if (!m_deadlines.isEmpty()) {
+    m_deadlineTimer->start(int(m_deadlines.head().expiry - now));
+  }
+}
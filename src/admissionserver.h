@@ -0,0 +1,87 @@
+#ifndef ADMISSIONSERVER_H
+#define ADMISSIONSERVER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+#include <QPointer>
+#include <QQueue>
+#include <QSslConfiguration>
+#include <QSslError>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QWebSocket>
+#include <QWebSocketServer>
+
+#include "admissioncontrol.h"
+
+/**
+ * @brief Accepts connections for a WebSocket server, admitting them before the handshake
+ *
+ * Connection limits are applied to the raw socket as soon as it's accepted, so a host can't hold
+ * open more sockets than it's allowed by never finishing the TLS or WebSocket handshake. Sockets
+ * that haven't been handed out by the WebSocket server within the handshake timeout are dropped.
+ * Admitted sockets count against their IP and subnet until they're destroyed.
+ */
+class AdmissionServer : public QTcpServer
+{
+  Q_OBJECT
+public:
+  /**
+   * @brief Feeds accepted sockets to target, after a TLS handshake if ssl isn't null
+   *
+   * The target server shouldn't listen itself.
+   */
+  AdmissionServer(QWebSocketServer *target, const QSslConfiguration &ssl, QObject *parent = nullptr);
+
+  AdmissionControl &admission() { return m_admission; }
+  const AdmissionControl &admission() const { return m_admission; }
+
+  /**
+   * @brief Must be called for each socket the target hands out, ending its handshake deadline
+   */
+  void upgraded(QWebSocket *skt);
+
+signals:
+  void rejected(const QHostAddress &address, AdmissionControl::Verdict verdict);
+
+  void sslErrors(const QList<QSslError> &errors);
+
+  void peerVerifyError(const QSslError &error);
+
+protected:
+  void incomingConnection(qintptr fd) override;
+
+private:
+  typedef QPair<QHostAddress, quint16> PeerKey;
+
+  struct Deadline
+  {
+    QPointer<QTcpSocket> socket;
+    PeerKey peer;
+    qint64 expiry;
+  };
+
+  void startDeadline(QTcpSocket *skt, const PeerKey &peer);
+
+  QWebSocketServer *m_target;
+  QSslConfiguration m_ssl;
+
+  AdmissionControl m_admission;
+
+  // Sockets still in the TLS or WebSocket handshake, by peer since the target doesn't expose the
+  // QTcpSocket behind each QWebSocket
+  QHash<PeerKey, QTcpSocket*> m_handshaking;
+
+  // Every socket gets the same timeout, so deadlines expire in the order they were started
+  QQueue<Deadline> m_deadlines;
+  QTimer *m_deadlineTimer;
+  QElapsedTimer m_clock;
+
+private slots:
+  void expireHandshakes();
+
+};
+
+#endif // ADMISSIONSERVER_H
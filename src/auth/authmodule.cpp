@@ -20,7 +20,7 @@ qint64 AuthModule::createNewUser(QSqlDatabase db) const
   insertQuery.addBindValue(int(Authorization::AUTH_USER));
   insertQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
 
-  if (!insertQuery.exec()) {
+  if (!execQuery(insertQuery)) {
     qCritical() << "Failed to insert user auth into table:" << insertQuery.lastError();
     return 0;
   }
@@ -12,6 +12,7 @@
 #include <QString>
 
 #include "authlevel.h"
+#include "../sqlexec.h"
 
 class AuthModule : public QObject
 {
@@ -6,13 +6,20 @@
 
 #include "../startupconfig.h"
 
+static QString getEndpoint(const QString &key, const QString &fallback)
+{
+  // Endpoints can be overridden (e.g. pointed at MockOAuthServer for offline load testing)
+  QString url = CONFIG[key].toString();
+  return url.isEmpty() ? fallback : url;
+}
+
 void GoogleAuth::authenticate(QSqlDatabase db, const QString &token, const QString &redirect_uri, std::function<void(qint64)> callback, std::function<void ()> failure) const
 {
   // Look up access token in database
   QSqlQuery lookupToken(db);
   lookupToken.prepare(QStringLiteral("SELECT * FROM google_tokens WHERE auth_token = ?"));
   lookupToken.addBindValue(token);
-  if (!lookupToken.exec()) {
+  if (!execQuery(lookupToken)) {
     qCritical() << "Failed to look up Google token:" << lookupToken.lastError();
     failure();
     return;
@@ -40,7 +47,7 @@ void GoogleAuth::lookupUserFromSub(QSqlDatabase db, const QString &sub, std::fun
   QSqlQuery lookupToken(db);
   lookupToken.prepare(QStringLiteral("SELECT user_id FROM google_users WHERE sub = ?"));
   lookupToken.addBindValue(sub);
-  if (!lookupToken.exec()) {
+  if (!execQuery(lookupToken)) {
     qCritical() << "Failed to look up Google token:" << lookupToken.lastError();
     failure();
     return;
@@ -59,7 +66,7 @@ void GoogleAuth::lookupUserFromSub(QSqlDatabase db, const QString &sub, std::fun
       linkUser.prepare(QStringLiteral("INSERT INTO google_users (sub, user_id) VALUES (?, ?)"));
       linkUser.addBindValue(sub);
       linkUser.addBindValue(userId);
-      if (!linkUser.exec()) {
+      if (!execQuery(linkUser)) {
         qCritical() << "Failed to insert link between Google sub and user ID:" << linkUser.lastError();
         failure();
         return;
@@ -74,7 +81,7 @@ void GoogleAuth::lookupUserFromSub(QSqlDatabase db, const QString &sub, std::fun
 
 void GoogleAuth::handleNewToken(QSqlDatabase db, const QString &token, const QString &redirect_uri, const QString &existingRefresh, std::function<void (qint64)> callback, std::function<void ()> failure) const
 {
-  QNetworkRequest req(QStringLiteral("https://oauth2.googleapis.com/token"));
+  QNetworkRequest req(getEndpoint(QStringLiteral("google_token_url"), QStringLiteral("https://oauth2.googleapis.com/token")));
   req.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/x-www-form-urlencoded"));
 
   QUrlQuery q;
@@ -114,7 +121,7 @@ void GoogleAuth::handleNewToken(QSqlDatabase db, const QString &token, const QSt
     qint64 expiresAt = QDateTime::currentSecsSinceEpoch() + expiresIn;
 
     // Use access token to retrieve Google ID
-    QNetworkRequest idLookup(QStringLiteral("https://www.googleapis.com/oauth2/v2/userinfo"));
+    QNetworkRequest idLookup(getEndpoint(QStringLiteral("google_userinfo_url"), QStringLiteral("https://www.googleapis.com/oauth2/v2/userinfo")));
     idLookup.setRawHeader(QByteArrayLiteral("Authorization"), QByteArrayLiteral("Bearer ").append(accessToken.toUtf8()));
     QNetworkReply *reply = netMan()->get(idLookup);
     connect(reply, &QNetworkReply::finished, this, [this, db, token, callback, failure, accessToken, refreshToken, expiresAt]{
@@ -141,7 +148,7 @@ void GoogleAuth::handleNewToken(QSqlDatabase db, const QString &token, const QSt
 
       insertQuery.addBindValue(accessToken);
       insertQuery.addBindValue(expiresAt);
-      if (!insertQuery.exec()) {
+      if (!execQuery(insertQuery)) {
         qCritical() << "Failed to insert Google token:" << insertQuery.lastError();
         failure();
       } else {
@@ -0,0 +1,77 @@
+#include "mockoauthserver.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+static const QString ACCESS_PREFIX = QStringLiteral("mock-access-");
+static const QString REFRESH_PREFIX = QStringLiteral("mock-refresh-");
+
+MockOAuthServer::MockOAuthServer(QObject *parent) :
+  QObject(parent)
+{
+  m_http = new HttpServer(this);
+  m_http->route(QByteArrayLiteral("POST"), QByteArrayLiteral("/token"), &MockOAuthServer::handleToken);
+  m_http->route(QByteArrayLiteral("GET"), QByteArrayLiteral("/userinfo"), &MockOAuthServer::handleUserInfo);
+}
+
+bool MockOAuthServer::listen(quint16 port)
+{
+  return m_http->listen(QHostAddress::LocalHost, port);
+}
+
+HttpServer::Response MockOAuthServer::handleToken(const HttpServer::Request &r)
+{
+  QUrlQuery form(QString::fromUtf8(r.body));
+
+  QString code;
+  if (form.queryItemValue(QStringLiteral("grant_type"), QUrl::FullyDecoded) == QStringLiteral("refresh_token")) {
+    code = form.queryItemValue(QStringLiteral("refresh_token"), QUrl::FullyDecoded);
+    if (!code.startsWith(REFRESH_PREFIX)) {
+      QJsonObject err;
+      err.insert(QStringLiteral("error"), QStringLiteral("invalid_grant"));
+      return jsonResponse(err, 400);
+    }
+    code.remove(0, REFRESH_PREFIX.size());
+  } else {
+    code = form.queryItemValue(QStringLiteral("code"), QUrl::FullyDecoded);
+  }
+
+  if (code.isEmpty()) {
+    QJsonObject err;
+    err.insert(QStringLiteral("error"), QStringLiteral("invalid_request"));
+    return jsonResponse(err, 400);
+  }
+
+  QJsonObject o;
+  o.insert(QStringLiteral("access_token"), ACCESS_PREFIX + code);
+  o.insert(QStringLiteral("refresh_token"), REFRESH_PREFIX + code);
+  o.insert(QStringLiteral("expires_in"), 3600);
+  o.insert(QStringLiteral("token_type"), QStringLiteral("Bearer"));
+  return jsonResponse(o);
+}
+
+HttpServer::Response MockOAuthServer::handleUserInfo(const HttpServer::Request &r)
+{
+  QString auth = QString::fromUtf8(r.header(QByteArrayLiteral("Authorization")));
+  QString bearer = QStringLiteral("Bearer ") + ACCESS_PREFIX;
+  if (!auth.startsWith(bearer) || auth.size() == bearer.size()) {
+    QJsonObject err;
+    err.insert(QStringLiteral("error"), QStringLiteral("invalid_token"));
+    return jsonResponse(err, 401);
+  }
+
+  QString code = auth.mid(bearer.size());
+
+  QJsonObject o;
+  o.insert(QStringLiteral("id"), QStringLiteral("mock-%1").arg(code));
+  o.insert(QStringLiteral("name"), code);
+  return jsonResponse(o);
+}
+
+HttpServer::Response MockOAuthServer::jsonResponse(const QJsonObject &o, int status)
+{
+  HttpServer::Response r;
+  r.status = status;
+  r.body = QJsonDocument(o).toJson(QJsonDocument::Compact);
+  return r;
+}
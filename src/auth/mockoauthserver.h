@@ -0,0 +1,40 @@
+#ifndef MOCKOAUTHSERVER_H
+#define MOCKOAUTHSERVER_H
+
+#include <QJsonObject>
+
+#include "../httpserver.h"
+
+/**
+ * @brief Local imitation of Google's OAuth token and userinfo endpoints
+ *
+ * Point `google_token_url` and `google_userinfo_url` at this server to exercise GoogleAuth's full
+ * code path offline. Every auth code is accepted and maps deterministically to the Google ID
+ * "mock-<code>", so repeated runs resolve to the same users.
+ */
+class MockOAuthServer : public QObject
+{
+  Q_OBJECT
+public:
+  explicit MockOAuthServer(QObject *parent = nullptr);
+
+  bool listen(quint16 port);
+
+  bool adoptListeningSocket(int fd) { return m_http->adoptListeningSocket(fd); }
+  int listeningDescriptor() const { return m_http->listeningDescriptor(); }
+
+  void close() { m_http->close(); }
+
+  void setResponseDelay(int ms) { m_http->setResponseDelay(ms); }
+
+private:
+  static HttpServer::Response handleToken(const HttpServer::Request &r);
+  static HttpServer::Response handleUserInfo(const HttpServer::Request &r);
+
+  static HttpServer::Response jsonResponse(const QJsonObject &o, int status = 200);
+
+  HttpServer *m_http;
+
+};
+
+#endif // MOCKOAUTHSERVER_H
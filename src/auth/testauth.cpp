@@ -0,0 +1,113 @@
+#include "testauth.h"
+
+void TestAuth::authenticate(QSqlDatabase db, const QString &token, const QString &redirect_uri, std::function<void(qint64)> callback, std::function<void ()> failure) const
+{
+  Q_UNUSED(redirect_uri)
+
+  if (!isValidToken(token)) {
+    failure();
+    return;
+  }
+
+  qint64 userId;
+  if (!findTestUser(db, token, &userId)) {
+    failure();
+    return;
+  }
+
+  if (userId == 0) {
+    userId = createTestUser(db, token);
+  }
+
+  if (userId == 0) {
+    failure();
+  } else {
+    callback(userId);
+  }
+}
+
+bool TestAuth::isValidToken(const QString &token)
+{
+  // Generated display name must fit in the 32 character limit
+  if (token.isEmpty() || token.size() > 27) {
+    return false;
+  }
+
+  for (const QChar &c : token) {
+    bool valid = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
+    if (!valid) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TestAuth::findTestUser(QSqlDatabase db, const QString &token, qint64 *userId)
+{
+  QSqlQuery lookupUser(db);
+  lookupUser.prepare(QStringLiteral("SELECT user_id FROM test_users WHERE token = ?"));
+  lookupUser.addBindValue(token);
+  if (!execQuery(lookupUser)) {
+    qCritical() << "Failed to look up test user:" << lookupUser.lastError();
+    return false;
+  }
+
+  *userId = lookupUser.next() ? lookupUser.value(QStringLiteral("user_id")).toLongLong() : 0;
+  return true;
+}
+
+qint64 TestAuth::createTestUser(QSqlDatabase db, const QString &token) const
+{
+  // Another node may be logging the same token in for the first time. Whichever links it second
+  // rolls its user back instead of leaving it orphaned, and uses the other one.
+  if (!db.transaction()) {
+    qCritical() << "Failed to start transaction for test user:" << db.lastError();
+    return 0;
+  }
+
+  qint64 userId = createNewUser(db);
+  if (userId == 0) {
+    db.rollback();
+    return 0;
+  }
+
+  {
+    QSqlQuery linkUser(db);
+    linkUser.prepare(QStringLiteral("INSERT INTO test_users (token, user_id) VALUES (?, ?)"));
+    linkUser.addBindValue(token);
+    linkUser.addBindValue(userId);
+    if (!execQuery(linkUser)) {
+      db.rollback();
+
+      qint64 existing;
+      if (findTestUser(db, token, &existing) && existing != 0) {
+        return existing;
+      }
+
+      qCritical() << "Failed to insert link between test token and user ID:" << linkUser.lastError();
+      return 0;
+    }
+  }
+
+  if (!db.commit()) {
+    qCritical() << "Failed to commit test user:" << db.lastError();
+    db.rollback();
+    return 0;
+  }
+
+  {
+    // Give the user a name straight away so they can chat without a rename, and backdate the
+    // account so follow mode doesn't silence a freshly created load test
+    QSqlQuery nameQuery(db);
+    nameQuery.prepare(QStringLiteral("UPDATE users SET display_name = ?, created_at = 0 WHERE id = ?"));
+    nameQuery.addBindValue(QStringLiteral("test_%1").arg(token));
+    nameQuery.addBindValue(userId);
+    if (!execQuery(nameQuery)) {
+      // Most likely a real user already has this name, they'll be asked to rename instead
+      qWarning() << "Failed to set display name for test user" << token << nameQuery.lastError();
+    }
+  }
+
+  return userId;
+}
@@ -0,0 +1,35 @@
+#ifndef TESTAUTH_H
+#define TESTAUTH_H
+
+#include "authmodule.h"
+
+/**
+ * @brief Stand-in auth module for load testing without live OAuth endpoints
+ *
+ * Accepts any token made of letters, numbers, and underscores, and deterministically maps it to a
+ * user named "test_<token>". Only registered when `test_auth` is enabled in config.json, and must
+ * never be enabled on a public server since anyone can log in as any test user.
+ */
+class TestAuth : public AuthModule
+{
+  Q_OBJECT
+public:
+  TestAuth(QObject *parent) : AuthModule(parent){}
+
+  virtual QString id() const override { return QStringLiteral("test"); }
+
+  virtual void authenticate(QSqlDatabase db, const QString &token, const QString &redirect_uri, std::function<void(qint64)> callback, std::function<void()> failure) const override;
+
+  static bool isValidToken(const QString &token);
+
+private:
+  /**
+   * @brief Sets userId to the user linked to token, or 0 if there isn't one yet
+   */
+  static bool findTestUser(QSqlDatabase db, const QString &token, qint64 *userId);
+
+  qint64 createTestUser(QSqlDatabase db, const QString &token) const;
+
+};
+
+#endif // TESTAUTH_H
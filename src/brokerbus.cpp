@@ -0,0 +1,158 @@
+#include "brokerbus.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+
+namespace
+{
+
+const int RETRY_INTERVAL = 2000;
+
+}
+
+BrokerBus::BrokerBus(const QString &nodeId, const QString &secret, QObject *parent) :
+  EventBus(nodeId, parent),
+  m_secret(secret),
+  m_local(nullptr),
+  m_tcp(nullptr),
+  m_port(0),
+  m_connected(false),
+  m_warnedDown(false)
+{
+  m_retryTimer.setInterval(RETRY_INTERVAL);
+  connect(&m_retryTimer, &QTimer::timeout, this, &BrokerBus::retry);
+}
+
+void BrokerBus::connectToUnixSocket(const QString &path)
+{
+  m_path = path;
+
+  m_local = new QLocalSocket(this);
+  connect(m_local, &QLocalSocket::connected, this, &BrokerBus::socketConnected);
+  connect(m_local, &QLocalSocket::disconnected, this, &BrokerBus::socketDisconnected);
+  connect(m_local, &QLocalSocket::readyRead, this, &BrokerBus::readFrames);
+
+  m_retryTimer.start();
+  retry();
+}
+
+void BrokerBus::connectToHost(const QString &host, quint16 port)
+{
+  m_host = host;
+  m_port = port;
+
+  m_tcp = new QTcpSocket(this);
+  m_tcp->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+  connect(m_tcp, &QTcpSocket::connected, this, &BrokerBus::socketConnected);
+  connect(m_tcp, &QTcpSocket::disconnected, this, &BrokerBus::socketDisconnected);
+  connect(m_tcp, &QTcpSocket::readyRead, this, &BrokerBus::readFrames);
+
+  m_retryTimer.start();
+  retry();
+}
+
+QIODevice *BrokerBus::device() const
+{
+  if (m_local) {
+    return m_local;
+  }
+  return m_tcp;
+}
+
+bool BrokerBus::isUnconnected() const
+{
+  if (m_local) {
+    return m_local->state() == QLocalSocket::UnconnectedState;
+  }
+  return m_tcp->state() == QAbstractSocket::UnconnectedState;
+}
+
+void BrokerBus::retry()
+{
+  if (!isUnconnected()) {
+    return;
+  }
+
+  if (m_local) {
+    m_local->connectToServer(m_path);
+  } else {
+    m_tcp->connectToHost(m_host, m_port);
+  }
+}
+
+void BrokerBus::socketConnected()
+{
+  m_connected = true;
+  m_warnedDown = false;
+  m_readBuffer.clear();
+
+  QJsonObject hello;
+  hello.insert(QStringLiteral("n"), nodeId());
+  hello.insert(QStringLiteral("secret"), m_secret);
+  write(hello);
+
+  qDebug() << "Connected to cluster broker as" << nodeId();
+  emit connected();
+}
+
+void BrokerBus::socketDisconnected()
+{
+  if (m_connected) {
+    qWarning() << "Lost connection to cluster broker, retrying";
+  }
+  m_connected = false;
+}
+
+void BrokerBus::readFrames()
+{
+  m_readBuffer.append(device()->readAll());
+
+  QByteArray payload;
+  bool error;
+  while (takeFrame(&m_readBuffer, &payload, &error)) {
+    QJsonObject o = QJsonDocument::fromJson(payload).object();
+
+    QString origin = o.value(QStringLiteral("n")).toString();
+    if (origin == nodeId()) {
+      continue;
+    }
+
+    int type = o.value(QStringLiteral("t")).toInt(-1);
+    if (type < 0 || type >= EVENT_COUNT) {
+      continue;
+    }
+
+    emit received(type, origin, o.value(QStringLiteral("d")).toObject());
+  }
+
+  if (error) {
+    qCritical() << "Oversized frame from cluster broker, reconnecting";
+    if (m_local) {
+      m_local->abort();
+    } else {
+      m_tcp->abort();
+    }
+  }
+}
+
+void BrokerBus::publish(EventType type, const QJsonObject &data)
+{
+  if (!m_connected) {
+    if (!m_warnedDown) {
+      qWarning() << "Cluster broker unavailable, events for other nodes are being dropped";
+      m_warnedDown = true;
+    }
+    return;
+  }
+
+  QJsonObject o;
+  o.insert(QStringLiteral("t"), int(type));
+  o.insert(QStringLiteral("n"), nodeId());
+  o.insert(QStringLiteral("d"), data);
+  write(o);
+}
+
+void BrokerBus::write(const QJsonObject &o)
+{
+  device()->write(encodeFrame(QJsonDocument(o).toJson(QJsonDocument::Compact)));
+}
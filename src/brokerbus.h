@@ -0,0 +1,57 @@
+#ifndef BROKERBUS_H
+#define BROKERBUS_H
+
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "eventbus.h"
+
+/**
+ * @brief Event bus through a kcchat-broker process over a UNIX or TCP socket
+ *
+ * Events are compact JSON objects {"t":type,"n":node,"d":data} in length-prefixed frames. The
+ * first frame sent after connecting authenticates the node with {"n":node,"secret":...}. The
+ * connection is retried every couple of seconds while the broker is unreachable, and events
+ * published in the meantime are dropped rather than delivered late.
+ */
+class BrokerBus : public EventBus
+{
+  Q_OBJECT
+public:
+  BrokerBus(const QString &nodeId, const QString &secret, QObject *parent = nullptr);
+
+  void connectToUnixSocket(const QString &path);
+  void connectToHost(const QString &host, quint16 port);
+
+  virtual bool isConnected() const override { return m_connected; }
+
+  virtual void publish(EventType type, const QJsonObject &data) override;
+
+private slots:
+  void retry();
+  void socketConnected();
+  void socketDisconnected();
+  void readFrames();
+
+private:
+  QIODevice *device() const;
+  bool isUnconnected() const;
+  void write(const QJsonObject &o);
+
+  QString m_secret;
+
+  QLocalSocket *m_local;
+  QTcpSocket *m_tcp;
+  QString m_path;
+  QString m_host;
+  quint16 m_port;
+
+  bool m_connected;
+  bool m_warnedDown;
+  QByteArray m_readBuffer;
+  QTimer m_retryTimer;
+
+};
+
+#endif // BROKERBUS_H
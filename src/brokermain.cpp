@@ -0,0 +1,45 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <signal.h>
+
+#include "eventbroker.h"
+
+/**
+ * @brief Handle Ctrl+C in a safe way
+ */
+void safeExit(int s)
+{
+  qApp->quit();
+}
+
+int main(int argc, char *argv[])
+{
+  signal(SIGINT, safeExit);
+  signal(SIGTERM, safeExit);
+
+  QCoreApplication a(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("kcchat-broker"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QStringLiteral("Relays events between kcchat nodes running with cluster_broker set"));
+  parser.addHelpOption();
+
+  QCommandLineOption listenOption(QStringLiteral("listen"), QStringLiteral("Address to listen on, unix:<path> or tcp:<host>:<port>."), QStringLiteral("address"), QStringLiteral("unix:/tmp/kcchat-bus.sock"));
+  QCommandLineOption secretOption(QStringLiteral("secret"), QStringLiteral("Shared secret nodes must present, defaults to $KCCHAT_CLUSTER_SECRET."), QStringLiteral("secret"));
+
+  parser.addOptions({listenOption, secretOption});
+  parser.process(a);
+
+  QString secret = parser.isSet(secretOption) ? parser.value(secretOption) : qEnvironmentVariable("KCCHAT_CLUSTER_SECRET");
+  if (secret.isEmpty() && parser.value(listenOption).startsWith(QStringLiteral("tcp:"))) {
+    qWarning() << "No secret set, any host that can reach the broker can join the cluster";
+  }
+
+  EventBroker broker(secret);
+  if (!broker.listen(parser.value(listenOption))) {
+    return 1;
+  }
+
+  return a.exec();
+}
@@ -0,0 +1,366 @@
+#include "chatserver.h"
+
+#include <QCoreApplication>
+#include <QSysInfo>
+
+void ChatServer::startCluster()
+{
+  QString broker = CONFIG[QStringLiteral("cluster_broker")].toString();
+  if (broker.isEmpty()) {
+    return;
+  }
+
+  QString node = clusterNodeId();
+  if (!connectBus(broker, node, CONFIG[QStringLiteral("cluster_secret")].toString())) {
+    qCritical() << "Invalid cluster_broker address" << broker;
+    return;
+  }
+
+  qDebug() << "Joining cluster through" << broker << "as" << node;
+}
+
+QString ChatServer::clusterNodeId()
+{
+  QString name = CONFIG[QStringLiteral("cluster_node")].toString();
+  if (name.isEmpty()) {
+    name = QSysInfo::machineHostName();
+  }
+
+  // A process being upgraded is still on the bus under the same name as its replacement
+  return QStringLiteral("%1:%2").arg(name, QString::number(QCoreApplication::applicationPid()));
+}
+
+bool ChatServer::connectBus(const QString &address, const QString &node, const QString &secret)
+{
+  EventBus *bus = EventBus::create(address, node, secret, this);
+  if (!bus) {
+    return false;
+  }
+
+  if (m_bus) {
+    m_bus->disconnect(this);
+    m_bus->deleteLater();
+  }
+
+  m_bus = bus;
+  m_busAddress = address;
+  connect(m_bus, &EventBus::connected, this, &ChatServer::busConnected);
+  connect(m_bus, &EventBus::received, this, &ChatServer::handleBusEvent);
+
+  return true;
+}
+
+void ChatServer::joinDrainBus(const QString &address, const QString &secret)
+{
+  if (address.isEmpty() || address == m_busAddress) {
+    return;
+  }
+
+  if (!connectBus(address, clusterNodeId(), secret)) {
+    qCritical() << "Invalid event bus address from the new process" << address;
+    return;
+  }
+
+  m_joinedDrainBus = true;
+  qDebug() << "Joining the new process's event bus" << address << "while draining";
+}
+
+void ChatServer::publishEvent(EventBus::EventType type, const QJsonObject &data)
+{
+  if (m_bus) {
+    m_bus->publish(type, data);
+  }
+}
+
+void ChatServer::publishPresenceSync(bool wantReply)
+{
+  // Authors per room, rooms nobody is in are left out
+  QJsonObject rooms;
+  for (const ChatRoom *room : qAsConst(m_rooms)) {
+    const QList<qint64> local = room->clients().authors();
+    if (local.isEmpty()) {
+      continue;
+    }
+
+    QJsonArray authors;
+    for (qint64 a : local) {
+      authors.append(a);
+    }
+    rooms.insert(room->name(), authors);
+  }
+
+  QJsonObject event;
+  event.insert(QStringLiteral("rooms"), rooms);
+  event.insert(QStringLiteral("reply"), wantReply);
+  publishEvent(EventBus::EVENT_PRESENCE_SYNC, event);
+}
+
+void ChatServer::publishSettings(ChatRoom *room)
+{
+  const ChatRoom::Settings &settings = room->settings();
+
+  QJsonObject event;
+  event.insert(QStringLiteral("room"), room->name());
+  event.insert(QStringLiteral("slow"), double(settings.slowMode));
+  event.insert(QStringLiteral("duplicate"), double(settings.duplicateSlowMode));
+  event.insert(QStringLiteral("follow"), double(settings.followMode));
+  publishEvent(EventBus::EVENT_SETTINGS, event);
+}
+
+void ChatServer::publishTimer(ChatRoom *room, const QString &name, qint64 started)
+{
+  QJsonObject event;
+  event.insert(QStringLiteral("room"), room->name());
+  event.insert(QStringLiteral("name"), name);
+  event.insert(QStringLiteral("started"), started);
+  publishEvent(EventBus::EVENT_TIMER, event);
+}
+
+void ChatServer::publishResponse(ChatRoom *room, const QString &command, const QString &response)
+{
+  QJsonObject event;
+  event.insert(QStringLiteral("room"), room->name());
+  event.insert(QStringLiteral("command"), command);
+  event.insert(QStringLiteral("response"), response);
+  publishEvent(EventBus::EVENT_RESPONSE, event);
+}
+
+void ChatServer::setRemotePresence(ChatRoom *room, const QString &node, const QSet<qint64> &authors)
+{
+  QSet<qint64> old = room->remotePresence(node);
+  room->setRemotePresence(node, authors);
+
+  // Only changes to who is in the room anywhere in the cluster are shown
+  for (qint64 a : authors) {
+    if (!old.contains(a) && !room->clients().containsAuthor(a) && !room->isPresentRemotely(a, node)) {
+      broadcastPresence(room, a, true);
+    }
+  }
+  for (qint64 a : qAsConst(old)) {
+    if (!authors.contains(a) && !room->clients().containsAuthor(a) && !room->isPresentRemotely(a)) {
+      broadcastPresence(room, a, false);
+    }
+  }
+}
+
+void ChatServer::busConnected()
+{
+  // Whatever happened on other nodes while the bus was down is only in the database now
+  invalidateHistory();
+
+  // Same goes for the new process, for whatever this one published before joining its bus
+  if (m_joinedDrainBus) {
+    m_joinedDrainBus = false;
+
+    QJsonObject event;
+    event.insert(QStringLiteral("invalidate"), true);
+    publishEvent(EventBus::EVENT_BROADCAST, event);
+  }
+
+  publishPresenceSync(true);
+}
+
+void ChatServer::handleBusEvent(int type, const QString &origin, const QJsonObject &data)
+{
+  // Nodes don't have to host the same rooms, events for rooms this one doesn't have are ignored
+  QString roomName = data.value(QStringLiteral("room")).toString();
+  ChatRoom *room = findRoom(roomName);
+
+  switch (static_cast<EventBus::EventType>(type)) {
+  case EventBus::EVENT_PUBLISH:
+  {
+    if (!room) {
+      break;
+    }
+
+    QString packet = data.value(QStringLiteral("packet")).toString();
+    room->insertHistory(qint64(data.value(QStringLiteral("id")).toDouble()), packet);
+    room->clients().broadcastTextMessage(packet);
+    break;
+  }
+  case EventBus::EVENT_DELETE:
+  {
+    QVector<qint64> ids;
+    const QJsonArray a = data.value(QStringLiteral("ids")).toArray();
+    for (const QJsonValue &v : a) {
+      ids.append(qint64(v.toDouble()));
+    }
+
+    // The origin already updated the database. No room means the messages came from all of them.
+    QString packet = generateDeletePacket(ids);
+    if (roomName.isEmpty()) {
+      invalidateHistory();
+      broadcastToAllRooms(packet);
+    } else if (room) {
+      room->invalidateHistory();
+      room->clients().broadcastTextMessage(packet);
+    }
+    break;
+  }
+  case EventBus::EVENT_BROADCAST:
+  {
+    if (data.value(QStringLiteral("invalidate")).toBool()) {
+      invalidateHistory();
+    }
+
+    const QJsonArray packets = data.value(QStringLiteral("packets")).toArray();
+    for (const QJsonValue &v : packets) {
+      broadcastToAllRooms(v.toString());
+    }
+    break;
+  }
+  case EventBus::EVENT_USER:
+  {
+    qint64 id = qint64(data.value(QStringLiteral("id")).toDouble());
+    const QList<QWebSocket*> skts = socketsForAuthor(id);
+
+    if (!data.value(QStringLiteral("banned")).toBool()) {
+      for (QWebSocket *s : skts) {
+        sendUserState(s, id);
+      }
+      break;
+    }
+
+    bool andIP = data.value(QStringLiteral("ip")).toBool();
+    qint64 banEnd = qint64(data.value(QStringLiteral("until")).toDouble());
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    for (QWebSocket *s : skts) {
+      sendUserStatusMessage(s, STATUS_BANNED);
+
+      if (andIP) {
+        QSqlQuery banIpQuery(m_db);
+        banIpQuery.prepare(QStringLiteral("INSERT INTO banned_hosts (host, started, until) VALUES (?, ?, ?)"));
+        banIpQuery.addBindValue(s->peerAddress().toString());
+        banIpQuery.addBindValue(now);
+        banIpQuery.addBindValue(banEnd);
+        if (!execQuery(banIpQuery)) {
+          qCritical() << "Failed to insert IP into banned hosts:" << banIpQuery.lastError();
+        }
+      }
+    }
+    break;
+  }
+  case EventBus::EVENT_PRESENCE:
+  {
+    if (!room) {
+      break;
+    }
+
+    qint64 author = qint64(data.value(QStringLiteral("author")).toDouble());
+    QSet<qint64> authors = room->remotePresence(origin);
+    if (data.value(QStringLiteral("joined")).toBool()) {
+      authors.insert(author);
+    } else {
+      authors.remove(author);
+    }
+    setRemotePresence(room, origin, authors);
+    break;
+  }
+  case EventBus::EVENT_PRESENCE_SYNC:
+  {
+    const QJsonObject rooms = data.value(QStringLiteral("rooms")).toObject();
+    for (ChatRoom *r : qAsConst(m_rooms)) {
+      QSet<qint64> authors;
+      const QJsonArray a = rooms.value(r->name()).toArray();
+      for (const QJsonValue &v : a) {
+        authors.insert(qint64(v.toDouble()));
+      }
+      setRemotePresence(r, origin, authors);
+    }
+
+    // A node that just (re)joined also needs the runtime settings it missed
+    if (data.value(QStringLiteral("reply")).toBool()) {
+      publishPresenceSync(false);
+      for (ChatRoom *r : qAsConst(m_rooms)) {
+        publishSettings(r);
+      }
+    }
+    break;
+  }
+  case EventBus::EVENT_NODES:
+  {
+    QSet<QString> nodes;
+    const QJsonArray a = data.value(QStringLiteral("nodes")).toArray();
+    for (const QJsonValue &v : a) {
+      nodes.insert(v.toString());
+    }
+
+    for (ChatRoom *r : qAsConst(m_rooms)) {
+      const QStringList known = r->remoteNodes();
+      for (const QString &node : known) {
+        if (!nodes.contains(node)) {
+          qDebug() << "Cluster node" << node << "left" << r->name();
+          setRemotePresence(r, node, QSet<qint64>());
+        }
+      }
+    }
+    break;
+  }
+  case EventBus::EVENT_SETTINGS:
+  {
+    if (!room) {
+      break;
+    }
+
+    ChatRoom::Settings &settings = room->settings();
+    settings.slowMode = quint64(data.value(QStringLiteral("slow")).toDouble());
+    settings.duplicateSlowMode = quint64(data.value(QStringLiteral("duplicate")).toDouble());
+    settings.followMode = quint64(data.value(QStringLiteral("follow")).toDouble());
+    break;
+  }
+  case EventBus::EVENT_TIMER:
+  {
+    if (!room) {
+      break;
+    }
+
+    QString name = data.value(QStringLiteral("name")).toString();
+    qint64 started = qint64(data.value(QStringLiteral("started")).toDouble());
+    if (started) {
+      room->timers().insert(name, started);
+    } else {
+      room->timers().remove(name);
+    }
+    break;
+  }
+  case EventBus::EVENT_RESPONSE:
+  {
+    if (!room) {
+      break;
+    }
+
+    QString command = data.value(QStringLiteral("command")).toString();
+    QString response = data.value(QStringLiteral("response")).toString();
+    if (response.isEmpty()) {
+      room->responses().remove(command);
+    } else {
+      insertSimpleResponse(room, command, response);
+    }
+    break;
+  }
+  case EventBus::EVENT_OVERLAY:
+  {
+    OverlayMessage msg(static_cast<OverlayMessage::Type>(data.value(QStringLiteral("type")).toInt()));
+    msg.setAlertTitle(data.value(QStringLiteral("title")).toString());
+    msg.setAlertSubtitle(data.value(QStringLiteral("subtitle")).toString());
+    msg.setJokeName(data.value(QStringLiteral("joke")).toString());
+    if (msg.type() == OverlayMessage::MSG_COMMAND) {
+      msg.setCommand(static_cast<OverlayMessage::CommandType>(data.value(QStringLiteral("command")).toInt()));
+    }
+    if (msg.type() != OverlayMessage::MSG_NONE) {
+      deliverOverlayMessage(msg);
+    }
+    break;
+  }
+  case EventBus::EVENT_RELOAD:
+  {
+    if (CONFIG.reload()) {
+      qDebug() << "Reloaded config.json for" << origin;
+      applyLiveConfig();
+    }
+    break;
+  }
+  case EventBus::EVENT_COUNT:
+    break;
+  }
+}
@@ -1,58 +1,83 @@
 #include "chatserver.h"
 
-void ChatServer::initCommands()
+constexpr ChatServer::BuiltinCommand ChatServer::BUILTIN_COMMANDS[] = {
+  {"addcom", &ChatServer::commandAddCom, Authorization::AUTH_MOD},
+  {"alert", &ChatServer::commandAlert, Authorization::AUTH_MOD},
+  {"editcom", &ChatServer::commandEditCom, Authorization::AUTH_MOD},
+  {"delcom", &ChatServer::commandDelCom, Authorization::AUTH_MOD},
+  {"commands", &ChatServer::commandHelp, Authorization::AUTH_USER},
+  {"help", &ChatServer::commandHelp, Authorization::AUTH_USER},
+  {"autotts", &ChatServer::commandAutoTTS, Authorization::AUTH_MOD},
+  {"nexttts", &ChatServer::commandNextTTS, Authorization::AUTH_MOD},
+  {"pausetts", &ChatServer::commandPauseTTS, Authorization::AUTH_MOD},
+  {"purgetts", &ChatServer::commandPurgeTTS, Authorization::AUTH_MOD},
+  {"say", &ChatServer::commandSay, Authorization::AUTH_MOD},
+  //{"shoutout", &ChatServer::commandShoutout, Authorization::AUTH_USER},
+  {"skiptts", &ChatServer::commandSkipTTS, Authorization::AUTH_MOD},
+  //{"so", &ChatServer::commandShoutout, Authorization::AUTH_USER},
+  {"time", &ChatServer::commandTime, Authorization::AUTH_USER},
+  {"timer", &ChatServer::commandTimer, Authorization::AUTH_USER},
+  {"info", &ChatServer::commandInfo, Authorization::AUTH_USER},
+  {"followmode", &ChatServer::commandFollowMode, Authorization::AUTH_MOD},
+
+  {"ban", &ChatServer::commandBan, Authorization::AUTH_MOD},
+  {"unban", &ChatServer::commandUnban, Authorization::AUTH_MOD},
+  {"ipban", &ChatServer::commandIpBan, Authorization::AUTH_MOD},
+  {"ip", &ChatServer::commandIpBan, Authorization::AUTH_MOD},
+  {"slowmode", &ChatServer::commandSlowMode, Authorization::AUTH_MOD},
+  {"slow", &ChatServer::commandSlowMode, Authorization::AUTH_MOD},
+  {"mod", &ChatServer::commandMod, Authorization::AUTH_ADMIN},
+  {"unmod", &ChatServer::commandUnmod, Authorization::AUTH_ADMIN},
+  {"delete", &ChatServer::commandDelMsg, Authorization::AUTH_MOD},
+  {"del", &ChatServer::commandDelMsg, Authorization::AUTH_MOD},
+  {"rm", &ChatServer::commandDelMsg, Authorization::AUTH_MOD},
+  {"video", &ChatServer::commandVideo, Authorization::AUTH_ADMIN},
+  {"admission", &ChatServer::commandAdmission, Authorization::AUTH_MOD},
+  {"dbstats", &ChatServer::commandDbStats, Authorization::AUTH_ADMIN},
+  {"reloadconfig", &ChatServer::commandReloadConfig, Authorization::AUTH_ADMIN}
+};
+
+// Seed and slots are found at compile time, adding a command just makes the search run again
+constexpr PerfectHash::Table<256> ChatServer::BUILTIN_COMMAND_TABLE = PerfectHash::build<256>(ChatServer::BUILTIN_COMMANDS);
+
+ChatServer::CommandMatch ChatServer::findCommand(const ChatRoom *room, QStringView command) const
 {
-  insertCommand(QStringLiteral("addcom"), &ChatServer::commandAddCom, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("alert"), &ChatServer::commandAlert, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("editcom"), &ChatServer::commandEditCom, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("delcom"), &ChatServer::commandDelCom, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("commands"), &ChatServer::commandHelp, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("help"), &ChatServer::commandHelp, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("autotts"), &ChatServer::commandAutoTTS, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("nexttts"), &ChatServer::commandNextTTS, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("pausetts"), &ChatServer::commandPauseTTS, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("purgetts"), &ChatServer::commandPurgeTTS, Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("say"), &ChatServer::commandSay, Authorization::AUTH_MOD);
-  //insertCommand(QStringLiteral("shoutout"), &ChatServer::commandShoutout, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("skiptts"), &ChatServer::commandSkipTTS, Authorization::AUTH_MOD);
-  //insertCommand(QStringLiteral("so"), &ChatServer::commandShoutout, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("time"), &ChatServer::commandTime, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("timer"), &ChatServer::commandTimer, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("info"), &ChatServer::commandInfo, Authorization::AUTH_USER);
-  insertCommand(QStringLiteral("followmode"), &ChatServer::commandFollowMode, Authorization::AUTH_MOD);
-
-  insertCommand(QStringLiteral("ban"), static_cast<CommandHandler_t>(&ChatServer::commandBan), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("unban"), static_cast<CommandHandler_t>(&ChatServer::commandUnban), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("ipban"), static_cast<CommandHandler_t>(&ChatServer::commandIpBan), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("ip"), static_cast<CommandHandler_t>(&ChatServer::commandIpBan), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("slowmode"), static_cast<CommandHandler_t>(&ChatServer::commandSlowMode), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("slow"), static_cast<CommandHandler_t>(&ChatServer::commandSlowMode), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("mod"), static_cast<CommandHandler_t>(&ChatServer::commandMod), Authorization::AUTH_ADMIN);
-  insertCommand(QStringLiteral("unmod"), static_cast<CommandHandler_t>(&ChatServer::commandUnmod), Authorization::AUTH_ADMIN);
-  insertCommand(QStringLiteral("delete"), static_cast<CommandHandler_t>(&ChatServer::commandDelMsg), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("del"), static_cast<CommandHandler_t>(&ChatServer::commandDelMsg), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("rm"), static_cast<CommandHandler_t>(&ChatServer::commandDelMsg), Authorization::AUTH_MOD);
-  insertCommand(QStringLiteral("video"), static_cast<CommandHandler_t>(&ChatServer::commandVideo), Authorization::AUTH_ADMIN);
+  static_assert(BUILTIN_COMMAND_TABLE.seed != PerfectHash::NO_SEED, "Failed to find a perfect hash for built-in commands");
+
+  CommandMatch m;
+
+  int builtin = PerfectHash::find(BUILTIN_COMMAND_TABLE, BUILTIN_COMMANDS, command);
+  if (builtin != -1) {
+    const BuiltinCommand &c = BUILTIN_COMMANDS[builtin];
+    m.found = true;
+    m.handler = c.handler;
+    m.authorization = c.authorization;
+  } else {
+    m.found = room->responses().find(command, &m.response);
+  }
+
+  return m;
 }
 
 ChatServer::Response ChatServer::commandAddCom(const Request &r)
 {
-  if (r.args().size() >= 3) {
-    QString newcom = r.args().at(1).toLower();
+  if (r.argCount() >= 3) {
+    QString newcom = r.arg(1).toLower();
 
-    if (m_commandMap.contains(newcom)) {
+    if (findCommand(r.room(), newcom).found) {
       return Response(r, tr("Command \"%1\" already exists").arg(newcom));
     } else {
-      QString response = r.args().mid(2).join(' ');
-      m_simpleResponses.insert(newcom, response);
-      insertCommand(newcom, &ChatServer::commandSimpleResponse, Authorization::AUTH_USER);
+      QString response = r.joinArgs(2);
+      insertSimpleResponse(r.room(), newcom, response);
+      publishResponse(r.room(), newcom, response);
 
       // Add to database
       QSqlQuery q(m_db);
-      q.prepare(QStringLiteral("INSERT INTO responses (command, response) VALUES (?, ?)"));
+      q.prepare(QStringLiteral("INSERT INTO responses (room, command, response) VALUES (?, ?, ?)"));
+      q.addBindValue(r.room()->name());
       q.addBindValue(newcom);
       q.addBindValue(response);
-      if (!q.exec()) {
+      if (!execQuery(q)) {
         qCritical() << "Failed to add simple response:" << q.lastError();
       }
 
@@ -65,17 +90,17 @@ ChatServer::Response ChatServer::commandAddCom(const Request &r)
 
 ChatServer::Response ChatServer::commandAlert(const Request &r)
 {
-  if (r.args().size() == 2 || r.args().size() == 3) {
-    emit requestOverlayMessage(OverlayMessage::Alert(r.args().at(1), r.args().size() == 3 ? r.args().at(2) : QString()));
+  if (r.argCount() == 2 || r.argCount() == 3) {
+    sendOverlayMessage(OverlayMessage::Alert(r.arg(1), r.argCount() == 3 ? r.arg(2) : QString()));
     return Response(r, tr("Alert submitted successfully"));
   } else {
     return Response(r, tr("Usage: %1 <title> [subtitle]").arg(r.command()));
   }
 }
 
-ChatServer::Response ChatServer::doMention(const Request &r)
+void ChatServer::loadMentionRules()
 {
-  static const QStringList helloWords = {
+  static const char *GREETINGS[] = {
     "hello",
     "hi",
     "hey",
@@ -87,28 +112,25 @@ ChatServer::Response ChatServer::doMention(const Request &r)
     "what's up"
   };
 
-  bool isGreeting = false;
+  m_mentions.setName(CONFIG.live().botName);
 
-  QStringList words = r.line().split(' ');
-  for (const QString &h : helloWords) {
-    if (h.contains(' ')) {
-      if (r.line().contains(h)) {
-        isGreeting = true;
-        break;
-      }
-    } else if (words.contains(h, Qt::CaseInsensitive)) {
-      isGreeting = true;
-      break;
-    }
+  m_mentions.clearRules();
+  for (const char *g : GREETINGS) {
+    m_mentions.addRule(QString::fromLatin1(g), MENTION_GREETING);
   }
+}
+
+ChatServer::Response ChatServer::doMention(const Request &r)
+{
+  MentionMatcher::Result mention = m_mentions.match(r.line());
 
-  if (isGreeting) {
+  if (mention.tag == MENTION_GREETING) {
     if (r.authorization() >= Authorization::AUTH_MEMBER) {
       return Response(r, tr("Hey @%1!").arg(r.author()), true);
     } else {
       return Response(r, tr("I only say hello to subscribers"), true);
     }
-  } else if (r.line().startsWith(QStringLiteral("@%1").arg(CONFIG[QStringLiteral("bot_name")].toString()), Qt::CaseInsensitive) && r.line().endsWith('?')) {
+  } else if (mention.leading && r.line().endsWith('?')) {
     static const QStringList random_replies = {
       "It is certain.",
       "It is decidedly so.",
@@ -140,20 +162,23 @@ ChatServer::Response ChatServer::doMention(const Request &r)
 
 ChatServer::Response ChatServer::commandEditCom(const Request &r)
 {
-  if (r.args().size() >= 3) {
-    QString editcom = r.args().at(1).toLower();
+  if (r.argCount() >= 3) {
+    QString editcom = r.arg(1).toLower();
 
-    if (m_commandMap.contains(editcom)) {
-      if (m_commandMap.value(editcom).handler == &ChatServer::commandSimpleResponse) {
-        QString response = r.args().mid(2).join(' ');
-        m_simpleResponses.insert(editcom, response);
+    CommandMatch match = findCommand(r.room(), editcom);
+    if (match.found) {
+      if (!match.handler) {
+        QString response = r.joinArgs(2);
+        insertSimpleResponse(r.room(), editcom, response);
+        publishResponse(r.room(), editcom, response);
 
         // Edit command in database
         QSqlQuery q(m_db);
-        q.prepare(QStringLiteral("UPDATE responses SET response = ? WHERE command = ?"));
+        q.prepare(QStringLiteral("UPDATE responses SET response = ? WHERE room = ? AND command = ?"));
         q.addBindValue(response);
+        q.addBindValue(r.room()->name());
         q.addBindValue(editcom);
-        if (!q.exec()) {
+        if (!execQuery(q)) {
           qCritical() << "Failed to edit simple response:" << q.lastError();
         }
 
@@ -171,20 +196,22 @@ ChatServer::Response ChatServer::commandEditCom(const Request &r)
 
 ChatServer::Response ChatServer::commandDelCom(const Request &r)
 {
-  if (r.args().size() == 2) {
-    QString delcom = r.args().at(1).toLower();
+  if (r.argCount() == 2) {
+    QString delcom = r.arg(1).toLower();
 
-    if (m_commandMap.contains(delcom)) {
-      if (m_commandMap.value(delcom).handler == &ChatServer::commandSimpleResponse) {
-        // Delete command from response and command maps
-        m_simpleResponses.remove(delcom);
-        m_commandMap.remove(delcom);
+    CommandMatch match = findCommand(r.room(), delcom);
+    if (match.found) {
+      if (!match.handler) {
+        // Delete command from response table
+        r.room()->responses().remove(delcom);
+        publishResponse(r.room(), delcom, QString());
 
         // Delete command from database
         QSqlQuery q(m_db);
-        q.prepare(QStringLiteral("DELETE FROM responses WHERE command = ?"));
+        q.prepare(QStringLiteral("DELETE FROM responses WHERE room = ? AND command = ?"));
+        q.addBindValue(r.room()->name());
         q.addBindValue(delcom);
-        if (!q.exec()) {
+        if (!execQuery(q)) {
           qCritical() << "Failed to delete simple response:" << q.lastError();
         }
 
@@ -202,45 +229,44 @@ ChatServer::Response ChatServer::commandDelCom(const Request &r)
 
 ChatServer::Response ChatServer::commandHelp(const Request &r)
 {
-  QString s;
+  QStringList commands = r.room()->responses().commands();
 
-  for (auto it=m_commandMap.cbegin(); it!=m_commandMap.cend(); it++) {
-    if (r.authorization() >= it->authorization) {
-      if (!s.isEmpty()) {
-        s.append(QStringLiteral(", "));
-      }
-      s.append(it.key());
+  for (const BuiltinCommand &c : BUILTIN_COMMANDS) {
+    if (r.authorization() >= c.authorization) {
+      commands.append(QLatin1String(c.name));
     }
   }
 
-  return Response(r, tr("Available commands: %1").arg(s));
+  commands.sort();
+
+  return Response(r, tr("Available commands: %1").arg(commands.join(QStringLiteral(", "))));
 }
 
 ChatServer::Response ChatServer::commandPauseTTS(const Request &r)
 {
-  emit requestOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_PAUSE_TTS));
+  sendOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_PAUSE_TTS));
   return Response(r, tr("TTS paused"));
 }
 
 ChatServer::Response ChatServer::commandPurgeTTS(const Request &r)
 {
-  emit requestOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_PURGE_TTS));
+  sendOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_PURGE_TTS));
   return Response(r, tr("TTS purged"));
 }
 
 ChatServer::Response ChatServer::commandSay(const Request &r)
 {
-  if (r.args().size() != 2) {
+  if (r.argCount() != 2) {
     return Response(r, tr("Usage: %1 <message>").arg(r.command()));
   } else {
-    return Response(Request(), r.args().at(1), true);
+    return Response(Request(QString(), r.room()), r.arg(1), true);
   }
 }
 
 ChatServer::Response ChatServer::commandShoutout(const Request &r)
 {
-  if (r.args().size() == 2) {
-    QString so_user = r.args().at(1);
+  if (r.argCount() == 2) {
+    QString so_user = r.arg(1);
 
     while (!so_user.isEmpty() && so_user.at(0) == '@') {
       so_user.remove(0, 1);
@@ -254,33 +280,35 @@ ChatServer::Response ChatServer::commandShoutout(const Request &r)
 
 ChatServer::Response ChatServer::commandSkipTTS(const Request &r)
 {
-  emit requestOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_SKIP_TTS));
+  sendOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_SKIP_TTS));
   return Response(r, tr("TTS skipped"));
 }
 
 ChatServer::Response ChatServer::commandTime(const Request &r)
 {
   QDateTime dt = QDateTime::currentDateTimeUtc();
-  dt = dt.toTimeZone(QTimeZone(CONFIG[QStringLiteral("timezone")].toByteArray()));
+  dt = dt.toTimeZone(CONFIG.live().timezone);
   return Response(r, tr("The time for the streamer is: %1").arg(dt.toString()), true);
 }
 
 ChatServer::Response ChatServer::commandTimer(const Request &r)
 {
-  if (r.args().size() == 3) {
-    QString action = r.args().at(1).toLower();
-    QString name = r.args().at(2).toLower();
+  if (r.argCount() == 3) {
+    QString action = r.arg(1).toLower();
+    QString name = r.arg(2).toLower();
+    QMap<QString, qint64> &timers = r.room()->timers();
 
     if (action == QStringLiteral("start")) {
-      if (m_timers.contains(name)) {
+      if (timers.contains(name)) {
         return Response(r, tr("Timer \"%1\" already exists").arg(name), true);
       } else {
-        m_timers.insert(name, QDateTime::currentSecsSinceEpoch());
+        timers.insert(name, QDateTime::currentSecsSinceEpoch());
+        publishTimer(r.room(), name, timers.value(name));
         return Response(r, tr("Timer \"%1\" created").arg(name), true);
       }
     } else if (action == QStringLiteral("check") || action == QStringLiteral("stop")) {
-      if (m_timers.contains(name)) {
-        qint64 old = m_timers.value(name);
+      if (timers.contains(name)) {
+        qint64 old = timers.value(name);
         qint64 elapsed = QDateTime::currentSecsSinceEpoch() - old;
 
         QString old_str = QDateTime::fromSecsSinceEpoch(old).toString();
@@ -289,7 +317,8 @@ ChatServer::Response ChatServer::commandTimer(const Request &r)
         if (action == QStringLiteral("check")) {
           return Response(r, tr("Timer \"%1\" has been running for %2 (started %3)").arg(name, elapsed_str, old_str), true);
         } else {
-          m_timers.remove(name);
+          timers.remove(name);
+          publishTimer(r.room(), name, 0);
           return Response(r, tr("Timer \"%1\" stopped at %2 (started %3)").arg(name, elapsed_str, old_str), true);
         }
       } else {
@@ -301,20 +330,15 @@ ChatServer::Response ChatServer::commandTimer(const Request &r)
   return Response(r, tr("Usage: %1 <start/check/stop> <name>").arg(r.command()), true);
 }
 
-ChatServer::Response ChatServer::commandSimpleResponse(const Request &r)
-{
-  return Response(r, m_simpleResponses.value(r.command()), true);
-}
-
 ChatServer::Response ChatServer::commandAutoTTS(const Request &r)
 {
-  emit requestOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_AUTO_TTS));
+  sendOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_AUTO_TTS));
   return Response(r, tr("Auto TTS toggled"));
 }
 
 ChatServer::Response ChatServer::commandNextTTS(const Request &r)
 {
-  emit requestOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_NEXT_TTS));
+  sendOverlayMessage(OverlayMessage::Command(OverlayMessage::CMD_NEXT_TTS));
   return Response(r, tr("Requested next TTS"));
 }
 
@@ -325,16 +349,16 @@ ChatServer::Response ChatServer::commandBan(const Request &r)
 
 ChatServer::Response ChatServer::commandUnban(const Request &r)
 {
-  if (r.args().size() == 2) {
+  if (r.argCount() == 2) {
     QSqlQuery userUpdate(m_db);
     userUpdate.prepare(QStringLiteral("UPDATE users SET banned_until = 0 WHERE display_name = ?;"
                                       "SELECT id FROM users WHERE display_name = ?;"));
 
-    QString unbannedUser = stripAtSymbols(r.args().at(1));
+    QString unbannedUser = stripAtSymbols(r.arg(1));
     userUpdate.addBindValue(unbannedUser);
     userUpdate.addBindValue(unbannedUser);
 
-    if (!userUpdate.exec()) {
+    if (!execQuery(userUpdate)) {
       qCritical() << "Failed to update user details for unban:" << userUpdate.lastError();
       return Response::Error(r);
     }
@@ -345,12 +369,17 @@ ChatServer::Response ChatServer::commandUnban(const Request &r)
 
       qint64 bannedId = userUpdate.value(0).toLongLong();
 
-      const QList<QWebSocket*> bannedClient = m_clients.socketsForAuthor(bannedId);
+      const QList<QWebSocket*> bannedClient = socketsForAuthor(bannedId);
       for (auto skt : bannedClient) {
         // Send banned status to user
         sendUserState(skt, bannedId);
       }
 
+      QJsonObject event;
+      event.insert(QStringLiteral("id"), bannedId);
+      event.insert(QStringLiteral("banned"), false);
+      publishEvent(EventBus::EVENT_USER, event);
+
       return Response(r, tr("%1 unbanned").arg(unbannedUser));
     } else {
       // Let sender know that user was banned
@@ -368,9 +397,11 @@ ChatServer::Response ChatServer::commandIpBan(const Request &r)
 
 ChatServer::Response ChatServer::commandSlowMode(const Request &r)
 {
-  if (r.args().size() == 2) {
-    m_slowMode = r.args().at(1).toInt();
-    return Response(r, tr("Slow mode set to %1 seconds").arg(m_slowMode));
+  if (r.argCount() == 2) {
+    quint64 &slowMode = r.room()->settings().slowMode;
+    slowMode = r.arg(1).toInt();
+    publishSettings(r.room());
+    return Response(r, tr("Slow mode set to %1 seconds").arg(slowMode));
   } else {
     return Response(r, tr("Usage: %1 <seconds>").arg(r.command()));
   }
@@ -388,16 +419,16 @@ ChatServer::Response ChatServer::commandUnmod(const Request &r)
 
 ChatServer::Response ChatServer::commandDelMsg(const Request &r)
 {
-  if (r.args().size() >= 2) {
+  if (r.argCount() >= 2) {
     QVector<qint64> msgs;
-    for (size_t i = 1; i < r.args().size(); i++) {
+    for (int i = 1; i < r.argCount(); i++) {
       bool ok;
-      qint64 msg = r.args().at(i).toLongLong(&ok);
+      qint64 msg = r.arg(i).toLongLong(&ok);
       if (ok) {
         msgs.append(msg);
       }
     }
-    dropMessages(msgs, true);
+    dropMessages(r.room(), msgs, true);
     return Response(r, tr("%1 message(s) deleted").arg(msgs.size()));
   } else {
     return Response(r, tr("Usage: %1 <messages-to-delete>").arg(r.command()));
@@ -406,12 +437,12 @@ ChatServer::Response ChatServer::commandDelMsg(const Request &r)
 
 ChatServer::Response ChatServer::commandVideo(const ChatServer::Request &r)
 {
-  if (r.args().size() >= 2) {
-    const QString &id = r.args().at(1);
+  if (r.argCount() >= 2) {
+    QString id = r.arg(1);
     QSqlQuery updateVideoQuery(m_db);
     updateVideoQuery.prepare(QStringLiteral("UPDATE config SET value = ? WHERE name = 'video'"));
     updateVideoQuery.addBindValue(id);
-    if (!updateVideoQuery.exec()) {
+    if (!execQuery(updateVideoQuery)) {
       qCritical() << "Failed to update video query:" << updateVideoQuery.lastError();
     }
     return Response(r, tr("Video updated to %1 successfully").arg(id));
@@ -422,23 +453,27 @@ ChatServer::Response ChatServer::commandVideo(const ChatServer::Request &r)
 
 ChatServer::Response ChatServer::commandInfo(const Request &r)
 {
-  return Response(r, tr("Version: %1<br>Slow Mode: %2 seconds<br>Duplicate Slow Mode: %3 seconds<br>Follow Mode: %4 seconds").arg(
+  const ChatRoom::Settings &settings = r.room()->settings();
+  return Response(r, tr("Version: %1<br>Room: %2<br>Slow Mode: %3 seconds<br>Duplicate Slow Mode: %4 seconds<br>Follow Mode: %5 seconds").arg(
                     QStringLiteral("0.1"),
-                    QString::number(m_slowMode),
-                    QString::number(m_duplicateSlowMode),
-                    QString::number(m_followMode)
+                    r.room()->name(),
+                    QString::number(settings.slowMode),
+                    QString::number(settings.duplicateSlowMode),
+                    QString::number(settings.followMode)
                     ));
 }
 
 ChatServer::Response ChatServer::commandFollowMode(const Request &r)
 {
-  if (r.args().size() == 2) {
-    const QString &s = r.args().at(1);
+  if (r.argCount() == 2) {
+    QString s = r.arg(1);
     bool ok;
     int newFollowMode = s.toInt(&ok);
     if (ok) {
-      m_followMode = newFollowMode;
-      return Response(r, tr("Follow mode set to %1 seconds").arg(m_followMode));
+      quint64 &followMode = r.room()->settings().followMode;
+      followMode = newFollowMode;
+      publishSettings(r.room());
+      return Response(r, tr("Follow mode set to %1 seconds").arg(followMode));
     } else {
       return Response(r, tr("Failed to parse seconds '%1'").arg(s));
     }
@@ -446,3 +481,57 @@ ChatServer::Response ChatServer::commandFollowMode(const Request &r)
     return Response(r, tr("Usage: %1 <seconds>").arg(r.command()));
   }
 }
+
+ChatServer::Response ChatServer::commandAdmission(const Request &r)
+{
+  return Response(r, m_listener->admission().getSummary());
+}
+
+ChatServer::Response ChatServer::commandDbStats(const Request &r)
+{
+  if (r.argCount() == 2 && r.arg(1) == QStringLiteral("reset")) {
+    QUERY_PROFILER.reset();
+    return Response(r, tr("Database statistics reset"));
+  }
+
+  const int shown = 3;
+  const int maxSqlLength = 80;
+
+  QVector<QueryProfiler::Statement> statements = QUERY_PROFILER.getStatements();
+  if (statements.isEmpty()) {
+    return Response(r, tr("No queries recorded yet"));
+  }
+
+  QStringList top;
+  for (int i = 0; i < statements.size() && i < shown; i++) {
+    const QueryProfiler::Statement &s = statements.at(i);
+
+    QString sql = s.sql.simplified();
+    if (sql.size() > maxSqlLength) {
+      sql = sql.left(maxSqlLength - 3) + QStringLiteral("...");
+    }
+
+    top.append(tr("%1 calls, %2 ms total, %3 ms avg, %4 ms max, %5 rows, %6 slow, %7 failed: %8").arg(
+                 QString::number(s.calls),
+                 QString::number(s.totalNs / 1000000),
+                 QString::number(double(s.totalNs) / s.calls / 1e6, 'f', 2),
+                 QString::number(s.maxNs / 1000000),
+                 s.rowsKnown ? QString::number(s.rows) : tr("unknown"),
+                 QString::number(s.slow),
+                 QString::number(s.failures),
+                 sql));
+  }
+
+  return Response(r, tr("%1 statements, top by time: %2").arg(QString::number(statements.size()), top.join(QStringLiteral(" | "))));
+}
+
+ChatServer::Response ChatServer::commandReloadConfig(const Request &r)
+{
+  if (!CONFIG.reload()) {
+    return Response(r, tr("Failed to read config.json"));
+  }
+
+  applyLiveConfig();
+  publishEvent(EventBus::EVENT_RELOAD, QJsonObject());
+  return Response(r, tr("Configuration reloaded"));
+}
@@ -0,0 +1,104 @@
+#include "chatroom.h"
+
+#include <algorithm>
+
+ChatRoom::ChatRoom(const QString &name) :
+  m_name(name),
+  m_historyValid(false),
+  m_historyComplete(false)
+{
+}
+
+bool ChatRoom::isValidName(const QString &name)
+{
+  if (name.isEmpty() || name.size() > 32) {
+    return false;
+  }
+
+  for (QChar c : name) {
+    bool valid = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '_' || c == '-';
+    if (!valid) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ChatRoom::insertHistory(qint64 id, const QString &packet)
+{
+  if (!m_historyValid) {
+    return;
+  }
+
+  // Messages from other nodes can arrive slightly out of order
+  int i = m_history.size();
+  while (i > 0 && m_history.at(i - 1).id > id) {
+    i--;
+  }
+  m_history.insert(i, {id, packet});
+
+  if (m_history.size() > HISTORY_LENGTH) {
+    m_history.removeFirst();
+    m_historyComplete = false;
+  }
+}
+
+bool ChatRoom::historyPage(qint64 before, int limit, QVector<CachedPacket> *out, bool *more) const
+{
+  if (!m_historyValid) {
+    return false;
+  }
+
+  auto end = std::lower_bound(m_history.cbegin(), m_history.cend(), before, [](const CachedPacket &p, qint64 id){
+    return p.id < id;
+  });
+  int available = int(end - m_history.cbegin());
+
+  if (available <= limit && !m_historyComplete) {
+    return false;
+  }
+
+  out->clear();
+  for (auto it = end - qMin(available, limit); it != end; it++) {
+    out->append(*it);
+  }
+  *more = available > limit;
+
+  return true;
+}
+
+bool ChatRoom::isPresentRemotely(qint64 author, const QString &exceptNode) const
+{
+  for (auto it = m_remotePresence.cbegin(); it != m_remotePresence.cend(); it++) {
+    if (it.key() != exceptNode && it.value().contains(author)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ChatRoom::setRemotePresence(const QString &node, const QSet<qint64> &authors)
+{
+  if (authors.isEmpty()) {
+    m_remotePresence.remove(node);
+  } else {
+    m_remotePresence.insert(node, authors);
+  }
+}
+
+QSet<qint64> ChatRoom::activeAuthors() const
+{
+  QSet<qint64> authors;
+
+  const QList<qint64> local = m_clients.authors();
+  for (qint64 a : local) {
+    authors.insert(a);
+  }
+  for (const QSet<qint64> &remote : m_remotePresence) {
+    authors.unite(remote);
+  }
+
+  return authors;
+}
@@ -0,0 +1,130 @@
+#ifndef CHATROOM_H
+#define CHATROOM_H
+
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "responsetable.h"
+#include "usersocketmap.h"
+
+/**
+ * @brief One room's members, recent history and moderation state
+ *
+ * Everything a chat message fans out to or is checked against lives here, so publishing into a
+ * room only ever touches the sockets that joined it. Users, bans and auth levels are shared by
+ * every room and stay in ChatServer.
+ */
+class ChatRoom
+{
+public:
+  struct Settings
+  {
+    // All in seconds, 0 turns the check off
+    quint64 slowMode = 0;
+    quint64 duplicateSlowMode = 30;
+    quint64 followMode = 600;
+  };
+
+  struct CachedPacket
+  {
+    qint64 id;
+    QString packet;
+  };
+
+  static const int HISTORY_LENGTH = 50;
+
+  explicit ChatRoom(const QString &name);
+
+  ChatRoom(const ChatRoom &) = delete;
+  ChatRoom &operator=(const ChatRoom &) = delete;
+
+  const QString &name() const { return m_name; }
+
+  /**
+   * @brief Room names go into the database and cluster events, so they're kept short and plain
+   */
+  static bool isValidName(const QString &name);
+
+  UserSocketMap &clients() { return m_clients; }
+  const UserSocketMap &clients() const { return m_clients; }
+
+  ResponseTable &responses() { return m_responses; }
+  const ResponseTable &responses() const { return m_responses; }
+
+  QMap<QString, qint64> &timers() { return m_timers; }
+
+  Settings &settings() { return m_settings; }
+  const Settings &settings() const { return m_settings; }
+
+  /**
+   * @brief Serialized chat packets sent to clients joining the room, oldest first
+   */
+  const QVector<CachedPacket> &history() const { return m_history; }
+  bool isHistoryValid() const { return m_historyValid; }
+
+  /**
+   * @brief Replaces the cached history, complete being whether it holds every message in the room
+   */
+  void setHistory(const QVector<CachedPacket> &history, bool complete)
+  {
+    m_history = history;
+    m_historyValid = true;
+    m_historyComplete = complete;
+  }
+
+  /**
+   * @brief Adds a broadcast packet to the cached history, keeping it in ID order
+   */
+  void insertHistory(qint64 id, const QString &packet);
+
+  void invalidateHistory()
+  {
+    m_historyValid = false;
+    m_historyComplete = false;
+    m_history.clear();
+  }
+
+  /**
+   * @brief Copies up to limit of the newest cached messages older than before into out, oldest first
+   *
+   * Returns false if the cache can't answer on its own, which is when it doesn't hold more than
+   * limit such messages and there may be older ones only in the database. Otherwise more is set
+   * to whether anything older than the page exists.
+   */
+  bool historyPage(qint64 before, int limit, QVector<CachedPacket> *out, bool *more) const;
+
+  /**
+   * @brief Returns true if author is in this room on another node, other than exceptNode
+   */
+  bool isPresentRemotely(qint64 author, const QString &exceptNode = QString()) const;
+
+  QSet<qint64> remotePresence(const QString &node) const { return m_remotePresence.value(node); }
+  QStringList remoteNodes() const { return m_remotePresence.keys(); }
+  void setRemotePresence(const QString &node, const QSet<qint64> &authors);
+
+  /**
+   * @brief Everyone in this room on any node in the cluster
+   */
+  QSet<qint64> activeAuthors() const;
+
+private:
+  QString m_name;
+
+  UserSocketMap m_clients;
+  ResponseTable m_responses;
+  QMap<QString, qint64> m_timers;
+  Settings m_settings;
+
+  QVector<CachedPacket> m_history;
+  bool m_historyValid;
+  bool m_historyComplete;
+
+  // Authors in this room on each of the other nodes
+  QHash<QString, QSet<qint64> > m_remotePresence;
+
+};
+
+#endif // CHATROOM_H
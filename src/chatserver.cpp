@@ -1,29 +1,104 @@
 #include "chatserver.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "auth/googleauth.h"
+#include "auth/testauth.h"
+#include "jsonwriter.h"
+#include "listensocket.h"
+#include "packetenvelope.h"
 #include "startupconfig.h"
+#include "textescape.h"
 
 static const QString SQL_CONNECTION_NAME = QStringLiteral("kcchat");
 
 ChatServer::ChatServer(QObject *parent) :
   QObject{parent},
-  m_slowMode(0),
-  m_duplicateSlowMode(30),          // 30 seconds
+  m_listener(nullptr),
   m_displayNameChangeTime(2592000), // 30 days
-  m_followMode(600)                 // 10 minutes
+  m_defaultRoom(nullptr),
+  m_heartbeat(nullptr),
+  m_overlayChannel(nullptr),
+  m_bus(nullptr),
+  m_joinedDrainBus(false),
+  m_inheritedListener(-1),
+  m_listeningDescriptor(-1),
+  m_drainPerTick(0),
+  m_drainTimer(nullptr)
 {
+  m_clock.start();
+
+  loadRooms();
+
   m_netMan = new QNetworkAccessManager(this);
   connect(m_netMan, &QNetworkAccessManager::finished, this, &ChatServer::checkApiError);
 
   m_authModules.append(new GoogleAuth(this));
 
-  initCommands();
+  if (CONFIG[QStringLiteral("test_auth")].toBool()) {
+    qWarning() << "Test authentication is enabled, anyone can log in as a test user";
+    m_authModules.append(new TestAuth(this));
+  }
+}
+
+ChatServer::~ChatServer()
+{
+  qDeleteAll(m_rooms);
+}
+
+void ChatServer::loadRooms()
+{
+  QStringList names = CONFIG[QStringLiteral("rooms")].toStringList();
+  if (names.isEmpty()) {
+    names.append(QStringLiteral("main"));
+  }
+
+  for (const QString &name : qAsConst(names)) {
+    if (!ChatRoom::isValidName(name)) {
+      qCritical() << "Ignoring room" << name << "- names are up to 32 lowercase letters, digits, dashes and underscores";
+      continue;
+    }
+
+    if (!m_rooms.contains(name)) {
+      ChatRoom *room = new ChatRoom(name);
+      m_rooms.insert(name, room);
+      if (!m_defaultRoom) {
+        m_defaultRoom = room;
+      }
+    }
+  }
+
+  if (!m_defaultRoom) {
+    qCritical() << "No valid rooms configured, falling back to \"main\"";
+    m_defaultRoom = new ChatRoom(QStringLiteral("main"));
+    m_rooms.insert(m_defaultRoom->name(), m_defaultRoom);
+  }
+
+  qDebug() << "Hosting rooms" << m_rooms.keys() << "with" << m_defaultRoom->name() << "as the default";
+}
+
+ChatRoom *ChatServer::roomForSocket(QWebSocket *skt)
+{
+  ConnectionState *state = m_connections.find(skt);
+  if (!state) {
+    return nullptr;
+  }
+
+  // Clients that authenticate without saying hello first are treated as being in the default room
+  if (!state->room) {
+    state->room = m_defaultRoom;
+  }
+
+  return state->room;
 }
 
 void ChatServer::start()
 {
   const quint16 wssPort = 2002;
 
+  TRACER.setThreadName("chat");
+
   m_db = QSqlDatabase::addDatabase(QStringLiteral("QMYSQL"), SQL_CONNECTION_NAME);
 
   m_db.setHostName(CONFIG[QStringLiteral("db_host")].toString());
@@ -35,52 +110,194 @@ void ChatServer::start()
   if (m_db.open()) {
     qDebug() << "Successfully connected to database";
     loadResponses();
+    for (ChatRoom *room : qAsConst(m_rooms)) {
+      loadHistory(room);
+    }
   } else {
     qCritical() << "Failed to connect to database:" << m_db.lastError();
   }
 
+  applyLiveConfig();
+
+  // Created here so its timer runs on this thread
+  m_heartbeat = new HeartbeatMonitor(this);
+  m_heartbeat->loadConfig();
+
+  // Optionally record inbound traffic for kcchat-replay
+  QString captureFile = CONFIG[QStringLiteral("capture_file")].toString();
+  if (!captureFile.isEmpty()) {
+    QVariant captureMaxSize = CONFIG[QStringLiteral("capture_max_size")];
+    qint64 maxBytes = qint64(captureMaxSize.isValid() ? captureMaxSize.toInt() : 1024) * 1024 * 1024;
+    if (m_capture.open(captureFile, maxBytes)) {
+      qWarning() << "Capturing inbound chat traffic to" << captureFile;
+    }
+  }
+
+  qDebug() << "Using" << TextEscape::getKernelName() << "text escape kernel";
+
+  startCluster();
+
   // Use SSL if available
   QSslConfiguration ssl = CONFIG.getSslConfiguration();
 
   // Start hosting websocket
   m_server = new QWebSocketServer(QStringLiteral("Chat"), ssl.isNull() ? QWebSocketServer::NonSecureMode : QWebSocketServer::SecureMode, this);
-  m_server->setSslConfiguration(ssl);
   connect(m_server, &QWebSocketServer::newConnection, this, &ChatServer::handleNewConnection);
-  connect(m_server, &QWebSocketServer::sslErrors, this, &ChatServer::handleSslError);
-  connect(m_server, &QWebSocketServer::peerVerifyError, this, &ChatServer::handlePeerVerifyError);
 
-  if (m_server->listen(QHostAddress::Any, wssPort)) {
+  // Accepts for m_server, so connections are admitted before they get to the handshake
+  m_listener = new AdmissionServer(m_server, ssl, this);
+  connect(m_listener, &AdmissionServer::sslErrors, this, &ChatServer::handleSslError);
+  connect(m_listener, &AdmissionServer::peerVerifyError, this, &ChatServer::handlePeerVerifyError);
+
+  // Every worker accepts chat connections, so each enforces its share of the limits
+  m_listener->admission().loadConfig(qMax(1, CONFIG[QStringLiteral("workers")].toInt()));
+
+  if (m_inheritedListener != -1 && adoptListeningSocket(m_listener, m_inheritedListener)) {
+    qDebug() << "Accepting chat connections on port" << wssPort << "from the previous process";
+  } else if (listenOnPort(m_listener, wssPort, CONFIG[QStringLiteral("reuse_port")].toBool())) {
     qDebug() << "Listening for chat server on port" << wssPort;
   } else {
     qCritical() << "Failed to bind chat server to port" << wssPort;
   }
+  m_listeningDescriptor.storeRelease(getListeningSocket(m_listener));
 }
 
 void ChatServer::stop()
 {
-  auto copy = m_clients.sockets();
-  for (auto it=copy.cbegin(); it!=copy.cend(); it++) {
-    (*it)->close();
+  const QList<QWebSocket*> skts = m_connections.sockets();
+  for (QWebSocket *s : skts) {
+    s->close();
   }
-  m_server->close();
+  m_listener->close();
+
+  m_capture.close();
 
   m_db = QSqlDatabase();
   QSqlDatabase::removeDatabase(SQL_CONNECTION_NAME);
 }
 
+void ChatServer::drain(int windowMs)
+{
+  qDebug() << "Draining" << m_connections.size() << "chat connections over" << windowMs << "ms";
+
+  m_listener->close();
+
+  m_drainQueue.clear();
+  const QList<QWebSocket*> skts = m_connections.sockets();
+  for (QWebSocket *s : skts) {
+    m_drainQueue.append(s);
+  }
+  std::shuffle(m_drainQueue.begin(), m_drainQueue.end(), *QRandomGenerator::global());
+
+  int ticks = qMax(1, windowMs / DRAIN_TICK);
+  m_drainPerTick = (m_drainQueue.size() + ticks - 1) / ticks;
+
+  if (!m_drainTimer) {
+    m_drainTimer = new QTimer(this);
+    m_drainTimer->setInterval(DRAIN_TICK);
+    connect(m_drainTimer, &QTimer::timeout, this, &ChatServer::drainTick);
+  }
+  m_drainTimer->start();
+  drainTick();
+}
+
+void ChatServer::drainTick()
+{
+  for (int i = 0; i < m_drainPerTick && !m_drainQueue.isEmpty(); i++) {
+    QPointer<QWebSocket> s = m_drainQueue.takeLast();
+    if (s) {
+      s->sendTextMessage(generateReconnectPacket(QRandomGenerator::global()->bounded(RECONNECT_JITTER)));
+      s->close(QWebSocketProtocol::CloseCodeGoingAway);
+    }
+  }
+
+  if (m_drainQueue.isEmpty()) {
+    m_drainTimer->stop();
+    qDebug() << "Finished draining chat connections";
+    emit drained();
+  }
+}
+
+void ChatServer::applyLiveConfig()
+{
+  loadRateLimits();
+  loadMentionRules();
+  QUERY_PROFILER.setSlowThreshold(CONFIG.live().slowQueryMs);
+}
+
+void ChatServer::Request::tokenize()
+{
+  // Split on runs of whitespace that aren't inside double quotes. This is a single pass over the
+  // line, so arbitrarily long or heavily quoted input can't cause any backtracking. An unterminated
+  // quote extends to the end of the line.
+  const QChar *d = m_line.constData();
+  const int size = m_line.size();
+
+  int start = 0;
+  bool quoted = false;
+
+  for (int i = 0; i < size; i++) {
+    const QChar c = d[i];
+    if (c == '"') {
+      quoted = !quoted;
+    } else if (!quoted && c.isSpace()) {
+      appendArg(start, i - start);
+
+      // Skip the rest of this run of whitespace
+      while (i + 1 < size && d[i + 1].isSpace()) {
+        i++;
+      }
+      start = i + 1;
+    }
+  }
+
+  appendArg(start, size - start);
+}
+
+void ChatServer::Request::appendArg(int start, int length)
+{
+  // Strip surrounding quotes
+  if (length > 0 && m_line.at(start) == '"') {
+    start++;
+    length--;
+  }
+  if (length > 0 && m_line.at(start + length - 1) == '"') {
+    length--;
+  }
+
+  m_args.append({start, length});
+}
+
+QString ChatServer::Request::joinArgs(int from) const
+{
+  QString s;
+
+  for (int i = from; i < m_args.size(); i++) {
+    if (i > from) {
+      s.append(' ');
+    }
+    QStringView v = argView(i);
+    s.append(v.data(), v.size());
+  }
+
+  return s;
+}
+
 void ChatServer::reply(const Response &r)
 {
   const Request &req = r.request();
+  ChatRoom *room = req.room() ? req.room() : m_defaultRoom;
   if (req.hasAuthor() || r.isPublic()) {
     if (r.isPublic()) {
       QString s = r.message();
       if (req.hasAuthor()) {
         s.prepend(QStringLiteral("@%1 ").arg(req.author()));
       }
-      publish(CONFIG[QStringLiteral("bot_name")].toString(), 0, 0, s, CONFIG[QStringLiteral("bot_color")].toString(), QHostAddress::LocalHost, Authorization::AUTH_MOD);
+      const ConfigSnapshot &config = CONFIG.live();
+      publish(room, config.botName, 0, 0, s, config.botColor, QHostAddress::LocalHost, Authorization::AUTH_MOD);
     } else {
       // Send status message
-      const QList<QWebSocket*> skts = m_clients.socketsForAuthor(req.authorId());
+      const QList<QWebSocket*> skts = room->clients().socketsForAuthor(req.authorId());
       for (QWebSocket *s : skts) {
         sendServerMessage(s, r.message());
       }
@@ -97,13 +314,50 @@ void ChatServer::reply(const Response &r)
   }
 }
 
+void ChatServer::sendOverlayMessage(const OverlayMessage &msg)
+{
+  if (msg.type() == OverlayMessage::MSG_NONE) {
+    return;
+  }
+
+  deliverOverlayMessage(msg);
+
+  QJsonObject data;
+  data.insert(QStringLiteral("type"), int(msg.type()));
+  data.insert(QStringLiteral("title"), msg.alertTitle());
+  data.insert(QStringLiteral("subtitle"), msg.alertSubtitle());
+  data.insert(QStringLiteral("joke"), msg.jokeName());
+  if (msg.type() == OverlayMessage::MSG_COMMAND) {
+    data.insert(QStringLiteral("command"), int(msg.command()));
+  }
+  publishEvent(EventBus::EVENT_OVERLAY, data);
+}
+
+void ChatServer::deliverOverlayMessage(const OverlayMessage &msg)
+{
+  qInfo() << "On-screen alert:" << msg.alertTitle() << "-" << msg.alertSubtitle();
+
+  // Serialize here so the overlay thread only has to forward the payload. While earlier events are
+  // still on their way by signal, this one follows them so it can't overtake them.
+  if (m_overlayChannel && !m_overlayChannel->isFallingBack() && m_overlayChannel->push(msg.topic(), msg.toJson())) {
+    return;
+  }
+
+  METRICS.overlayChannelFallbacks.add();
+
+  if (m_overlayChannel) {
+    m_overlayChannel->beginFallback();
+  }
+  emit requestOverlayMessage(msg);
+}
+
 ChatServer::Status ChatServer::getUserStateFromID(qint64 id)
 {
   QSqlQuery userLookupQuery(m_db);
   userLookupQuery.prepare(QStringLiteral("SELECT display_name, banned_until FROM users WHERE id = ?"));
   userLookupQuery.addBindValue(id);
 
-  if (!userLookupQuery.exec()) {
+  if (!execQuery(userLookupQuery)) {
     qCritical() << "Failed to look up user state:" << userLookupQuery.lastError();
     return STATUS_UNAUTHENTICATED;
   }
@@ -149,8 +403,10 @@ QString ChatServer::getStatusString(Status s)
   return QString();
 }
 
-void ChatServer::publish(const QString &author, qint64 id, qint64 replyId, QString msg, const QString &color, const QHostAddress &ip, Authorization auth, const QString &donateValue)
+void ChatServer::publish(ChatRoom *room, const QString &author, qint64 id, qint64 replyId, QString msg, const QString &color, const QHostAddress &ip, Authorization auth, const QString &donateValue)
 {
+  TraceSpan traceSpan("publish");
+
   // Attempt to prevent spamming "empty characters" - though some of these are used in Unicode for
   // certain things, so I've disabled it for now
   /*msg = msg.replace(QRegExp(QStringLiteral("["
@@ -166,7 +422,7 @@ void ChatServer::publish(const QString &author, qint64 id, qint64 replyId, QStri
 
   // Trim string and check for empty. Client will have done this, but we can't trust it.
   msg = msg.trimmed();
-  if (donateValue.isEmpty() && (msg.isEmpty() || msg.size() > CONFIG[QStringLiteral("max_chat_length")].toInt())) {
+  if (donateValue.isEmpty() && (msg.isEmpty() || msg.size() > CONFIG.live().maxChatLength)) {
     return;
   }
 
@@ -174,16 +430,20 @@ void ChatServer::publish(const QString &author, qint64 id, qint64 replyId, QStri
   qint64 now = QDateTime::currentMSecsSinceEpoch();
 
   QSqlQuery insertQuery(m_db);
-  insertQuery.prepare(QStringLiteral("INSERT INTO history (user_id, time, message, dropped, host, donate_value, reply_id) VALUES (?, ?, ?, ?, ?, ?, ?); SELECT LAST_INSERT_ID();"));
-  insertQuery.addBindValue(id);
-  insertQuery.addBindValue(now);
-  insertQuery.addBindValue(msg);
-  insertQuery.addBindValue(dropped);
-  insertQuery.addBindValue(ip.toString());
-  insertQuery.addBindValue(donateValue.isEmpty() ? QStringLiteral("") : donateValue);
-  insertQuery.addBindValue(replyId);
-  if (!insertQuery.exec()) {
-    qCritical() << "Failed to insert chat message into history:" << insertQuery.lastError();
+  {
+    TraceSpan insertSpan("history_insert");
+    insertQuery.prepare(QStringLiteral("INSERT INTO history (room, user_id, time, message, dropped, host, donate_value, reply_id) VALUES (?, ?, ?, ?, ?, ?, ?, ?); SELECT LAST_INSERT_ID();"));
+    insertQuery.addBindValue(room->name());
+    insertQuery.addBindValue(id);
+    insertQuery.addBindValue(now);
+    insertQuery.addBindValue(msg);
+    insertQuery.addBindValue(dropped);
+    insertQuery.addBindValue(ip.toString());
+    insertQuery.addBindValue(donateValue.isEmpty() ? QStringLiteral("") : donateValue);
+    insertQuery.addBindValue(replyId);
+    if (!execQuery(insertQuery)) {
+      qCritical() << "Failed to insert chat message into history:" << insertQuery.lastError();
+    }
   }
 
   if (dropped) {
@@ -202,34 +462,92 @@ void ChatServer::publish(const QString &author, qint64 id, qint64 replyId, QStri
     fixReplyIdQuery.prepare(QStringLiteral("UPDATE history SET reply_id = ? WHERE id = ?"));
     fixReplyIdQuery.addBindValue(replyId);
     fixReplyIdQuery.addBindValue(msgId);
-    if (!fixReplyIdQuery.exec()) {
+    if (!execQuery(fixReplyIdQuery)) {
       qCritical() << "Failed to fix malformed reply ID";
     }
   }
 
-  m_clients.broadcastTextMessage(generateChatMessageForClient(msgId, now, replyId, author, id, color, msg, auth, donateValue).toJson());
+  // Escaped once, then shared between the broadcast and history replay for new clients
+  QString packet = generateChatMessageForClient(msgId, now, replyId, author, id, color, msg, auth, donateValue);
+
+  room->insertHistory(msgId, packet);
+
+  TraceSpan broadcastSpan("broadcast");
+  room->clients().broadcastTextMessage(packet);
+
+  QJsonObject event;
+  event.insert(QStringLiteral("room"), room->name());
+  event.insert(QStringLiteral("id"), msgId);
+  event.insert(QStringLiteral("packet"), packet);
+  publishEvent(EventBus::EVENT_PUBLISH, event);
 }
 
-QJsonDocument ChatServer::generateClientPacket(const QString &type, const QJsonObject &data)
+void ChatServer::invalidateHistory()
 {
-  QJsonObject o;
-  o.insert(QStringLiteral("type"), type);
-  o.insert(QStringLiteral("data"), data);
-  return QJsonDocument(o);
+  for (ChatRoom *room : qAsConst(m_rooms)) {
+    room->invalidateHistory();
+  }
+}
+
+QString ChatServer::generateStatusPacket(Status status)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"status");
+  w.key(JSON_KEY("status"));
+  w.value(getStatusString(status));
+  return w.endPacket();
+}
+
+QString ChatServer::generateServerMessagePacket(const QString &text)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"servermsg");
+  w.key(JSON_KEY("message"));
+  w.value(text);
+  return w.endPacket();
+}
+
+QString ChatServer::generateDeletePacket(const QVector<qint64> &msgIds)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"delete");
+  w.key(JSON_KEY("messages"));
+  w.beginArray();
+  for (qint64 id : msgIds) {
+    w.value(id);
+  }
+  w.endArray();
+  return w.endPacket();
+}
+
+QString ChatServer::generateAcceptedPacket(const QString &msg)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"accepted");
+  w.key(JSON_KEY("message"));
+  w.value(msg);
+  return w.endPacket();
+}
+
+QString ChatServer::generateUserConfigPacket(const QString &name, const QString &color)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"getuserconf");
+  w.key(JSON_KEY("name"));
+  w.value(name);
+  w.key(JSON_KEY("color"));
+  w.value(color);
+  return w.endPacket();
 }
 
 void ChatServer::sendUserStatusMessage(QWebSocket *skt, const Status &status)
 {
-  QJsonObject data;
-  data.insert(QStringLiteral("status"), getStatusString(status));
-  skt->sendTextMessage(generateClientPacket(QStringLiteral("status"), data).toJson());
+  skt->sendTextMessage(generateStatusPacket(status));
 }
 
 void ChatServer::sendServerMessage(QWebSocket *skt, const QString &text)
 {
-  QJsonObject o;
-  o.insert(QStringLiteral("message"), text);
-  skt->sendTextMessage(generateClientPacket(QStringLiteral("servermsg"), o).toJson());
+  skt->sendTextMessage(generateServerMessagePacket(text));
 }
 
 void ChatServer::sendUserState(QWebSocket *skt, qint64 id)
@@ -239,10 +557,12 @@ void ChatServer::sendUserState(QWebSocket *skt, qint64 id)
 
 bool ChatServer::getUserInfoFromUserId(qint64 id, UserInfo *out)
 {
+  TraceSpan traceSpan("getUserInfoFromUserId");
+
   QSqlQuery userLookupQuery(m_db);
   userLookupQuery.prepare(QStringLiteral("SELECT * FROM users WHERE id = ?"));
   userLookupQuery.addBindValue(id);
-  if (!userLookupQuery.exec()) {
+  if (!execQuery(userLookupQuery)) {
     qCritical() << "Failed to look up user information:" << userLookupQuery.lastError();
     return false;
   }
@@ -262,39 +582,62 @@ bool ChatServer::getUserInfoFromUserId(qint64 id, UserInfo *out)
   return true;
 }
 
-void ChatServer::dropMessages(const QVector<qint64> &msgIds, bool updateDb)
+void ChatServer::dropMessages(ChatRoom *room, const QVector<qint64> &msgIds, bool updateDb)
 {
-  QJsonArray a;
+  // Older messages need to move up to replace the dropped ones, so just reload on next use
+  if (room) {
+    room->invalidateHistory();
+  } else {
+    invalidateHistory();
+  }
 
   for (int i = 0; i < msgIds.size(); i++) {
     qint64 id = msgIds.at(i);
-    a.append(id);
 
     if (updateDb) {
+      // Moderators can only remove messages from the room they're in
       QSqlQuery rmQuery(m_db);
-      rmQuery.prepare(QStringLiteral("UPDATE history SET dropped = 1 WHERE id = ?"));
-      rmQuery.addBindValue(id);
-      if (!rmQuery.exec()) {
+      if (room) {
+        rmQuery.prepare(QStringLiteral("UPDATE history SET dropped = 1 WHERE id = ? AND room = ?"));
+        rmQuery.addBindValue(id);
+        rmQuery.addBindValue(room->name());
+      } else {
+        rmQuery.prepare(QStringLiteral("UPDATE history SET dropped = 1 WHERE id = ?"));
+        rmQuery.addBindValue(id);
+      }
+      if (!execQuery(rmQuery)) {
         qCritical() << "Failed to set message to dropped:" << rmQuery.lastError();
       }
     }
   }
 
-  QJsonObject o;
-  o.insert(QStringLiteral("messages"), a);
-  m_clients.broadcastTextMessage(generateClientPacket(QStringLiteral("delete"), o).toJson());
+  QString packet = generateDeletePacket(msgIds);
+  if (room) {
+    room->clients().broadcastTextMessage(packet);
+  } else {
+    broadcastToAllRooms(packet);
+  }
+
+  QJsonArray ids;
+  for (qint64 id : msgIds) {
+    ids.append(id);
+  }
+  QJsonObject event;
+  event.insert(QStringLiteral("room"), room ? room->name() : QString());
+  event.insert(QStringLiteral("ids"), ids);
+  publishEvent(EventBus::EVENT_DELETE, event);
 }
 
 ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
 {
-  if (r.args().size() == 2 || r.args().size() == 3) {
+  if (r.argCount() == 2 || r.argCount() == 3) {
     QSqlQuery userUpdate(m_db);
     userUpdate.prepare(QStringLiteral("UPDATE users SET banned_at = ?, banned_until = ? WHERE display_name = ? AND auth_level != ?;"
                                       "SELECT id FROM users WHERE display_name = ?;"));
 
     qint64 now = QDateTime::currentSecsSinceEpoch();
     qint64 banEnd;
-    if (r.args().size() == 2) {
+    if (r.argCount() == 2) {
       // Perma-ban
 
       // Defined as Number.MAX_SAFE_INTEGER
@@ -304,7 +647,7 @@ ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
       banEnd = MAX_JAVASCRIPT_NUMBER;
     } else {
       // Ban for seconds
-      QString timeframe = r.args().at(2);
+      QString timeframe = r.arg(2);
 
       bool ok;
 
@@ -339,21 +682,21 @@ ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
         }
 
         if (!ok) {
-          return Response(r, tr("Failed to parse ban timeframe: %1").arg(r.args().at(2)));
+          return Response(r, tr("Failed to parse ban timeframe: %1").arg(r.arg(2)));
         }
       }
 
       banEnd = now + timeframeSecs;
     }
 
-    QString bannedUser = stripAtSymbols(r.args().at(1));
+    QString bannedUser = stripAtSymbols(r.arg(1));
     userUpdate.addBindValue(now);
     userUpdate.addBindValue(banEnd);
     userUpdate.addBindValue(bannedUser);
     userUpdate.addBindValue(int(Authorization::AUTH_ADMIN));
     userUpdate.addBindValue(bannedUser);
 
-    if (!userUpdate.exec()) {
+    if (!execQuery(userUpdate)) {
       qCritical() << "Failed to update user details for ban:" << userUpdate.lastError();
       return Response::Error(r);
     }
@@ -371,21 +714,21 @@ ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
                                             "UPDATE history SET dropped = 1 WHERE user_id = ?"));
         dropMsgQuery.addBindValue(bannedId);
         dropMsgQuery.addBindValue(bannedId);
-        if (!dropMsgQuery.exec()) {
+        if (!execQuery(dropMsgQuery)) {
           qCritical() << "Failed to drop messages from banned user:" << dropMsgQuery.lastError();
         } else {
           QVector<qint64> msgs;
           while (dropMsgQuery.next()) {
             msgs.append(dropMsgQuery.value(0).toLongLong());
           }
-          dropMessages(msgs, false);
+          dropMessages(nullptr, msgs, false);
         }
       }
 
       QString msg = tr("%1 banned until <span class='timestamp'>%2</span>").arg(bannedUser, QString::number(banEnd));
 
       // Use socket to send ban message (and ban the IP if necessary)
-      const QList<QWebSocket *> bannedClient = m_clients.socketsForAuthor(bannedId);
+      const QList<QWebSocket *> bannedClient = socketsForAuthor(bannedId);
       for (QWebSocket *s : bannedClient) {
         // Send banned status to user
         sendUserStatusMessage(s, STATUS_BANNED);
@@ -396,12 +739,20 @@ ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
           banIpQuery.addBindValue(s->peerAddress().toString());
           banIpQuery.addBindValue(now);
           banIpQuery.addBindValue(banEnd);
-          if (!banIpQuery.exec()) {
+          if (!execQuery(banIpQuery)) {
             qCritical() << "Failed to insert IP into banned hosts:" << banIpQuery.lastError();
           }
         }
       }
 
+      // Other nodes kick and IP ban the user's sockets connected to them
+      QJsonObject event;
+      event.insert(QStringLiteral("id"), bannedId);
+      event.insert(QStringLiteral("banned"), true);
+      event.insert(QStringLiteral("until"), banEnd);
+      event.insert(QStringLiteral("ip"), andIP);
+      publishEvent(EventBus::EVENT_USER, event);
+
       if (andIP) {
         msg.append('\n');
         if (bannedClient.empty()) {
@@ -424,8 +775,8 @@ ChatServer::Response ChatServer::ban(const Request &r, bool andIP)
 
 ChatServer::Response ChatServer::setUserAuthLevelCommand(const Request &r, Authorization auth)
 {
-  if (r.args().size() == 2) {
-    QString userToMod = stripAtSymbols(r.args().at(1));
+  if (r.argCount() == 2) {
+    QString userToMod = stripAtSymbols(r.arg(1));
 
     QSqlQuery modQuery(m_db);
     modQuery.prepare(QStringLiteral("UPDATE users SET auth_level = ? WHERE display_name = ? AND auth_level != ?"));
@@ -433,7 +784,7 @@ ChatServer::Response ChatServer::setUserAuthLevelCommand(const Request &r, Autho
     modQuery.addBindValue(userToMod);
     modQuery.addBindValue(int(Authorization::AUTH_ADMIN));
 
-    if (!modQuery.exec()) {
+    if (!execQuery(modQuery)) {
       qCritical() << "Failed to set auth level:" << modQuery.lastError();
       return Response::Error(r);
     }
@@ -441,9 +792,16 @@ ChatServer::Response ChatServer::setUserAuthLevelCommand(const Request &r, Autho
     if (modQuery.numRowsAffected() == 0) {
       return Response(r, tr("Failed to find user '%1'").arg(userToMod));
     } else {
-      auto skts = m_clients.socketsForAuthor(userToMod.toLongLong());
+      // History packets include the author's level
+      invalidateHistory();
+
+      QJsonObject event;
+      event.insert(QStringLiteral("invalidate"), true);
+      publishEvent(EventBus::EVENT_BROADCAST, event);
+
+      auto skts = socketsForAuthor(userToMod.toLongLong());
       for (auto skt : skts) {
-        skt->sendTextMessage(generateAuthLevelPacket(auth).toJson());
+        skt->sendTextMessage(generateAuthLevelPacket(auth));
       }
       return Response(r, tr("%1 auth level set to %2 successfully").arg(userToMod, QString::number(int(auth))));
     }
@@ -456,30 +814,49 @@ void ChatServer::loadResponses()
 {
   // Read commands from database
   QSqlQuery commandRetrieve(m_db);
-  if (!commandRetrieve.exec(QStringLiteral("SELECT * FROM responses"))) {
+  commandRetrieve.prepare(QStringLiteral("SELECT room, command, response FROM responses"));
+  if (!execQuery(commandRetrieve)) {
     qCritical() << "Failed to query responses:" << commandRetrieve.lastError();
     return;
   }
 
   while (commandRetrieve.next()) {
+    // Responses for rooms this server doesn't host are left alone
+    ChatRoom *room = findRoom(commandRetrieve.value(QStringLiteral("room")).toString());
+    if (!room) {
+      continue;
+    }
+
     QString command = commandRetrieve.value(QStringLiteral("command")).toString();
     QString response = commandRetrieve.value(QStringLiteral("response")).toString();
-    insertSimpleResponse(command, response);
-    qDebug() << "Loaded simple response" << command;
+    insertSimpleResponse(room, command, response);
+    qDebug() << "Loaded simple response" << command << "for room" << room->name();
   }
 }
 
 bool ChatServer::isMessageAcceptable(const QString &msg)
 {
-  QSqlQuery blockedWordQuery(QStringLiteral("SELECT word FROM banned_words"), m_db);
+  TraceSpan traceSpan("isMessageAcceptable");
+
+  QSqlQuery blockedWordQuery(m_db);
+  blockedWordQuery.prepare(QStringLiteral("SELECT word FROM banned_words"));
 
-  if (!blockedWordQuery.exec()) {
+  if (!execQuery(blockedWordQuery)) {
     qCritical() << "Failed to look up banned word list";
     return false;
   }
 
+  QStringList bannedWords;
   while (blockedWordQuery.next()) {
-    QString word = blockedWordQuery.value(QStringLiteral("word")).toString();
+    bannedWords.append(blockedWordQuery.value(QStringLiteral("word")).toString());
+  }
+
+  return isMessageAcceptable(msg, bannedWords);
+}
+
+bool ChatServer::isMessageAcceptable(const QString &msg, const QStringList &bannedWords)
+{
+  for (const QString &word : bannedWords) {
     if (msg.contains(word, Qt::CaseInsensitive)) {
       return false;
     }
@@ -497,70 +874,168 @@ QString ChatServer::stripAtSymbols(QString name)
   return name;
 }
 
-QJsonDocument ChatServer::generateChatMessageForClient(qint64 msgId, qint64 time, qint64 replyId, const QString &author, qint64 authorId, const QString &authorColor, QString msg, Authorization auth, const QString &donateValue)
+QString ChatServer::generateChatMessageForClient(qint64 msgId, qint64 time, qint64 replyId, const QString &author, qint64 authorId, const QString &authorColor, const QString &msg, Authorization auth, const QString &donateValue)
 {
-  // Escape HTML
-  msg = msg.toHtmlEscaped();
-
   // Message is valid, create JSON data to send to clients
-  QJsonObject data;
-  data.insert(QStringLiteral("id"), msgId);
-  data.insert(QStringLiteral("time"), time);
-  data.insert(QStringLiteral("author"), author);
-  data.insert(QStringLiteral("author_id"), authorId);
-  data.insert(QStringLiteral("author_color"), authorColor);
-  data.insert(QStringLiteral("author_level"), int(auth));
-  data.insert(QStringLiteral("message"), msg);
-  data.insert(QStringLiteral("auth"), int(auth));
-  data.insert(QStringLiteral("donate_value"), donateValue);
-  data.insert(QStringLiteral("reply"), replyId);
-
-  return generateClientPacket(QStringLiteral("chat"), data);
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"chat");
+  w.key(JSON_KEY("id"));
+  w.value(msgId);
+  w.key(JSON_KEY("time"));
+  w.value(time);
+  w.key(JSON_KEY("author"));
+  w.value(author);
+  w.key(JSON_KEY("author_id"));
+  w.value(authorId);
+  w.key(JSON_KEY("author_color"));
+  w.value(authorColor);
+  w.key(JSON_KEY("author_level"));
+  w.value(int(auth));
+  w.key(JSON_KEY("message"));
+  w.htmlValue(msg);
+  w.key(JSON_KEY("auth"));
+  w.value(int(auth));
+  w.key(JSON_KEY("donate_value"));
+  w.value(donateValue);
+  w.key(JSON_KEY("reply"));
+  w.value(replyId);
+  return w.endPacket();
 }
 
-void ChatServer::insertSocket(qint64 author, QWebSocket *skt)
+void ChatServer::insertSocket(ChatRoom *room, qint64 author, QWebSocket *skt)
 {
-  bool just_joined = m_clients.insertSocket(author, skt);
+  bool just_joined = room->clients().insertSocket(author, skt);
+  updateAuthorMetrics();
   if (just_joined) {
-    UserInfo info;
-    if (getUserInfoFromUserId(author, &info) && !info.name.isEmpty()) {
-      m_clients.broadcastTextMessage(generateJoinPacket(info.name).toJson());
-      qDebug() << "Chatter" << info.name << author << "joined";
+    QJsonObject event;
+    event.insert(QStringLiteral("room"), room->name());
+    event.insert(QStringLiteral("author"), author);
+    event.insert(QStringLiteral("joined"), true);
+    publishEvent(EventBus::EVENT_PRESENCE, event);
+
+    // Already shown as present if they're in this room on another node
+    if (!room->isPresentRemotely(author)) {
+      broadcastPresence(room, author, true);
     }
   }
 }
 
 void ChatServer::removeSocket(QWebSocket *skt)
 {
-  qint64 a = m_clients.removeSocket(skt);
+  ConnectionState *state = m_connections.find(skt);
+  if (!state || !state->room) {
+    return;
+  }
+
+  ChatRoom *room = state->room;
+  qint64 a = room->clients().removeSocket(skt);
+  updateAuthorMetrics();
   if (a != 0) {
-    UserInfo info;
-    if (getUserInfoFromUserId(a, &info) && !info.name.isEmpty()) {
-      m_clients.broadcastTextMessage(generatePartPacket(info.name).toJson());
-      qDebug() << "Chatter" << info.name << a << "parted";
+    QJsonObject event;
+    event.insert(QStringLiteral("room"), room->name());
+    event.insert(QStringLiteral("author"), a);
+    event.insert(QStringLiteral("joined"), false);
+    publishEvent(EventBus::EVENT_PRESENCE, event);
+
+    if (!room->isPresentRemotely(a)) {
+      broadcastPresence(room, a, false);
+    }
+  }
+}
+
+void ChatServer::updateAuthorMetrics()
+{
+  // Someone in two rooms counts twice, which is what each room's roster shows
+  int authors = 0;
+  for (const ChatRoom *room : qAsConst(m_rooms)) {
+    const UserSocketMap &clients = room->clients();
+
+    // Lurkers who only said hello are author 0, they aren't authenticated
+    authors += clients.authorCount() - (clients.containsAuthor(0) ? 1 : 0);
+  }
+  METRICS.authenticatedUsers.set(authors);
+}
+
+QList<QWebSocket*> ChatServer::socketsForAuthor(qint64 author) const
+{
+  QList<QWebSocket*> skts;
+  for (const ChatRoom *room : m_rooms) {
+    skts.append(room->clients().socketsForAuthor(author));
+  }
+  return skts;
+}
+
+void ChatServer::broadcastToAllRooms(const QString &packet)
+{
+  for (ChatRoom *room : qAsConst(m_rooms)) {
+    room->clients().broadcastTextMessage(packet);
+  }
+}
+
+void ChatServer::broadcastPresence(ChatRoom *room, qint64 author, bool joined)
+{
+  UserInfo info;
+  if (getUserInfoFromUserId(author, &info) && !info.name.isEmpty()) {
+    if (joined) {
+      room->clients().broadcastTextMessage(generateJoinPacket(info.name));
+      qDebug() << "Chatter" << info.name << author << "joined" << room->name();
+    } else {
+      room->clients().broadcastTextMessage(generatePartPacket(info.name));
+      qDebug() << "Chatter" << info.name << author << "parted" << room->name();
     }
   }
 }
 
-QJsonDocument ChatServer::generateJoinPacket(const QString &name)
+QString ChatServer::generateJoinPacket(const QString &name)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"join");
+  w.key(JSON_KEY("name"));
+  w.value(name);
+  return w.endPacket();
+}
+
+QString ChatServer::generatePartPacket(const QString &name)
+{
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"part");
+  w.key(JSON_KEY("name"));
+  w.value(name);
+  return w.endPacket();
+}
+
+QString ChatServer::generateAuthLevelPacket(Authorization auth)
 {
-  QJsonObject d;
-  d.insert(QStringLiteral("name"), name);
-  return generateClientPacket(QStringLiteral("join"), d);
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"authlevel");
+  w.key(JSON_KEY("value"));
+  w.value(int(auth));
+  return w.endPacket();
 }
 
-QJsonDocument ChatServer::generatePartPacket(const QString &name)
+QString ChatServer::generateReconnectPacket(int delay)
 {
-  QJsonObject d;
-  d.insert(QStringLiteral("name"), name);
-  return generateClientPacket(QStringLiteral("part"), d);
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"reconnect");
+  w.key(JSON_KEY("delay"));
+  w.value(delay);
+  return w.endPacket();
 }
 
-QJsonDocument ChatServer::generateAuthLevelPacket(Authorization auth)
+QString ChatServer::generateHistoryPacket(const QVector<ChatRoom::CachedPacket> &messages, bool more)
 {
-  QJsonObject o;
-  o.insert(QStringLiteral("value"), int(auth));
-  return generateClientPacket(QStringLiteral("authlevel"), o);
+  // Messages are embedded as the already escaped packets, clients handle them like live ones
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(u"history");
+  w.key(JSON_KEY("messages"));
+  w.beginArray();
+  for (const ChatRoom::CachedPacket &p : messages) {
+    w.rawValue(p.packet);
+  }
+  w.endArray();
+  w.key(JSON_KEY("more"));
+  w.value(more);
+  return w.endPacket();
 }
 
 AuthModule *ChatServer::getAuthModuleById(const QString &id) const
@@ -574,20 +1049,61 @@ AuthModule *ChatServer::getAuthModuleById(const QString &id) const
   return nullptr;
 }
 
+void ChatServer::loadRateLimits()
+{
+  // Defaults, overridable per packet type with "rate_limits" in the config. Out of the box only
+  // the overall 10 packets per second applies, as it always has. History is the exception, since
+  // every page past the cache is a database query.
+  m_rateLimits[PACKET_ANY] = {10, 10};
+  m_rateLimits[PACKET_HELLO] = {0, 0};
+  m_rateLimits[PACKET_STATUS] = {0, 0};
+  m_rateLimits[PACKET_MESSAGE] = {0, 0};
+  m_rateLimits[PACKET_PAYPAL] = {0, 0};
+  m_rateLimits[PACKET_HISTORY] = {1, 5};
+  m_rateLimits[PACKET_OTHER] = {0, 0};
+
+  const QVariantMap &config = CONFIG.live().rateLimits;
+  for (int i = 0; i < PACKET_TYPE_COUNT; i++) {
+    QVariantMap limit = config.value(QLatin1String(getPacketTypeName(static_cast<PacketType>(i)))).toMap();
+    if (limit.contains(QStringLiteral("rate"))) {
+      m_rateLimits[i].rate = limit.value(QStringLiteral("rate")).toDouble();
+    }
+    if (limit.contains(QStringLiteral("burst"))) {
+      m_rateLimits[i].burst = limit.value(QStringLiteral("burst")).toDouble();
+    }
+  }
+}
+
 void ChatServer::handleNewConnection()
 {
-  QWebSocket *skt = m_server->nextPendingConnection();
+  while (QWebSocket *skt = m_server->nextPendingConnection()) {
+    QHostAddress address = skt->peerAddress();
+
+    m_listener->upgraded(skt);
+    m_capture.recordConnect(skt, address);
 
-  connect(skt, &QWebSocket::textMessageReceived, this, &ChatServer::processClientMessage);
-  connect(skt, &QWebSocket::disconnected, this, &ChatServer::clientDisconnected);
+    m_connections.insert(skt, address, m_clock.elapsed());
+    METRICS.chatConnections.set(m_connections.size());
+    m_heartbeat->add(skt);
+
+    connect(skt, &QWebSocket::textMessageReceived, this, &ChatServer::processClientMessage);
+    connect(skt, &QWebSocket::disconnected, this, &ChatServer::clientDisconnected);
+  }
 }
 
 void ChatServer::clientDisconnected()
 {
   QWebSocket *s = static_cast<QWebSocket*>(sender());
 
+  m_capture.recordDisconnect(s);
+  m_heartbeat->remove(s);
   removeSocket(s);
 
+  if (m_connections.find(s)) {
+    m_connections.remove(s);
+    METRICS.chatConnections.set(m_connections.size());
+  }
+
   s->deleteLater();
 }
 
@@ -600,7 +1116,16 @@ void ChatServer::processAuthenticatedMessage(QPointer<QWebSocket> client, const
     return;
   }
 
-  insertSocket(id, client);
+  HistogramTimer timer(METRICS.clientMessageStages[Metrics::STAGE_HANDLE]);
+  TraceSpan traceSpan("processAuthenticatedMessage");
+
+  // Also catches clients that disconnected while authentication was pending
+  ChatRoom *room = roomForSocket(client);
+  if (!room) {
+    return;
+  }
+
+  insertSocket(room, id, client);
 
   if (type == QStringLiteral("status")) {
     sendUserState(client, id);
@@ -610,12 +1135,12 @@ void ChatServer::processAuthenticatedMessage(QPointer<QWebSocket> client, const
       QSqlQuery authLevelQuery(m_db);
       authLevelQuery.prepare(QStringLiteral("SELECT auth_level FROM users WHERE id = ?"));
       authLevelQuery.addBindValue(id);
-      if (!authLevelQuery.exec()) {
+      if (!execQuery(authLevelQuery)) {
         qCritical() << "Failed to get auth_level" << authLevelQuery.lastError();
       } else if (!authLevelQuery.next()) {
         qCritical() << "Failed to get auth_level, user" << id << "didn't exist";
       } else {
-        client->sendTextMessage(generateAuthLevelPacket(static_cast<Authorization>(authLevelQuery.value(QStringLiteral("auth_level")).toInt())).toJson());
+        client->sendTextMessage(generateAuthLevelPacket(static_cast<Authorization>(authLevelQuery.value(QStringLiteral("auth_level")).toInt())));
       }
     }
   } else if (type == QStringLiteral("getuserconf")) {
@@ -623,9 +1148,9 @@ void ChatServer::processAuthenticatedMessage(QPointer<QWebSocket> client, const
   } else if (type == QStringLiteral("setuserconf")) {
     processSetUserConfig(client, id, data);
   } else if (type == QStringLiteral("message")) {
-    processChatMessage(client, id, data);
+    processChatMessage(room, client, id, data);
   } else if (type == QStringLiteral("paypal")) {
-    processPayPal(client->peerAddress(), id, data);
+    processPayPal(room, client->peerAddress(), id, data);
   }
 }
 
@@ -638,88 +1163,135 @@ void ChatServer::processClientMessage(const QString &s)
 {
   QWebSocket *client = static_cast<QWebSocket*>(sender());
 
-  // Ignore packet if sent too recently to last packet (attempt to mitigate DDoS)
-  {
-    //
-    // Enforce no more than 10 requests per second
-    //
-    const qint64 MAX_REQUEST_COUNT = 10;
-    const qint64 MAX_REQUEST_INTERVAL = 1000;
+  ConnectionState *state = m_connections.find(client);
+  if (!state) {
+    return;
+  }
 
-    // Get access record
-    std::list<qint64> accessRecord = client->property("access").value< std::list<qint64> >();
+  // Captured before any checks so replay reproduces floods and junk as well
+  m_capture.recordFrame(client, s);
 
-    // Push back now time
-    accessRecord.push_back(QDateTime::currentMSecsSinceEpoch());
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+  // Older Qt can't cap messages while they arrive, but they can at least be dropped unread
+  if (s.size() > m_listener->admission().maxMessageSize()) {
+    client->abort();
+    return;
+  }
+#endif
 
-    // Keep list 10 elements long
-    if (accessRecord.size() > MAX_REQUEST_COUNT) {
-      accessRecord.pop_front();
-    }
+  // Anything at all, even a throttled packet, shows the client is still there
+  m_heartbeat->touch(client);
 
-    // Store access history in socket
-    client->setProperty("access", QVariant::fromValue(accessRecord));
+  // Every span from here until the broadcast is attributed to this packet
+  TraceRequest traceRequest(TRACER.newRequest());
+  TraceSpan traceSpan("processClientMessage");
 
-    // If we have the maximum number of requests, make sure they happened in longer than the max
-    // interval for that amount of requests
-    if (accessRecord.size() == MAX_REQUEST_COUNT) {
-      qint64 diff = accessRecord.back() - accessRecord.front();
-      if (diff < MAX_REQUEST_INTERVAL) {
-        // Too many requests per second. Discard.
-        return;
-      }
+  qint64 now = m_clock.elapsed();
+
+  // Ignore packet if sent too soon after previous packets (attempt to mitigate DDoS)
+  {
+    TraceSpan rateLimitSpan("rate_limit");
+    if (!state->limiters[PACKET_ANY].consume(m_rateLimits[PACKET_ANY], now)) {
+      METRICS.packetsThrottled[PACKET_ANY].add();
+      return;
     }
   }
 
-  QJsonDocument json = QJsonDocument::fromJson(s.toUtf8());
-  QString type = json.object().value(QStringLiteral("type")).toString();
-  QJsonValue data = json.object().value(QStringLiteral("data"));
+  // Only the envelope is parsed up front so floods and junk can be discarded cheaply
+  PacketEnvelope envelope;
+  {
+    HistogramTimer timer(METRICS.clientMessageStages[Metrics::STAGE_PARSE]);
+    TraceSpan parseSpan("parse");
+    if (!envelope.parse(s)) {
+      METRICS.packetsMalformed.add();
+      return;
+    }
+  }
 
-  // Hello is processed before anything else
-  if (type == QStringLiteral("hello")) {
-    processHello(client, data);
+  PacketType packetType = envelope.packetType();
+  METRICS.packetsReceived[packetType].add();
+  if (!state->limiters[packetType].consume(m_rateLimits[packetType], now)) {
+    METRICS.packetsThrottled[packetType].add();
     return;
   }
 
-  // Check if IP is banned
-
-  // First, check if IP is banned
-  QSqlQuery bannedHostQuery(m_db);
-  bannedHostQuery.prepare(QStringLiteral("SELECT * FROM banned_hosts WHERE host = ? AND until > ?"));
-  bannedHostQuery.addBindValue(client->peerAddress().toString());
-  bannedHostQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
-  if (!bannedHostQuery.exec()) {
-    qCritical() << "Failed to check for banned host:" << bannedHostQuery.lastError();
-    sendInternalServerError(client);
+  // Hello is processed before anything else
+  if (packetType == PACKET_HELLO) {
+    processHello(client, envelope.data());
     return;
   }
 
-  if (bannedHostQuery.next()) {
-    // Banned host exists in the database
-    sendUserStatusMessage(client, STATUS_BANNED);
+  // History is as public as what hello sends, so scrolling back doesn't need a login
+  if (packetType == PACKET_HISTORY) {
+    processHistory(client, envelope.data());
     return;
   }
 
-  // Ensure token is valid
-  QString token = json.object().value(QStringLiteral("token")).toString();
-  QString redirect_uri = json.object().value(QStringLiteral("redirect_uri")).toString();
-  QString authType = json.object().value(QStringLiteral("auth")).toString();
-  if (token.isEmpty() || authType.isEmpty()) {
+  // Check if IP is banned
+  {
+    HistogramTimer timer(METRICS.clientMessageStages[Metrics::STAGE_BAN_CHECK]);
+    TraceSpan banSpan("ban_check");
+
+    QSqlQuery bannedHostQuery(m_db);
+    bannedHostQuery.prepare(QStringLiteral("SELECT * FROM banned_hosts WHERE host = ? AND until > ?"));
+    bannedHostQuery.addBindValue(state->address.toString());
+    bannedHostQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
+    if (!execQuery(bannedHostQuery)) {
+      qCritical() << "Failed to check for banned host:" << bannedHostQuery.lastError();
+      sendInternalServerError(client);
+      return;
+    }
+
+    if (bannedHostQuery.next()) {
+      // Banned host exists in the database
+      sendUserStatusMessage(client, STATUS_BANNED);
+      return;
+    }
+  }
+
+  // Ensure token is present and we know how to check it before authenticating
+  if (envelope.token().isEmpty() || envelope.auth().isEmpty()) {
     sendUserStatusMessage(client, STATUS_UNAUTHENTICATED);
     return;
   }
 
-  if (AuthModule *a = getAuthModuleById(authType)) {
-    a->authenticate(m_db, token, redirect_uri, std::bind(&ChatServer::processAuthenticatedMessage, this, client, type, data, std::placeholders::_1), std::bind(&ChatServer::handleAuthFailure, this, client));
-  } else {
+  AuthModule *authModule = getAuthModuleById(envelope.auth().toString());
+  if (!authModule) {
     // Don't know how to handle this auth service
     sendUserStatusMessage(client, STATUS_UNAUTHENTICATED);
     return;
   }
+
+  QString type = envelope.type().toString();
+
+  // Only decode data for packets that actually use it
+  QJsonValue data;
+  if (packetType == PACKET_MESSAGE || packetType == PACKET_PAYPAL || type == QStringLiteral("setuserconf")) {
+    data = envelope.data();
+  }
+
+  // Authentication may finish asynchronously, so time it from here to the callback
+  QElapsedTimer authTimer;
+  authTimer.start();
+  quint64 request = Tracer::currentRequest();
+  qint64 traceStart = TRACER.isEnabled() ? TRACER.now() : 0;
+  QPointer<QWebSocket> guard(client);
+  auto authenticated = [this, guard, type, data, authTimer, request, traceStart](qint64 id){
+    METRICS.clientMessageStages[Metrics::STAGE_AUTHENTICATE].observe(authTimer.nsecsElapsed());
+    TRACER.record("authenticate", request, traceStart, TRACER.now(), true);
+
+    // May be called later from the event loop, so restore the request the spans belong to
+    TraceRequest traceRequest(request);
+    processAuthenticatedMessage(guard, type, data, id);
+  };
+
+  authModule->authenticate(m_db, envelope.token().toString(), envelope.redirectUri().toString(), authenticated, std::bind(&ChatServer::handleAuthFailure, this, client));
 }
 
-void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const QJsonValue &data)
+void ChatServer::processChatMessage(ChatRoom *room, QWebSocket *client, qint64 authorId, const QJsonValue &data)
 {
+  TraceSpan traceSpan("processChatMessage");
+
   UserInfo info;
 
   // Using the user ID, try loading the user's details
@@ -763,33 +1335,37 @@ void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const Q
 
     // Prevent possible backdoor to admin access
     if (!info.name.isEmpty() && authorId != 0) {
-      Request r(strippedMsg, info.name, authorId, info.auth);
-      qDebug() << info.name << "tried to use command" << r.command();
+      Request r(strippedMsg, info.name, authorId, info.auth, room);
+      qDebug() << info.name << "tried to use command" << r.commandView();
 
-      if (r.command().isEmpty()) {
+      if (r.commandView().isEmpty()) {
         return;
-      } else if (m_commandMap.contains(r.command())) {
-        const CommandHandler &hnd = m_commandMap.value(r.command());
-        if (r.authorization() >= hnd.authorization) {
-          response = (this->*hnd.handler)(r);
-        } else {
-          response = Response(r, tr("You don't have permission to use this command."));
-        }
-      } else {
+      }
+
+      CommandMatch match = findCommand(room, r.commandView());
+      if (!match.found) {
         response = Response(r, tr("Don't know command \"%1\"").arg(r.command()));
+      } else if (r.authorization() < match.authorization) {
+        response = Response(r, tr("You don't have permission to use this command."));
+      } else if (match.handler) {
+        response = (this->*match.handler)(r);
+      } else {
+        response = Response(r, match.response, true);
       }
     }
   } else {
     // Handle a mention of the bot
-    if (msg.contains(QStringLiteral("@%1").arg(CONFIG[QStringLiteral("bot_name")].toString()), Qt::CaseInsensitive)) {
-      response = doMention(Request(msg, info.name, authorId, info.auth));
+    if (m_mentions.isMentioned(msg)) {
+      response = doMention(Request(msg, info.name, authorId, info.auth, room));
     }
   }
 
   if ((!response.isValid() || response.isPublic()) && info.auth < Authorization::AUTH_MOD) {
+    const ChatRoom::Settings &settings = room->settings();
+
     // Check if user has violated slow mode
-    if (m_slowMode > 0) {
-      qint64 slowModeDelta = info.lastMessageTime + m_slowMode - now;
+    if (settings.slowMode > 0) {
+      qint64 slowModeDelta = info.lastMessageTime + settings.slowMode - now;
       if (slowModeDelta > 0) {
         sendServerMessage(client, tr("Chat is in slow mode, please wait %1 seconds to send another message.").arg(slowModeDelta));
         return;
@@ -797,8 +1373,8 @@ void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const Q
     }
 
     // If this is not a bot message, and it's a duplicate that happened too quickly, reject it
-    if (m_duplicateSlowMode > 0 && msg == info.lastMessage) {
-      qint64 slowModeDelta = info.lastMessageTime + m_duplicateSlowMode - now;
+    if (settings.duplicateSlowMode > 0 && msg == info.lastMessage) {
+      qint64 slowModeDelta = info.lastMessageTime + settings.duplicateSlowMode - now;
       if (slowModeDelta > 0) {
         sendServerMessage(client, tr("Your identical message was sent too quickly, please wait %1 seconds to send it again.").arg(slowModeDelta));
         return;
@@ -806,10 +1382,10 @@ void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const Q
     }
 
     // Check if user is allowed to speak yet
-    if (m_followMode > 0) {
-      qint64 followDelta = now - (info.createdAt + m_followMode);
+    if (settings.followMode > 0) {
+      qint64 followDelta = now - (info.createdAt + settings.followMode);
       if (followDelta < 0) {
-        sendServerMessage(client, tr("Your account must be at least %1 seconds old to message here. Please wait another %2 seconds.").arg(QString::number(m_followMode), QString::number(-followDelta)));
+        sendServerMessage(client, tr("Your account must be at least %1 seconds old to message here. Please wait another %2 seconds.").arg(QString::number(settings.followMode), QString::number(-followDelta)));
         return;
       }
     }
@@ -821,14 +1397,14 @@ void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const Q
       updateLastMsgQuery.addBindValue(msg);
       updateLastMsgQuery.addBindValue(now);
       updateLastMsgQuery.addBindValue(authorId);
-      if (!updateLastMsgQuery.exec()) {
+      if (!execQuery(updateLastMsgQuery)) {
         qCritical() << "Failed to update last message information:" << updateLastMsgQuery.lastError();
       }
     }
   }
 
   if (!response.isValid() || response.isPublic()) {
-    publish(info.name, authorId, replyMsg, msg, info.color, ip, info.auth);
+    publish(room, info.name, authorId, replyMsg, msg, info.color, ip, info.auth);
   }
 
   if (response.isValid()) {
@@ -836,9 +1412,7 @@ void ChatServer::processChatMessage(QWebSocket *client, qint64 authorId, const Q
   }
 
   // Let client know we accepted the message
-  QJsonObject accept;
-  accept.insert(QStringLiteral("message"), msg);
-  client->sendTextMessage(generateClientPacket(QStringLiteral("accepted"), accept).toJson());
+  client->sendTextMessage(generateAcceptedPacket(msg));
 }
 
 void ChatServer::processGetUserConfig(QWebSocket *client, qint64 id)
@@ -846,7 +1420,7 @@ void ChatServer::processGetUserConfig(QWebSocket *client, qint64 id)
   QSqlQuery currentConfigLookup(m_db);
   currentConfigLookup.prepare(QStringLiteral("SELECT display_name, display_color FROM users WHERE id = ?"));
   currentConfigLookup.addBindValue(id);
-  if (!currentConfigLookup.exec()) {
+  if (!execQuery(currentConfigLookup)) {
     qCritical() << "Failed to retrieve current user config:" << currentConfigLookup.lastError();
     return;
   }
@@ -856,10 +1430,7 @@ void ChatServer::processGetUserConfig(QWebSocket *client, qint64 id)
     return;
   }
 
-  QJsonObject data;
-  data.insert(QStringLiteral("name"), currentConfigLookup.value(QStringLiteral("display_name")).toString());
-  data.insert(QStringLiteral("color"), currentConfigLookup.value(QStringLiteral("display_color")).toString());
-  client->sendTextMessage(generateClientPacket(QStringLiteral("getuserconf"), data).toJson());
+  client->sendTextMessage(generateUserConfigPacket(currentConfigLookup.value(QStringLiteral("display_name")).toString(), currentConfigLookup.value(QStringLiteral("display_color")).toString()));
 }
 
 void ChatServer::processSetUserConfig(QWebSocket *client, qint64 id, const QJsonValue &data)
@@ -873,7 +1444,7 @@ void ChatServer::processSetUserConfig(QWebSocket *client, qint64 id, const QJson
     QSqlQuery currentConfigLookup(m_db);
     currentConfigLookup.prepare(QStringLiteral("SELECT display_name, display_name_change_time FROM users WHERE id = ?"));
     currentConfigLookup.addBindValue(id);
-    if (!currentConfigLookup.exec()) {
+    if (!execQuery(currentConfigLookup)) {
       qCritical() << "Failed to retrieve display name change time:" << currentConfigLookup.lastError();
       return;
     }
@@ -893,8 +1464,14 @@ void ChatServer::processSetUserConfig(QWebSocket *client, qint64 id, const QJson
     updateColorQuery.prepare(QStringLiteral("UPDATE users SET display_color = ? WHERE id = ?"));
     updateColorQuery.addBindValue(o.value(QStringLiteral("color")));
     updateColorQuery.addBindValue(id);
-    if (!updateColorQuery.exec()) {
+    if (!execQuery(updateColorQuery)) {
       qCritical() << "Failed to update color:" << updateColorQuery.lastError();
+    } else {
+      invalidateHistory();
+
+      QJsonObject event;
+      event.insert(QStringLiteral("invalidate"), true);
+      publishEvent(EventBus::EVENT_BROADCAST, event);
     }
   }
 
@@ -931,7 +1508,7 @@ void ChatServer::processSetUserConfig(QWebSocket *client, qint64 id, const QJson
       renameQuery.addBindValue(newName);
       renameQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
       renameQuery.addBindValue(id);
-      if (!renameQuery.exec()) {
+      if (!execQuery(renameQuery)) {
         // SQL error, determine whether it's a "duplicate entry" error or some other error
         QSqlError err = renameQuery.lastError();
         if (err.nativeErrorCode() == QStringLiteral("1062")) {
@@ -945,10 +1522,20 @@ void ChatServer::processSetUserConfig(QWebSocket *client, qint64 id, const QJson
       }
 
       // If we're here, username changed successfully. Let all clients know.
+      invalidateHistory();
+      QJsonArray packets;
       if (!oldName.isEmpty()) {
-        m_clients.broadcastTextMessage(generatePartPacket(oldName).toJson());
+        packets.append(generatePartPacket(oldName));
+      }
+      packets.append(generateJoinPacket(newName));
+      for (const QJsonValue &packet : qAsConst(packets)) {
+        broadcastToAllRooms(packet.toString());
       }
-      m_clients.broadcastTextMessage(generateJoinPacket(newName).toJson());
+
+      QJsonObject event;
+      event.insert(QStringLiteral("packets"), packets);
+      event.insert(QStringLiteral("invalidate"), true);
+      publishEvent(EventBus::EVENT_BROADCAST, event);
     }
   }
 
@@ -963,88 +1550,167 @@ void ReportPayPalError(const QString &orderId, qint64 userId, const QString &use
 
 void ChatServer::processHello(QWebSocket *client, const QJsonValue &data)
 {
-  // Send last few messages as history
-  const int HISTORY_LENGTH = 50;
+  ConnectionState *state = m_connections.find(client);
+  if (!state) {
+    return;
+  }
 
   QJsonObject o = data.toObject();
 
-  QSqlQuery historyQuery(m_db);
-  historyQuery.prepare(QStringLiteral("SELECT id, user_id, message, donate_value, time, reply_id FROM history WHERE dropped = 0 AND id > ? ORDER BY time DESC LIMIT ?"));
-  historyQuery.addBindValue(o.value(QStringLiteral("last_message")).toInt());
-  historyQuery.addBindValue(HISTORY_LENGTH);
-  if (!historyQuery.exec()) {
-    qCritical() << "Failed to retrieve chat messages for history:" << historyQuery.lastError();
+  // Clients that don't name a room get the default one
+  QString roomName = o.value(QStringLiteral("room")).toString();
+  ChatRoom *room = roomName.isEmpty() ? m_defaultRoom : findRoom(roomName);
+  if (!room) {
+    sendServerMessage(client, tr("That room doesn't exist"));
+    return;
   }
 
-  struct Msg
-  {
-    QString author;
-    qint64 authorId;
-    qint64 replyId;
-    QString authorColor;
-    QString message;
-    qint64 messageId;
-    qint64 messageTime;
-    Authorization auth;
-    QString donateValue;
-  };
+  // Saying hello again with another room moves the client there
+  if (state->room && state->room != room) {
+    removeSocket(client);
+  }
+  state->room = room;
+
+  if (!room->isHistoryValid()) {
+    loadHistory(room);
+  }
+
+  // Send last few messages as history, skipping any the client says it already has
+  qint64 lastMessage = qint64(o.value(QStringLiteral("last_message")).toDouble());
+  for (const ChatRoom::CachedPacket &p : room->history()) {
+    if (p.id > lastMessage) {
+      client->sendTextMessage(p.packet);
+    }
+  }
 
-  std::list<Msg> msgs;
+  // Everyone in the room on any node in the cluster
+  const QSet<qint64> activeUsers = room->activeAuthors();
+
+  client->sendTextMessage(generateJoinPacket(CONFIG.live().botName));
+  for (qint64 a : activeUsers) {
+    UserInfo info;
+    if (getUserInfoFromUserId(a, &info) && !info.name.isEmpty()) {
+      client->sendTextMessage(generateJoinPacket(info.name));
+    }
+  }
+
+  insertSocket(room, 0, client);
+}
+
+void ChatServer::loadHistory(ChatRoom *room)
+{
+  room->invalidateHistory();
+
+  QVector<ChatRoom::CachedPacket> history;
+  int rows;
+  if (queryHistory(room, std::numeric_limits<qint64>::max(), ChatRoom::HISTORY_LENGTH, &history, &rows)) {
+    room->setHistory(history, rows < ChatRoom::HISTORY_LENGTH);
+  }
+}
+
+bool ChatServer::queryHistory(ChatRoom *room, qint64 before, int limit, QVector<ChatRoom::CachedPacket> *out, int *rows)
+{
+  TraceSpan traceSpan("history_query");
+
+  out->clear();
+  *rows = 0;
+
+  // Walks the (room, id) index back from before, so a page costs the same however far back it is.
+  // Authors come from the same query rather than one lookup per message.
+  QSqlQuery historyQuery(m_db);
+  historyQuery.prepare(QStringLiteral("SELECT h.id, h.user_id, h.message, h.donate_value, h.time, h.reply_id, u.id AS found_user, u.display_name, u.display_color, u.auth_level "
+                                      "FROM history h LEFT JOIN users u ON u.id = h.user_id "
+                                      "WHERE h.room = ? AND h.id < ? AND h.dropped = 0 ORDER BY h.id DESC LIMIT ?"));
+  historyQuery.addBindValue(room->name());
+  historyQuery.addBindValue(before);
+  historyQuery.addBindValue(limit);
+  if (!execQuery(historyQuery)) {
+    qCritical() << "Failed to retrieve chat messages for history:" << historyQuery.lastError();
+    return false;
+  }
 
   while (historyQuery.next()) {
-    Msg m;
+    // Counted before anything is skipped, so callers can tell whether older rows exist
+    (*rows)++;
 
-    m.authorId = historyQuery.value(QStringLiteral("user_id")).toLongLong();
+    qint64 authorId = historyQuery.value(QStringLiteral("user_id")).toLongLong();
+    QString author;
+    QString authorColor;
+    Authorization auth = Authorization::AUTH_USER;
 
-    if (m.authorId == 0) {
-      m.author = CONFIG[QStringLiteral("bot_name")].toString();
+    if (authorId == 0) {
+      author = CONFIG.live().botName;
     } else {
-      QSqlQuery authorQuery(m_db);
-      authorQuery.prepare(QStringLiteral("SELECT display_name, display_color, auth_level FROM users WHERE id = ?"));
-      authorQuery.addBindValue(m.authorId);
-      if (!authorQuery.exec()) {
-        qCritical() << "Failed to query author display name for chat:" << authorQuery.lastError();
-        continue;
-      }
-
-      if (!authorQuery.next()) {
+      if (historyQuery.value(QStringLiteral("found_user")).isNull()) {
         qCritical() << "Failed to find author display name for chat, row did not exist";
         continue;
       }
 
-      m.author = authorQuery.value(QStringLiteral("display_name")).toString();
-      m.authorColor = authorQuery.value(QStringLiteral("display_color")).toString();
-      m.auth = static_cast<Authorization>(authorQuery.value(QStringLiteral("auth_level")).toInt());
+      author = historyQuery.value(QStringLiteral("display_name")).toString();
+      authorColor = historyQuery.value(QStringLiteral("display_color")).toString();
+      auth = static_cast<Authorization>(historyQuery.value(QStringLiteral("auth_level")).toInt());
     }
 
-    m.messageTime = historyQuery.value(QStringLiteral("time")).toLongLong();
-    m.messageId = historyQuery.value(QStringLiteral("id")).toLongLong();
-    m.message = historyQuery.value(QStringLiteral("message")).toString();
-    m.replyId = historyQuery.value(QStringLiteral("reply_id")).toLongLong();
-    m.donateValue = historyQuery.value(QStringLiteral("donate_value")).toString();
+    qint64 messageId = historyQuery.value(QStringLiteral("id")).toLongLong();
+    qint64 messageTime = historyQuery.value(QStringLiteral("time")).toLongLong();
+    qint64 replyId = historyQuery.value(QStringLiteral("reply_id")).toLongLong();
+    QString message = historyQuery.value(QStringLiteral("message")).toString();
+    QString donateValue = historyQuery.value(QStringLiteral("donate_value")).toString();
 
-    msgs.push_back(m);
+    // Query is newest first, history is kept oldest first
+    out->prepend({messageId, generateChatMessageForClient(messageId, messageTime, replyId, author, authorId, authorColor, message, auth, donateValue)});
   }
 
-  while (!msgs.empty()) {
-    const Msg &m = msgs.back();
-    client->sendTextMessage(generateChatMessageForClient(m.messageId, m.messageTime, m.replyId, m.author, m.authorId, m.authorColor, m.message, m.auth, m.donateValue).toJson());
-    msgs.pop_back();
+  return true;
+}
+
+void ChatServer::processHistory(QWebSocket *client, const QJsonValue &data)
+{
+  TraceSpan traceSpan("processHistory");
+
+  ChatRoom *room = roomForSocket(client);
+  if (!room) {
+    return;
   }
 
-  const QList<qint64> activeUsers = m_clients.authors();
-  client->sendTextMessage(generateJoinPacket(CONFIG[QStringLiteral("bot_name")].toString()).toJson());
-  for (qint64 a : activeUsers) {
-    UserInfo info;
-    if (getUserInfoFromUserId(a, &info) && !info.name.isEmpty()) {
-      client->sendTextMessage(generateJoinPacket(info.name).toJson());
+  QJsonObject o = data.toObject();
+
+  // Without a message to start from, the newest page is sent
+  qint64 before = qint64(o.value(QStringLiteral("before")).toDouble());
+  if (before <= 0) {
+    before = std::numeric_limits<qint64>::max();
+  }
+
+  int limit = qBound(1, o.value(QStringLiteral("limit")).toInt(ChatRoom::HISTORY_LENGTH), int(HISTORY_PAGE_MAX));
+
+  // Most requests are for the first page or two back from what hello sent
+  if (!room->isHistoryValid()) {
+    loadHistory(room);
+  }
+
+  QVector<ChatRoom::CachedPacket> page;
+  bool more;
+  if (!room->historyPage(before, limit, &page, &more)) {
+    METRICS.historyPageQueries.add();
+
+    // The extra row only tells whether there's anything older
+    int rows;
+    if (!queryHistory(room, before, limit + 1, &page, &rows)) {
+      sendInternalServerError(client);
+      return;
+    }
+
+    // Rows without an author are left out of the page, which mustn't end the scrollback early
+    more = rows > limit;
+    if (page.size() > limit) {
+      page.removeFirst();
     }
   }
 
-  insertSocket(0, client);
+  client->sendTextMessage(generateHistoryPacket(page, more));
 }
 
-void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJsonValue &data)
+void ChatServer::processPayPal(ChatRoom *room, const QHostAddress &address, qint64 id, const QJsonValue &data)
 {
   static QByteArray PP_ACCESS_TOKEN;
 
@@ -1091,7 +1757,7 @@ void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJs
   req.setRawHeader(QByteArrayLiteral("Authorization"), QByteArrayLiteral("Bearer ").append(PP_ACCESS_TOKEN));
 
   auto reply = m_netMan->get(req);
-  connect(reply, &QNetworkReply::finished, this, [this, address, id, data, info, message, orderId, order]{
+  connect(reply, &QNetworkReply::finished, this, [this, room, address, id, data, info, message, orderId, order]{
     auto reply = static_cast<QNetworkReply*>(sender());
     auto doc = QJsonDocument::fromJson(reply->readAll());
 
@@ -1112,12 +1778,12 @@ void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJs
         tokenReq.setRawHeader(QByteArrayLiteral("Authorization"), QByteArrayLiteral("Basic ").append(auth));
 
         QNetworkReply *tokenReply = m_netMan->post(tokenReq, QByteArrayLiteral("grant_type=client_credentials"));
-        connect(tokenReply, &QNetworkReply::finished, this, [this, address, id, data]{
+        connect(tokenReply, &QNetworkReply::finished, this, [this, room, address, id, data]{
           auto reply = static_cast<QNetworkReply*>(sender());
           auto json = QJsonDocument::fromJson(reply->readAll());
 
           PP_ACCESS_TOKEN = json.object().value(QStringLiteral("access_token")).toString().toUtf8();
-          processPayPal(address, id, data);
+          processPayPal(room, address, id, data);
         });
       } else {
         // Handle unknown error
@@ -1137,7 +1803,7 @@ void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJs
       recordQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
       recordQuery.addBindValue(QJsonDocument(order).toJson());
       recordQuery.addBindValue(message);
-      if (!recordQuery.exec()) {
+      if (!execQuery(recordQuery)) {
         QSqlError err = recordQuery.lastError();
         if (err.nativeErrorCode() == QStringLiteral("1062")) { // Duplicate key
           ReportPayPalError(orderId, id, name, tr("transaction already exists in database"));
@@ -1188,7 +1854,7 @@ void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJs
       return;
     }
 
-    if (message > CONFIG[QStringLiteral("max_chat_length")].toInt()) {
+    if (message > CONFIG.live().maxChatLength) {
       ReportPayPalError(orderId, id, name, tr("message was too long"));
       return;
     }
@@ -1198,8 +1864,8 @@ void ChatServer::processPayPal(const QHostAddress &address, qint64 id, const QJs
       return;
     }
 
-    emit requestOverlayMessage(OverlayMessage::Alert(tr("%1 donated $%2").arg(name, amountStr), message));
-    publish(name, id, 0, message, info.color, address, info.auth, amountStr);
+    sendOverlayMessage(OverlayMessage::Alert(tr("%1 donated $%2").arg(name, amountStr), message));
+    publish(room, name, id, 0, message, info.color, address, info.auth, amountStr);
   });
 }
 
@@ -1362,10 +2028,9 @@ void ChatServer::youtube_lookupUser(const MessageData &msg, const QString &auth_
 }
 */
 
-void ChatServer::insertSimpleResponse(const QString &command, const QString &response)
+void ChatServer::insertSimpleResponse(ChatRoom *room, const QString &command, const QString &response)
 {
-  insertCommand(command, &ChatServer::commandSimpleResponse, Authorization::AUTH_USER);
-  m_simpleResponses.insert(command, response);
+  room->responses().insert(command, response);
 }
 
 void ChatServer::checkApiError(QNetworkReply *r)
@@ -1,6 +1,8 @@
 #ifndef CHATSERVER_H
 #define CHATSERVER_H
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -9,8 +11,10 @@
 #include <QObject>
 #include <QPointer>
 #include <QRandomGenerator>
+#include <QSet>
 #include <QSslCertificate>
 #include <QSslKey>
+#include <QTimer>
 #include <QTimeZone>
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlError>
@@ -18,12 +22,26 @@
 #include <QtSql/QSqlResult>
 #include <QtSql/QSqlQuery>
 #include <QUrlQuery>
+#include <QVarLengthArray>
 #include <QWebSocket>
 #include <QWebSocketServer>
 
+#include "admissionserver.h"
 #include "auth/authmodule.h"
+#include "chatroom.h"
+#include "connectiontable.h"
+#include "eventbus.h"
+#include "heartbeatmonitor.h"
+#include "mentionmatcher.h"
+#include "metrics.h"
+#include "overlaychannel.h"
 #include "overlaymessage.h"
+#include "perfecthash.h"
+#include "responsetable.h"
+#include "sqlexec.h"
 #include "startupconfig.h"
+#include "tracer.h"
+#include "trafficcapture.h"
 #include "usersocketmap.h"
 #include "util.h"
 
@@ -34,27 +52,18 @@ public:
   class Request
   {
   public:
-    Request(const QString &line, const QString &author, qint64 authorId, Authorization auth)
+    Request(const QString &line, const QString &author, qint64 authorId, Authorization auth, ChatRoom *room) :
+      m_line(line),
+      m_author(author),
+      m_authorId(authorId),
+      m_authorization(auth),
+      m_room(room)
     {
-      m_line = line;
-      m_args = m_line.split(QRegExp("\\s+(?=([^\"]*\"[^\"]*\")*[^\"]*$)"));
-      for (int i=0; i<m_args.size(); i++) {
-        QString &s = m_args[i];
-        if (s.startsWith('"')) {
-          s.remove(0, 1);
-        }
-        if (s.endsWith('"')) {
-          s.chop(1);
-        }
-      }
-      m_command = m_args.at(0).toLower();
-      m_author = author;
-      m_authorId = authorId;
-      m_authorization = auth;
+      tokenize();
     }
 
-    Request(const QString &line) :
-      Request(line, QString(), 0, Authorization::AUTH_ADMIN)
+    Request(const QString &line, ChatRoom *room = nullptr) :
+      Request(line, QString(), 0, Authorization::AUTH_ADMIN, room)
     {}
 
     Request() : Request(QString()){}
@@ -63,23 +72,45 @@ public:
 
     bool equals(const char *command) const
     {
-      return m_command.compare(command, Qt::CaseInsensitive) == 0;
+      return PerfectHash::equals(argView(0), command);
     }
 
     const QString &line() const { return m_line; }
-    const QStringList &args() const { return m_args; }
     const QString &author() const { return m_author; }
-    const QString &command() const { return m_command; }
+    QStringView commandView() const { return argView(0); }
+    QString command() const { return argView(0).toString().toLower(); }
     qint64 authorId() const { return m_authorId; }
     Authorization authorization() const { return m_authorization; }
 
+    // The room the request was made in, replies and room settings go here
+    ChatRoom *room() const { return m_room; }
+
+    // Arguments are slices of line(), only copied out when a handler asks for them
+    int argCount() const { return m_args.size(); }
+    QStringView argView(int i) const
+    {
+      const Span &s = m_args.at(i);
+      return QStringView(m_line).mid(s.start, s.length);
+    }
+    QString arg(int i) const { return argView(i).toString(); }
+    QString joinArgs(int from) const;
+
   private:
+    struct Span
+    {
+      int start;
+      int length;
+    };
+
+    void tokenize();
+    void appendArg(int start, int length);
+
     QString m_line;
-    QStringList m_args;
-    QString m_command;
+    QVarLengthArray<Span, 16> m_args;
     QString m_author;
     qint64 m_authorId;
     Authorization m_authorization;
+    ChatRoom *m_room;
 
   };
 
@@ -129,38 +160,126 @@ public:
 
   explicit ChatServer(QObject *parent = nullptr);
 
+  virtual ~ChatServer() override;
+
+  /**
+   * @brief Set channel for sending overlay messages, falls back to requestOverlayMessage() without one
+   */
+  void setOverlayChannel(OverlayChannel *channel) { m_overlayChannel = channel; }
+
+  /**
+   * @brief Accept on a listening socket handed over by a previous process instead of binding
+   */
+  void setInheritedListener(int fd) { m_inheritedListener = fd; }
+
+  /**
+   * @brief The chat port's listening socket once started, safe to call from any thread
+   */
+  int listeningDescriptor() const { return m_listeningDescriptor.loadAcquire(); }
+
+  static QString generateStatusPacket(Status status);
+  static QString generateServerMessagePacket(const QString &text);
+  static QString generateDeletePacket(const QVector<qint64> &msgIds);
+  static QString generateAcceptedPacket(const QString &msg);
+  static QString generateUserConfigPacket(const QString &name, const QString &color);
+  static QString generateChatMessageForClient(qint64 msgId, qint64 time, qint64 replyId, const QString &author, qint64 authorId, const QString &authorColor, const QString &msg, Authorization auth, const QString &donateValue);
+  static QString generateJoinPacket(const QString &name);
+  static QString generatePartPacket(const QString &name);
+  static QString generateAuthLevelPacket(Authorization auth);
+  static QString generateReconnectPacket(int delay);
+
+  /**
+   * @brief One page of chat history, messages being the chat packets as they were broadcast
+   */
+  static QString generateHistoryPacket(const QVector<ChatRoom::CachedPacket> &messages, bool more);
+
+  /**
+   * @brief Returns true if msg contains none of the banned words, ignoring case
+   */
+  static bool isMessageAcceptable(const QString &msg, const QStringList &bannedWords);
+
 public slots:
   void start();
 
   void stop();
 
+  /**
+   * @brief Picks up a new CONFIG.live() snapshot in settings this server caches
+   */
+  void applyLiveConfig();
+
+  /**
+   * @brief Stops accepting and closes every client over windowMs, asking each to reconnect
+   *
+   * Clients are closed in a random order a batch at a time so they arrive at the replacement
+   * process spread across the window. Emits drained() once all of them have been closed.
+   */
+  void drain(int windowMs);
+
+  /**
+   * @brief Moves this node onto the replacement process's event bus for the rest of its drain
+   *
+   * Without this the two processes would serve chat side by side without seeing each other's
+   * messages. Does nothing if both are already on the same bus.
+   */
+  void joinDrainBus(const QString &address, const QString &secret);
+
 signals:
   void requestOverlayMessage(const OverlayMessage &msg);
 
+  void drained();
+
 protected:
   void reply(const Response &reply);
 
   typedef Response(ChatServer::*CommandHandler_t)(const Request &r);
 
-  void insertCommand(const QString &command, CommandHandler_t handler, Authorization minimumAuth)
-  {
-    m_commandMap.insert(command, {handler, minimumAuth});
-  }
+  void insertSimpleResponse(ChatRoom *room, const QString &command, const QString &response);
+
+  void publish(ChatRoom *room, const QString &author, qint64 id, qint64 replyId, QString msg, const QString &color, const QHostAddress &ip, Authorization auth, const QString &donateValue = QString());
 
-  void insertSimpleResponse(const QString &command, const QString &response);
+  /**
+   * @brief Tags for the rules in m_mentions, checked in the order they're added
+   */
+  enum MentionRule
+  {
+    MENTION_GREETING
+  };
 
-  void publish(const QString &author, qint64 id, qint64 replyId, QString msg, const QString &color, const QHostAddress &ip, Authorization auth, const QString &donateValue = QString());
+  void loadMentionRules();
 
   Response doMention(const Request &r);
 
+  void sendOverlayMessage(const OverlayMessage &msg);
+
 private:
-  struct CommandHandler
+  /**
+   * @brief Sends to this node's overlays only, sendOverlayMessage() also tells the other nodes
+   */
+  void deliverOverlayMessage(const OverlayMessage &msg);
+
+  struct BuiltinCommand
   {
+    const char *name;
     CommandHandler_t handler;
     Authorization authorization;
   };
 
-  void initCommands();
+  static const BuiltinCommand BUILTIN_COMMANDS[];
+  static const PerfectHash::Table<256> BUILTIN_COMMAND_TABLE;
+
+  /**
+   * @brief Result of looking up a command, either a built-in handler or a user-defined response
+   */
+  struct CommandMatch
+  {
+    bool found = false;
+    CommandHandler_t handler = nullptr;
+    Authorization authorization = Authorization::AUTH_USER;
+    QString response;
+  };
+
+  CommandMatch findCommand(const ChatRoom *room, QStringView command) const;
 
   Response commandAddCom(const Request &r);
   Response commandAlert(const Request &r);
@@ -174,7 +293,6 @@ private:
   Response commandSkipTTS(const Request &r);
   Response commandTime(const Request &r);
   Response commandTimer(const Request &r);
-  Response commandSimpleResponse(const Request &r);
   Response commandAutoTTS(const Request &r);
   Response commandNextTTS(const Request &r);
   Response commandBan(const Request &r);
@@ -187,12 +305,13 @@ private:
   Response commandVideo(const Request &r);
   Response commandInfo(const Request &r);
   Response commandFollowMode(const Request &r);
+  Response commandAdmission(const Request &r);
+  Response commandDbStats(const Request &r);
+  Response commandReloadConfig(const Request &r);
 
   Status getUserStateFromID(qint64 id);
   static QString getStatusString(Status s);
 
-  static QJsonDocument generateClientPacket(const QString &type, const QJsonObject &data);
-
   void processAuthenticatedMessage(QPointer<QWebSocket> client, const QString &type, const QJsonValue &data, qint64 authorId);
   void handleAuthFailure(QWebSocket *client);
 
@@ -218,7 +337,10 @@ private:
 
   bool getUserInfoFromUserId(qint64 id, UserInfo *out);
 
-  void dropMessages(const QVector<qint64> &msgIds, bool updateDb);
+  /**
+   * @brief Drops messages posted in room, or in any room if room is nullptr
+   */
+  void dropMessages(ChatRoom *room, const QVector<qint64> &msgIds, bool updateDb);
 
   Response ban(const Request &r, bool andIP);
 
@@ -231,53 +353,126 @@ private:
 
   static QString stripAtSymbols(QString name);
 
-  static QJsonDocument generateChatMessageForClient(qint64 msgId, qint64 time, qint64 replyId, const QString &author, qint64 authorId, const QString &authorColor, QString msg, Authorization auth, const QString &donateValue);
+  /**
+   * @brief Reads the "rooms" list from the config, the first room being the default
+   */
+  void loadRooms();
 
-  void insertSocket(qint64 author, QWebSocket *skt);
-  void removeSocket(QWebSocket *skt);
+  ChatRoom *findRoom(const QString &name) const { return m_rooms.value(name); }
 
-  QJsonDocument generateJoinPacket(const QString &name);
-  QJsonDocument generatePartPacket(const QString &name);
-  QJsonDocument generateAuthLevelPacket(Authorization auth);
+  /**
+   * @brief The room skt is in, moving it into the default room if it hasn't joined one
+   */
+  ChatRoom *roomForSocket(QWebSocket *skt);
+
+  void insertSocket(ChatRoom *room, qint64 author, QWebSocket *skt);
+  void removeSocket(QWebSocket *skt);
+  void updateAuthorMetrics();
+
+  /**
+   * @brief An author's sockets in every room
+   */
+  QList<QWebSocket*> socketsForAuthor(qint64 author) const;
+
+  void broadcastToAllRooms(const QString &packet);
+
+  /**
+   * @brief Sends a join or part for an author to this node's sockets in room
+   */
+  void broadcastPresence(ChatRoom *room, qint64 author, bool joined);
+
+  // Clustering, see chatcluster.cpp
+  void startCluster();
+  static QString clusterNodeId();
+  bool connectBus(const QString &address, const QString &node, const QString &secret);
+  void publishEvent(EventBus::EventType type, const QJsonObject &data);
+  void publishPresenceSync(bool wantReply);
+  void publishSettings(ChatRoom *room);
+  void publishTimer(ChatRoom *room, const QString &name, qint64 started);
+  void publishResponse(ChatRoom *room, const QString &command, const QString &response);
+  void setRemotePresence(ChatRoom *room, const QString &node, const QSet<qint64> &authors);
 
   AuthModule *getAuthModuleById(const QString &id) const;
 
-  QMap<QString, CommandHandler> m_commandMap;
-  QMap<QString, QString> m_simpleResponses;
-  QMap<QString, qint64> m_timers;
+  void loadRateLimits();
+
+  /**
+   * @brief Rebuilds the serialized history sent to clients joining room from the database
+   */
+  void loadHistory(ChatRoom *room);
+
+  /**
+   * @brief Reads up to limit messages older than before in room from the database, oldest first
+   */
+  bool queryHistory(ChatRoom *room, qint64 before, int limit, QVector<ChatRoom::CachedPacket> *out, int *rows);
+
+  static const int HISTORY_PAGE_MAX = 100;
+
+  /**
+   * @brief Drops the cached history of every room, for changes to users that appear in all of them
+   */
+  void invalidateHistory();
 
   QWebSocketServer *m_server;
+  AdmissionServer *m_listener;
 
-  quint64 m_slowMode;
-  quint64 m_duplicateSlowMode;
   quint64 m_displayNameChangeTime;
-  quint64 m_followMode;
 
   QSqlDatabase m_db;
 
-  UserSocketMap m_clients;
+  QMap<QString, ChatRoom*> m_rooms;
+  ChatRoom *m_defaultRoom;
+
+  ConnectionTable m_connections;
+  HeartbeatMonitor *m_heartbeat;
+  QElapsedTimer m_clock;
+  MentionMatcher m_mentions;
+  TrafficCapture m_capture;
+  RateLimit m_rateLimits[PACKET_TYPE_COUNT];
 
   QNetworkAccessManager *m_netMan;
 
+  OverlayChannel *m_overlayChannel;
+
   QVector<AuthModule*> m_authModules;
 
+  EventBus *m_bus;
+  QString m_busAddress;
+  bool m_joinedDrainBus;
+
+  int m_inheritedListener;
+  QAtomicInt m_listeningDescriptor;
+
+  static const int DRAIN_TICK = 50;
+  static const int RECONNECT_JITTER = 2000;
+
+  QVector<QPointer<QWebSocket> > m_drainQueue;
+  int m_drainPerTick;
+  QTimer *m_drainTimer;
+
 private slots:
   void handleNewConnection();
 
   void clientDisconnected();
 
   void processClientMessage(const QString &s);
-  void processChatMessage(QWebSocket *client, qint64 authorId, const QJsonValue &data);
+  void processChatMessage(ChatRoom *room, QWebSocket *client, qint64 authorId, const QJsonValue &data);
   void processGetUserConfig(QWebSocket *client, qint64 id);
   void processSetUserConfig(QWebSocket *client, qint64 id, const QJsonValue &data);
-  void processPayPal(const QHostAddress &address, qint64 id, const QJsonValue &data);
+  void processPayPal(ChatRoom *room, const QHostAddress &address, qint64 id, const QJsonValue &data);
   void processHello(QWebSocket *client, const QJsonValue &data);
+  void processHistory(QWebSocket *client, const QJsonValue &data);
 
   void handleSslError(const QList<QSslError> &errs);
   void handlePeerVerifyError(const QSslError &err);
 
   void checkApiError(QNetworkReply *r);
 
+  void drainTick();
+
+  void busConnected();
+  void handleBusEvent(int type, const QString &origin, const QJsonObject &data);
+
 };
 
 #endif // CHATSERVER_H
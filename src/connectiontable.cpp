@@ -0,0 +1,20 @@
+#include "connectiontable.h"
+
+ConnectionState *ConnectionTable::insert(QWebSocket *skt, const QHostAddress &address, qint64 now)
+{
+  ConnectionState *&state = m_states[skt];
+  if (!state) {
+    state = new ConnectionState();
+  }
+
+  state->connectedAt = now;
+  state->address = address;
+  state->room = nullptr;
+
+  return state;
+}
+
+void ConnectionTable::remove(QWebSocket *skt)
+{
+  delete m_states.take(skt);
+}
@@ -0,0 +1,62 @@
+#ifndef CONNECTIONTABLE_H
+#define CONNECTIONTABLE_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QWebSocket>
+
+#include "packettype.h"
+#include "tokenbucket.h"
+
+class ChatRoom;
+
+/**
+ * @brief Session state kept for every open client connection
+ */
+struct ConnectionState
+{
+  // Monotonic time (ms) the connection was accepted
+  qint64 connectedAt;
+
+  // Cached since QWebSocket::peerAddress() returns a copy on every call
+  QHostAddress address;
+
+  // One rate limiter per packet type, plus one for all packets
+  TokenBucket limiters[PACKET_TYPE_COUNT];
+
+  // Set by hello, or to the default room by the first authenticated packet
+  ChatRoom *room;
+};
+
+/**
+ * @brief Owns the ConnectionState of every connected socket
+ */
+class ConnectionTable
+{
+public:
+  ConnectionTable() = default;
+
+  ~ConnectionTable()
+  {
+    qDeleteAll(m_states);
+  }
+
+  ConnectionTable(const ConnectionTable &) = delete;
+  ConnectionTable &operator=(const ConnectionTable &) = delete;
+
+  ConnectionState *insert(QWebSocket *skt, const QHostAddress &address, qint64 now);
+
+  void remove(QWebSocket *skt);
+
+  ConnectionState *find(QWebSocket *skt) const { return m_states.value(skt); }
+
+  int size() const { return m_states.size(); }
+
+  QList<QWebSocket*> sockets() const { return m_states.keys(); }
+
+private:
+  QHash<QWebSocket*, ConnectionState*> m_states;
+
+};
+
+#endif // CONNECTIONTABLE_H
@@ -0,0 +1,190 @@
+#include "eventbroker.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "eventbus.h"
+
+EventBroker::EventBroker(const QString &secret, QObject *parent) :
+  QObject(parent),
+  m_secret(secret),
+  m_localServer(nullptr),
+  m_tcpServer(nullptr)
+{
+}
+
+bool EventBroker::listen(const QString &address)
+{
+  QString path, host;
+  quint16 port;
+  if (!EventBus::parseAddress(address, &path, &host, &port)) {
+    qCritical() << "Invalid broker address" << address;
+    return false;
+  }
+
+  if (!path.isEmpty()) {
+    // A stale socket left behind by a crashed broker would otherwise block the bind
+    QLocalServer::removeServer(path);
+
+    m_localServer = new QLocalServer(this);
+    m_localServer->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_localServer, &QLocalServer::newConnection, this, &EventBroker::handleNewLocalConnection);
+    if (!m_localServer->listen(path)) {
+      qCritical() << "Failed to listen on" << path << m_localServer->errorString();
+      return false;
+    }
+  } else {
+    m_tcpServer = new QTcpServer(this);
+    connect(m_tcpServer, &QTcpServer::newConnection, this, &EventBroker::handleNewTcpConnection);
+    if (!m_tcpServer->listen(QHostAddress(host), port)) {
+      qCritical() << "Failed to listen on" << host << port << m_tcpServer->errorString();
+      return false;
+    }
+  }
+
+  qDebug() << "Broker listening on" << address;
+  return true;
+}
+
+void EventBroker::handleNewLocalConnection()
+{
+  while (QLocalSocket *skt = m_localServer->nextPendingConnection()) {
+    connect(skt, &QLocalSocket::disconnected, this, &EventBroker::nodeDisconnected);
+    addConnection(skt);
+  }
+}
+
+void EventBroker::handleNewTcpConnection()
+{
+  while (QTcpSocket *skt = m_tcpServer->nextPendingConnection()) {
+    skt->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(skt, &QTcpSocket::disconnected, this, &EventBroker::nodeDisconnected);
+    addConnection(skt);
+  }
+}
+
+void EventBroker::addConnection(QIODevice *skt)
+{
+  m_nodes.insert(skt, Node());
+  connect(skt, &QIODevice::readyRead, this, &EventBroker::readNode);
+}
+
+void EventBroker::readNode()
+{
+  QIODevice *skt = static_cast<QIODevice*>(sender());
+
+  auto it = m_nodes.find(skt);
+  if (it == m_nodes.end()) {
+    return;
+  }
+
+  Node &node = it.value();
+  node.buffer.append(skt->readAll());
+
+  QByteArray payload;
+  bool error;
+  while (EventBus::takeFrame(&node.buffer, &payload, &error)) {
+    if (!node.authenticated) {
+      handleHello(skt, node, payload);
+      if (!node.authenticated) {
+        return;
+      }
+      continue;
+    }
+
+    QByteArray frame = EventBus::encodeFrame(payload);
+    for (auto jt = m_nodes.constBegin(); jt != m_nodes.constEnd(); jt++) {
+      if (jt.key() != skt && jt.value().authenticated) {
+        jt.key()->write(frame);
+      }
+    }
+  }
+
+  if (error) {
+    qWarning() << "Oversized frame from node" << node.id << "- disconnecting";
+    abort(skt);
+  }
+}
+
+void EventBroker::handleHello(QIODevice *skt, Node &node, const QByteArray &payload)
+{
+  QJsonObject hello = QJsonDocument::fromJson(payload).object();
+  QString id = hello.value(QStringLiteral("n")).toString();
+
+  if (id.isEmpty() || (!m_secret.isEmpty() && hello.value(QStringLiteral("secret")).toString() != m_secret)) {
+    qWarning() << "Rejected node with a missing name or wrong secret";
+    abort(skt);
+    return;
+  }
+
+  // A node that restarted can reconnect before its old connection is noticed as dead
+  for (auto it = m_nodes.begin(); it != m_nodes.end(); it++) {
+    if (it.key() != skt && it.value().authenticated && it.value().id == id) {
+      qWarning() << "Node" << id << "reconnected, dropping its old connection";
+      it.value().authenticated = false;
+      abort(it.key());
+    }
+  }
+
+  node.id = id;
+  node.authenticated = true;
+  qDebug() << "Node" << id << "joined";
+
+  sendNodes();
+}
+
+void EventBroker::nodeDisconnected()
+{
+  QIODevice *skt = static_cast<QIODevice*>(sender());
+
+  Node node = m_nodes.take(skt);
+  skt->deleteLater();
+
+  if (node.authenticated) {
+    qDebug() << "Node" << node.id << "left";
+    sendNodes();
+  }
+}
+
+void EventBroker::sendNodes()
+{
+  QJsonArray ids;
+  for (const Node &node : qAsConst(m_nodes)) {
+    if (node.authenticated) {
+      ids.append(node.id);
+    }
+  }
+
+  QJsonObject data;
+  data.insert(QStringLiteral("nodes"), ids);
+
+  QJsonObject o;
+  o.insert(QStringLiteral("t"), int(EventBus::EVENT_NODES));
+  o.insert(QStringLiteral("n"), QString());
+  o.insert(QStringLiteral("d"), data);
+
+  QByteArray frame = EventBus::encodeFrame(QJsonDocument(o).toJson(QJsonDocument::Compact));
+  for (auto it = m_nodes.constBegin(); it != m_nodes.constEnd(); it++) {
+    if (it.value().authenticated) {
+      it.key()->write(frame);
+    }
+  }
+}
+
+void EventBroker::abort(QIODevice *skt)
+{
+  // Aborting emits disconnected() right away, which would remove the node while it's still in use
+  disconnect(skt, &QIODevice::readyRead, this, &EventBroker::readNode);
+  QTimer::singleShot(0, skt, [skt](){
+    if (QLocalSocket *local = qobject_cast<QLocalSocket*>(skt)) {
+      local->abort();
+    } else if (QTcpSocket *tcp = qobject_cast<QTcpSocket*>(skt)) {
+      tcp->abort();
+    }
+  });
+}
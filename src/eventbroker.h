@@ -0,0 +1,54 @@
+#ifndef EVENTBROKER_H
+#define EVENTBROKER_H
+
+#include <QHash>
+#include <QLocalServer>
+#include <QTcpServer>
+
+/**
+ * @brief Relays event bus frames between kcchat nodes, see BrokerBus for the node side
+ *
+ * Frames are forwarded as-is to every other authenticated node, the broker itself only reads
+ * the hello frame. Whenever a node joins or leaves, every node is sent EVENT_NODES with the
+ * list of nodes still connected so they can forget state belonging to the ones that are gone.
+ */
+class EventBroker : public QObject
+{
+  Q_OBJECT
+public:
+  explicit EventBroker(const QString &secret, QObject *parent = nullptr);
+
+  /**
+   * @brief Listens on a "unix:<path>" or "tcp:<host>:<port>" address
+   */
+  bool listen(const QString &address);
+
+private:
+  struct Node
+  {
+    QString id;
+    bool authenticated = false;
+    QByteArray buffer;
+  };
+
+  void addConnection(QIODevice *skt);
+  void handleHello(QIODevice *skt, Node &node, const QByteArray &payload);
+  void sendNodes();
+  void abort(QIODevice *skt);
+
+  QString m_secret;
+
+  QLocalServer *m_localServer;
+  QTcpServer *m_tcpServer;
+
+  QHash<QIODevice*, Node> m_nodes;
+
+private slots:
+  void handleNewLocalConnection();
+  void handleNewTcpConnection();
+  void readNode();
+  void nodeDisconnected();
+
+};
+
+#endif // EVENTBROKER_H
@@ -0,0 +1,89 @@
+#include "eventbus.h"
+
+#include <QtEndian>
+
+#include "brokerbus.h"
+
+EventBus::EventBus(const QString &nodeId, QObject *parent) :
+  QObject(parent),
+  m_nodeId(nodeId)
+{
+}
+
+EventBus *EventBus::create(const QString &address, const QString &nodeId, const QString &secret, QObject *parent)
+{
+  QString path, host;
+  quint16 port;
+  if (!parseAddress(address, &path, &host, &port)) {
+    return nullptr;
+  }
+
+  BrokerBus *bus = new BrokerBus(nodeId, secret, parent);
+  if (!path.isEmpty()) {
+    bus->connectToUnixSocket(path);
+  } else {
+    bus->connectToHost(host, port);
+  }
+  return bus;
+}
+
+bool EventBus::parseAddress(const QString &address, QString *path, QString *host, quint16 *port)
+{
+  path->clear();
+  host->clear();
+  *port = 0;
+
+  if (address.startsWith(QStringLiteral("unix:"))) {
+    *path = address.mid(5);
+    return !path->isEmpty();
+  }
+
+  if (address.startsWith(QStringLiteral("tcp:"))) {
+    int colon = address.lastIndexOf(':');
+    if (colon <= 4) {
+      return false;
+    }
+
+    bool ok;
+    *host = address.mid(4, colon - 4);
+    *port = address.mid(colon + 1).toUShort(&ok);
+    return ok && *port != 0 && !host->isEmpty();
+  }
+
+  return false;
+}
+
+QByteArray EventBus::encodeFrame(const QByteArray &payload)
+{
+  QByteArray frame;
+  frame.reserve(4 + payload.size());
+
+  uchar length[4];
+  qToBigEndian<quint32>(quint32(payload.size()), length);
+  frame.append(reinterpret_cast<const char*>(length), 4);
+  frame.append(payload);
+  return frame;
+}
+
+bool EventBus::takeFrame(QByteArray *buffer, QByteArray *payload, bool *error)
+{
+  *error = false;
+
+  if (buffer->size() < 4) {
+    return false;
+  }
+
+  quint32 length = qFromBigEndian<quint32>(buffer->constData());
+  if (length > quint32(MAX_FRAME_SIZE)) {
+    *error = true;
+    return false;
+  }
+
+  if (quint32(buffer->size()) - 4 < length) {
+    return false;
+  }
+
+  *payload = buffer->mid(4, int(length));
+  buffer->remove(0, 4 + int(length));
+  return true;
+}
@@ -0,0 +1,105 @@
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <QJsonObject>
+#include <QObject>
+
+/**
+ * @brief Carries chat state changes between kcchat nodes sharing one database
+ *
+ * Every node keeps fanning out to its own sockets only. The bus tells the other nodes what this
+ * one published, deleted or changed so they can do the same for theirs. Implementations are
+ * picked by address in create(), the default being a broker reached over a UNIX or TCP socket.
+ */
+class EventBus : public QObject
+{
+  Q_OBJECT
+public:
+  enum EventType
+  {
+    // A chat packet to broadcast and add to history
+    EVENT_PUBLISH,
+
+    // Message IDs that were dropped
+    EVENT_DELETE,
+
+    // Packets to broadcast as-is, optionally invalidating history
+    EVENT_BROADCAST,
+
+    // A user was banned or unbanned
+    EVENT_USER,
+
+    // An author joined or left the sending node
+    EVENT_PRESENCE,
+
+    // Every author on the sending node, sent on connect and in reply to one
+    EVENT_PRESENCE_SYNC,
+
+    // From the broker, the nodes currently connected
+    EVENT_NODES,
+
+    // Slow, duplicate and follow mode
+    EVENT_SETTINGS,
+
+    // A !timer was started or stopped
+    EVENT_TIMER,
+
+    // A simple response was added, edited or removed
+    EVENT_RESPONSE,
+
+    // An overlay message for every node's overlays
+    EVENT_OVERLAY,
+
+    // An admin ran !reloadconfig, every node reloads its own config.json
+    EVENT_RELOAD,
+
+    EVENT_COUNT
+  };
+
+  EventBus(const QString &nodeId, QObject *parent = nullptr);
+
+  const QString &nodeId() const { return m_nodeId; }
+
+  virtual bool isConnected() const = 0;
+
+  virtual void publish(EventType type, const QJsonObject &data) = 0;
+
+  /**
+   * @brief Creates the bus for an address like "unix:/run/kcchat-bus.sock" or "tcp:10.0.0.2:2003",
+   * returns nullptr if the address isn't understood
+   */
+  static EventBus *create(const QString &address, const QString &nodeId, const QString &secret, QObject *parent);
+
+  /**
+   * @brief Splits a "unix:<path>" or "tcp:<host>:<port>" address, shared with the broker
+   */
+  static bool parseAddress(const QString &address, QString *path, QString *host, quint16 *port);
+
+  static const int MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+  /**
+   * @brief Prefixes a payload with its 4 byte big-endian length
+   */
+  static QByteArray encodeFrame(const QByteArray &payload);
+
+  /**
+   * @brief Removes the first complete frame from buffer, returns false if there isn't one yet
+   *
+   * Sets error instead if the frame is larger than MAX_FRAME_SIZE.
+   */
+  static bool takeFrame(QByteArray *buffer, QByteArray *payload, bool *error);
+
+signals:
+  /**
+   * @brief Emitted every time the bus (re)connects, anything published while it was down is lost
+   */
+  void connected();
+
+  void received(int type, const QString &origin, const QJsonObject &data);
+
+private:
+  QString m_nodeId;
+
+};
+
+#endif // EVENTBUS_H
@@ -0,0 +1,103 @@
+#include "heartbeatmonitor.h"
+
+#include "metrics.h"
+#include "startupconfig.h"
+
+HeartbeatMonitor::HeartbeatMonitor(QObject *parent) :
+  QObject(parent),
+  m_pingInterval(30000),
+  m_pongTimeout(10000),
+  m_wheel(SLOTS, TICK_MS)
+{
+  m_clock.start();
+  m_wheel.reset(0);
+
+  m_timer = new QTimer(this);
+  m_timer->setInterval(TICK_MS);
+  connect(m_timer, &QTimer::timeout, this, &HeartbeatMonitor::tick);
+}
+
+void HeartbeatMonitor::loadConfig()
+{
+  QVariant pingInterval = CONFIG[QStringLiteral("ping_interval")];
+  if (pingInterval.isValid()) {
+    m_pingInterval = pingInterval.toLongLong();
+  }
+
+  QVariant pongTimeout = CONFIG[QStringLiteral("pong_timeout")];
+  if (pongTimeout.isValid()) {
+    m_pongTimeout = pongTimeout.toLongLong();
+  }
+
+  if (m_pingInterval > 0) {
+    m_timer->start();
+  } else {
+    m_timer->stop();
+  }
+}
+
+void HeartbeatMonitor::add(QWebSocket *skt)
+{
+  if (m_pingInterval <= 0) {
+    return;
+  }
+
+  qint64 now = m_clock.elapsed();
+  m_peers.insert(skt, {now, -1});
+  m_wheel.schedule(skt, now + m_pingInterval);
+
+  connect(skt, &QWebSocket::pong, this, &HeartbeatMonitor::handlePong);
+}
+
+void HeartbeatMonitor::remove(QWebSocket *skt)
+{
+  if (m_peers.remove(skt)) {
+    m_wheel.cancel(skt);
+    disconnect(skt, &QWebSocket::pong, this, &HeartbeatMonitor::handlePong);
+  }
+}
+
+void HeartbeatMonitor::handlePong()
+{
+  touch(static_cast<QWebSocket*>(sender()));
+}
+
+void HeartbeatMonitor::tick()
+{
+  m_wheel.advance(m_clock.elapsed(), [this](QWebSocket *skt){
+    expired(skt);
+  });
+}
+
+void HeartbeatMonitor::expired(QWebSocket *skt)
+{
+  auto it = m_peers.find(skt);
+  if (it == m_peers.end()) {
+    return;
+  }
+
+  qint64 now = m_clock.elapsed();
+
+  if (it->pingSent >= 0 && it->lastSeen < it->pingSent) {
+    if (now - it->pingSent < m_pongTimeout) {
+      m_wheel.schedule(skt, it->pingSent + m_pongTimeout);
+      return;
+    }
+
+    // Nothing back since the ping, the other end is most likely gone. Aborting goes through the
+    // owner's normal disconnect handling, which removes the socket from here.
+    METRICS.heartbeatTimeouts.add();
+    m_peers.erase(it);
+    skt->abort();
+    return;
+  }
+
+  if (now - it->lastSeen >= m_pingInterval) {
+    it->pingSent = now;
+    skt->ping();
+    m_wheel.schedule(skt, now + m_pongTimeout);
+  } else {
+    it->pingSent = -1;
+    m_wheel.schedule(skt, it->lastSeen + m_pingInterval);
+  }
+}
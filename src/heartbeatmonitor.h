@@ -0,0 +1,73 @@
+#ifndef HEARTBEATMONITOR_H
+#define HEARTBEATMONITOR_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QWebSocket>
+
+#include "timerwheel.h"
+
+/**
+ * @brief Pings quiet connections and aborts the ones that stop answering
+ *
+ * A connection that hasn't sent anything for ping_interval is sent a WebSocket ping, and aborted
+ * if neither a pong nor anything else arrives within pong_timeout. This catches half-open TCP
+ * connections that would otherwise keep receiving broadcasts and keep their user in the roster
+ * forever. All connections share one timing wheel driven by a single timer, and traffic only
+ * updates a timestamp, so the wheel is touched about once per connection per interval.
+ */
+class HeartbeatMonitor : public QObject
+{
+  Q_OBJECT
+public:
+  explicit HeartbeatMonitor(QObject *parent = nullptr);
+
+  /**
+   * @brief Reads ping_interval and pong_timeout, a ping_interval of 0 disables the monitor
+   */
+  void loadConfig();
+
+  void add(QWebSocket *skt);
+  void remove(QWebSocket *skt);
+
+  /**
+   * @brief Notes that something arrived from skt
+   */
+  void touch(QWebSocket *skt)
+  {
+    auto it = m_peers.find(skt);
+    if (it != m_peers.end()) {
+      it->lastSeen = m_clock.elapsed();
+    }
+  }
+
+private:
+  static const int TICK_MS = 500;
+  static const int SLOTS = 256;
+
+  struct Peer
+  {
+    qint64 lastSeen;
+
+    // When the outstanding ping was sent, -1 if there isn't one
+    qint64 pingSent;
+  };
+
+  void expired(QWebSocket *skt);
+
+  qint64 m_pingInterval;
+  qint64 m_pongTimeout;
+
+  QElapsedTimer m_clock;
+  QTimer *m_timer;
+  TimerWheel<QWebSocket*> m_wheel;
+  QHash<QWebSocket*, Peer> m_peers;
+
+private slots:
+  void tick();
+  void handlePong();
+
+};
+
+#endif // HEARTBEATMONITOR_H
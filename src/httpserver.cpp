@@ -0,0 +1,177 @@
+#include "httpserver.h"
+
+#include <QPointer>
+#include <QTimer>
+
+HttpServer::HttpServer(QObject *parent) :
+  QObject(parent),
+  m_responseDelay(0)
+{
+  m_server = new QTcpServer(this);
+  connect(m_server, &QTcpServer::newConnection, this, &HttpServer::handleNewConnection);
+}
+
+bool HttpServer::listen(const QHostAddress &address, quint16 port)
+{
+  return m_server->listen(address, port);
+}
+
+bool HttpServer::adoptListeningSocket(int fd)
+{
+  return m_server->setSocketDescriptor(fd);
+}
+
+int HttpServer::listeningDescriptor() const
+{
+  return m_server->isListening() ? int(m_server->socketDescriptor()) : -1;
+}
+
+void HttpServer::close()
+{
+  m_server->close();
+}
+
+void HttpServer::route(const QByteArray &method, const QByteArray &path, const Handler &handler)
+{
+  m_routes.insert(method + ' ' + path, handler);
+}
+
+void HttpServer::handleNewConnection()
+{
+  while (QTcpSocket *skt = m_server->nextPendingConnection()) {
+    connect(skt, &QTcpSocket::readyRead, this, &HttpServer::readClient);
+    connect(skt, &QTcpSocket::disconnected, this, &HttpServer::clientDisconnected);
+  }
+}
+
+void HttpServer::readClient()
+{
+  QTcpSocket *skt = static_cast<QTcpSocket*>(sender());
+  QByteArray &buf = m_buffers[skt];
+  buf.append(skt->readAll());
+
+  if (buf.size() > MAX_REQUEST_SIZE) {
+    // Stop reading, or the rest of the request would keep growing a new buffer
+    disconnect(skt, &QTcpSocket::readyRead, this, &HttpServer::readClient);
+    m_buffers.remove(skt);
+
+    Response tooLarge;
+    tooLarge.status = 413;
+    writeResponse(skt, tooLarge);
+    return;
+  }
+
+  int headerEnd = buf.indexOf("\r\n\r\n");
+  if (headerEnd == -1) {
+    // Wait for the rest of the headers
+    return;
+  }
+
+  Request r;
+
+  const QList<QByteArray> lines = buf.left(headerEnd).split('\n');
+  const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+  if (requestLine.size() < 2) {
+    disconnect(skt, &QTcpSocket::readyRead, this, &HttpServer::readClient);
+    m_buffers.remove(skt);
+
+    Response bad;
+    bad.status = 400;
+    writeResponse(skt, bad);
+    return;
+  }
+
+  r.method = requestLine.at(0);
+
+  QByteArray target = requestLine.at(1);
+  int queryStart = target.indexOf('?');
+  if (queryStart == -1) {
+    r.path = target;
+  } else {
+    r.path = target.left(queryStart);
+    r.query.setQuery(QString::fromUtf8(target.mid(queryStart + 1)));
+  }
+
+  for (int i = 1; i < lines.size(); i++) {
+    const QByteArray &l = lines.at(i);
+    int colon = l.indexOf(':');
+    if (colon != -1) {
+      r.headers.insert(l.left(colon).trimmed().toLower(), l.mid(colon + 1).trimmed());
+    }
+  }
+
+  int bodyLength = r.header(QByteArrayLiteral("Content-Length")).toInt();
+  int bodyStart = headerEnd + 4;
+  if (buf.size() - bodyStart < bodyLength) {
+    // Wait for the rest of the body
+    return;
+  }
+
+  r.body = buf.mid(bodyStart, bodyLength);
+  m_buffers.remove(skt);
+
+  // Only one request per connection is handled, so stop reading from this socket
+  disconnect(skt, &QTcpSocket::readyRead, this, &HttpServer::readClient);
+
+  if (m_responseDelay > 0) {
+    QPointer<QTcpSocket> guard(skt);
+    QTimer::singleShot(m_responseDelay, this, [this, guard, r]{
+      if (guard) {
+        handleRequest(guard, r);
+      }
+    });
+  } else {
+    handleRequest(skt, r);
+  }
+}
+
+void HttpServer::handleRequest(QTcpSocket *skt, const Request &r)
+{
+  auto it = m_routes.constFind(r.method + ' ' + r.path);
+  if (it == m_routes.cend()) {
+    Response notFound;
+    notFound.status = 404;
+    writeResponse(skt, notFound);
+  } else {
+    writeResponse(skt, (*it)(r));
+  }
+}
+
+void HttpServer::clientDisconnected()
+{
+  QTcpSocket *skt = static_cast<QTcpSocket*>(sender());
+  m_buffers.remove(skt);
+  skt->deleteLater();
+}
+
+void HttpServer::writeResponse(QTcpSocket *skt, const Response &r)
+{
+  QByteArray out;
+  out.reserve(128 + r.body.size());
+  out.append("HTTP/1.1 ");
+  out.append(QByteArray::number(r.status));
+  out.append(' ');
+  out.append(getStatusText(r.status));
+  out.append("\r\nContent-Type: ");
+  out.append(r.contentType);
+  out.append("\r\nContent-Length: ");
+  out.append(QByteArray::number(r.body.size()));
+  out.append("\r\nConnection: close\r\n\r\n");
+  out.append(r.body);
+
+  skt->write(out);
+  skt->disconnectFromHost();
+}
+
+QByteArray HttpServer::getStatusText(int status)
+{
+  switch (status) {
+  case 200: return QByteArrayLiteral("OK");
+  case 400: return QByteArrayLiteral("Bad Request");
+  case 401: return QByteArrayLiteral("Unauthorized");
+  case 404: return QByteArrayLiteral("Not Found");
+  case 413: return QByteArrayLiteral("Payload Too Large");
+  }
+
+  return QByteArrayLiteral("Unknown");
+}
@@ -0,0 +1,87 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <functional>
+#include <QHash>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+
+/**
+ * @brief Minimal HTTP/1.1 server for local-only endpoints
+ *
+ * Only supports one request per connection and requests with a Content-Length body. This is
+ * intended for tooling endpoints bound to localhost, not for serving the public internet.
+ */
+class HttpServer : public QObject
+{
+  Q_OBJECT
+public:
+  struct Request
+  {
+    QByteArray method;
+    QByteArray path;
+    QUrlQuery query;
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray body;
+
+    QByteArray header(const QByteArray &name) const { return headers.value(name.toLower()); }
+  };
+
+  struct Response
+  {
+    int status = 200;
+    QByteArray contentType = QByteArrayLiteral("application/json");
+    QByteArray body;
+  };
+
+  typedef std::function<Response(const Request &)> Handler;
+
+  explicit HttpServer(QObject *parent = nullptr);
+
+  bool listen(const QHostAddress &address, quint16 port);
+
+  /**
+   * @brief Accepts on a socket that is already listening, taking ownership of it on success
+   */
+  bool adoptListeningSocket(int fd);
+
+  /**
+   * @brief Returns the listening socket, or -1 if the server isn't listening
+   */
+  int listeningDescriptor() const;
+
+  void close();
+
+  void route(const QByteArray &method, const QByteArray &path, const Handler &handler);
+
+  void setResponseDelay(int ms) { m_responseDelay = ms; }
+
+private:
+  static const int MAX_REQUEST_SIZE = 65536;
+
+  void handleRequest(QTcpSocket *skt, const Request &r);
+
+  static void writeResponse(QTcpSocket *skt, const Response &r);
+
+  static QByteArray getStatusText(int status);
+
+  QTcpServer *m_server;
+
+  QHash<QByteArray, Handler> m_routes;
+
+  QHash<QTcpSocket*, QByteArray> m_buffers;
+
+  int m_responseDelay;
+
+private slots:
+  void handleNewConnection();
+
+  void readClient();
+
+  void clientDisconnected();
+
+};
+
+#endif // HTTPSERVER_H
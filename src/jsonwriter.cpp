@@ -0,0 +1,57 @@
+#include "jsonwriter.h"
+
+#include "textescape.h"
+
+JsonWriter &JsonWriter::threadLocal()
+{
+  static thread_local JsonWriter writer;
+  return writer;
+}
+
+void JsonWriter::value(QStringView s)
+{
+  separate();
+  m_buffer.append('"');
+  TextEscape::appendJson(&m_buffer, s, false);
+  m_buffer.append('"');
+  m_needComma = true;
+}
+
+void JsonWriter::htmlValue(QStringView s)
+{
+  separate();
+  m_buffer.append('"');
+  TextEscape::appendJson(&m_buffer, s, true);
+  m_buffer.append('"');
+  m_needComma = true;
+}
+
+void JsonWriter::value(qint64 v)
+{
+  separate();
+
+  // Format into a stack buffer rather than allocating a temporary string
+  QChar digits[20];
+  int pos = 20;
+  quint64 u = v < 0 ? quint64(0) - quint64(v) : quint64(v);
+  do {
+    digits[--pos] = QChar(ushort('0' + u % 10));
+    u /= 10;
+  } while (u);
+
+  if (v < 0) {
+    m_buffer.append('-');
+  }
+  m_buffer.append(digits + pos, 20 - pos);
+
+  m_needComma = true;
+}
+
+void JsonWriter::beginPacket(QStringView type)
+{
+  clear();
+  m_buffer.append(QLatin1String("{\"type\":\""));
+  m_buffer.append(type.data(), type.size());
+  m_buffer.append(QLatin1String("\",\"data\":{"));
+  m_needComma = false;
+}
@@ -0,0 +1,103 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QLatin1String>
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief Pre-escaped object key fragment, e.g. JSON_KEY("type") becomes "type":
+ */
+#define JSON_KEY(k) QLatin1String("\"" k "\":")
+
+/**
+ * @brief Writes compact JSON straight into a reusable buffer
+ *
+ * This skips building a QJsonObject tree only to serialize it once. The buffer is UTF-16 since
+ * QWebSocket::sendTextMessage() takes a QString anyway, so nothing is converted until the socket
+ * encodes the frame. Callers are responsible for emitting a well-formed structure.
+ */
+class JsonWriter
+{
+public:
+  JsonWriter() : m_needComma(false) {}
+
+  /**
+   * @brief Writer reused by every packet generated on the calling thread
+   *
+   * A packet must be finished with endPacket() before another one is started on the same thread.
+   */
+  static JsonWriter &threadLocal();
+
+  void clear()
+  {
+    // Keeps the allocation as long as nothing else still references the last result
+    m_buffer.truncate(0);
+    m_needComma = false;
+  }
+
+  void beginObject() { separate(); m_buffer.append('{'); m_needComma = false; }
+  void endObject() { m_buffer.append('}'); m_needComma = true; }
+
+  void beginArray() { separate(); m_buffer.append('['); m_needComma = false; }
+  void endArray() { m_buffer.append(']'); m_needComma = true; }
+
+  void key(QLatin1String fragment)
+  {
+    separate();
+    m_buffer.append(fragment);
+    m_needComma = false;
+  }
+
+  void value(QStringView s);
+  void value(const QString &s) { value(QStringView(s)); }
+
+  /**
+   * @brief Writes a string value with HTML special characters replaced by entities
+   */
+  void htmlValue(QStringView s);
+
+  void value(qint64 v);
+  void value(int v) { value(qint64(v)); }
+  void value(bool v) { separate(); m_buffer.append(v ? QLatin1String("true") : QLatin1String("false")); m_needComma = true; }
+
+  /**
+   * @brief Writes already serialized JSON as a value, such as a packet generated earlier
+   */
+  void rawValue(QStringView json)
+  {
+    separate();
+    m_buffer.append(json.data(), json.size());
+    m_needComma = true;
+  }
+
+  /**
+   * @brief Clears the buffer and opens a {"type":...,"data":{ packet as sent to clients
+   */
+  void beginPacket(QStringView type);
+
+  /**
+   * @brief Closes the packet opened by beginPacket() and returns the result
+   */
+  QString endPacket()
+  {
+    m_buffer.append(QLatin1String("}}"));
+    return m_buffer;
+  }
+
+  const QString &buffer() const { return m_buffer; }
+
+private:
+  void separate()
+  {
+    if (m_needComma) {
+      m_buffer.append(',');
+    }
+  }
+
+  QString m_buffer;
+  bool m_needComma;
+
+};
+
+#endif // JSONWRITER_H
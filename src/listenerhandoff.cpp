@@ -0,0 +1,251 @@
+#include "listenerhandoff.h"
+
+#include <cstring>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const char MAGIC[] = {'K', 'C', 'H', 'O'};
+
+const char TAG_CHAT = 'c';
+const char TAG_OVERLAY = 'o';
+const char TAG_METRICS = 'm';
+const char TAG_MOCK_OAUTH = 'a';
+
+// The request is one line of JSON, anything longer than this without a newline is garbage
+const int MAX_REQUEST_SIZE = 4096;
+
+}
+
+ListenerHandoff::ListenerHandoff(QObject *parent) :
+  QObject(parent),
+  m_server(nullptr)
+{
+}
+
+bool ListenerHandoff::receive(const QString &path, const QString &bus, const QString &secret, Listeners *out)
+{
+#ifdef Q_OS_UNIX
+  QByteArray encodedPath = path.toLocal8Bit();
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (size_t(encodedPath.size()) >= sizeof(addr.sun_path)) {
+    qCritical() << "Handoff socket path is too long:" << path;
+    return false;
+  }
+  memcpy(addr.sun_path, encodedPath.constData(), size_t(encodedPath.size()));
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    // Nothing to take over
+    close(fd);
+    return false;
+  }
+
+  timeval timeout = {RECEIVE_TIMEOUT / 1000, (RECEIVE_TIMEOUT % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  QJsonObject o;
+  o.insert(QStringLiteral("bus"), bus);
+  o.insert(QStringLiteral("secret"), secret);
+  QByteArray request = QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+  if (request.size() > MAX_REQUEST_SIZE
+      || send(fd, request.constData(), size_t(request.size()), MSG_NOSIGNAL) != ssize_t(request.size())) {
+    qCritical() << "Failed to send handoff request to" << path;
+    close(fd);
+    return false;
+  }
+
+  char tags[sizeof(MAGIC) + MAX_LISTENERS];
+  iovec iov = {tags, sizeof(tags)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+#ifdef MSG_CMSG_CLOEXEC
+  ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+  ssize_t n = recvmsg(fd, &msg, 0);
+#endif
+
+  int fds[MAX_LISTENERS] = {-1, -1, -1, -1};
+  int count = 0;
+  for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+      count = int((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      memcpy(fds, CMSG_DATA(c), sizeof(int) * size_t(qMin(count, int(MAX_LISTENERS))));
+    }
+  }
+
+  bool ok = n > ssize_t(sizeof(MAGIC)) && memcmp(tags, MAGIC, sizeof(MAGIC)) == 0
+      && count == int(n - ssize_t(sizeof(MAGIC)));
+
+  for (int i = 0; i < qMin(count, int(MAX_LISTENERS)); i++) {
+    if (!ok) {
+      close(fds[i]);
+      continue;
+    }
+
+    char tag = tags[sizeof(MAGIC) + i];
+    if (tag == TAG_CHAT) {
+      out->chat = fds[i];
+    } else if (tag == TAG_OVERLAY) {
+      out->overlay = fds[i];
+    } else if (tag == TAG_METRICS) {
+      out->metrics = fds[i];
+    } else if (tag == TAG_MOCK_OAUTH) {
+      out->mockOAuth = fds[i];
+    } else {
+      close(fds[i]);
+    }
+  }
+
+  if (ok) {
+    // The old process closes the connection once it has let go of the path, which is our cue to
+    // take it over
+    char c;
+    while (read(fd, &c, 1) > 0) {
+    }
+  } else {
+    qCritical() << "Failed to receive listening sockets from" << path;
+  }
+
+  close(fd);
+  return ok;
+#else
+  Q_UNUSED(path)
+  Q_UNUSED(bus)
+  Q_UNUSED(secret)
+  Q_UNUSED(out)
+  return false;
+#endif
+}
+
+bool ListenerHandoff::listen(const QString &path, std::function<Listeners()> get)
+{
+#ifdef Q_OS_UNIX
+  m_get = get;
+
+  // Anything left at the path belongs to a process that has either handed off or died
+  QLocalServer::removeServer(path);
+
+  m_server = new QLocalServer(this);
+  m_server->setSocketOptions(QLocalServer::UserAccessOption);
+  connect(m_server, &QLocalServer::newConnection, this, &ListenerHandoff::handleNewConnection);
+  if (!m_server->listen(path)) {
+    qCritical() << "Failed to listen for handoff on" << path << m_server->errorString();
+    return false;
+  }
+
+  return true;
+#else
+  Q_UNUSED(path)
+  Q_UNUSED(get)
+  qWarning() << "Listener handoff is not available on this platform";
+  return false;
+#endif
+}
+
+void ListenerHandoff::handleNewConnection()
+{
+#ifdef Q_OS_UNIX
+  QLocalSocket *skt = m_server->nextPendingConnection();
+  if (!skt) {
+    return;
+  }
+
+  connect(skt, &QLocalSocket::readyRead, this, &ListenerHandoff::readRequest);
+  connect(skt, &QLocalSocket::disconnected, skt, &QObject::deleteLater);
+#endif
+}
+
+void ListenerHandoff::readRequest()
+{
+#ifdef Q_OS_UNIX
+  QLocalSocket *skt = static_cast<QLocalSocket*>(sender());
+  if (!skt->canReadLine()) {
+    if (skt->bytesAvailable() > MAX_REQUEST_SIZE) {
+      skt->abort();
+    }
+    return;
+  }
+
+  // Only one request is handled per connection
+  disconnect(skt, &QLocalSocket::readyRead, this, &ListenerHandoff::readRequest);
+
+  QJsonObject request = QJsonDocument::fromJson(skt->readLine(MAX_REQUEST_SIZE)).object();
+
+  Listeners l = m_get();
+
+  char tags[sizeof(MAGIC) + MAX_LISTENERS];
+  memcpy(tags, MAGIC, sizeof(MAGIC));
+  int fds[MAX_LISTENERS];
+  int count = 0;
+  if (l.chat != -1) {
+    tags[sizeof(MAGIC) + count] = TAG_CHAT;
+    fds[count++] = l.chat;
+  }
+  if (l.overlay != -1) {
+    tags[sizeof(MAGIC) + count] = TAG_OVERLAY;
+    fds[count++] = l.overlay;
+  }
+  if (l.metrics != -1) {
+    tags[sizeof(MAGIC) + count] = TAG_METRICS;
+    fds[count++] = l.metrics;
+  }
+  if (l.mockOAuth != -1) {
+    tags[sizeof(MAGIC) + count] = TAG_MOCK_OAUTH;
+    fds[count++] = l.mockOAuth;
+  }
+
+  iovec iov = {tags, sizeof(MAGIC) + size_t(count)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (count > 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * size_t(count));
+
+    cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * size_t(count));
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * size_t(count));
+  }
+
+  if (sendmsg(int(skt->socketDescriptor()), &msg, MSG_NOSIGNAL) < 0) {
+    qCritical() << "Failed to hand listening sockets to the new process";
+    skt->abort();
+    return;
+  }
+
+  qDebug() << "Handed" << count << "listening sockets to the new process";
+
+  // Closing the server removes the path, so this has to happen before the new process binds it
+  m_server->close();
+  skt->disconnectFromServer();
+
+  emit handedOff(request.value(QStringLiteral("bus")).toString(), request.value(QStringLiteral("secret")).toString());
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef LISTENERHANDOFF_H
+#define LISTENERHANDOFF_H
+
+#include <functional>
+#include <QLocalServer>
+
+/**
+ * @brief Passes the listening sockets of a running server to its replacement
+ *
+ * The running server listens on a UNIX socket at handoff_socket. A new process started with the
+ * same config connects there before binding anything, and receives duplicates of the listening
+ * sockets over SCM_RIGHTS, so no connection attempt is refused while both are up. The old process
+ * then stops accepting and drains its clients, and the new one takes over handoff_socket for the
+ * next upgrade once the old one has let go of it.
+ *
+ * The new process also tells the old one which event bus it is on, so the two can keep passing
+ * chat between their clients until the old one has finished draining.
+ */
+class ListenerHandoff : public QObject
+{
+  Q_OBJECT
+public:
+  struct Listeners
+  {
+    int chat = -1;
+    int overlay = -1;
+    int metrics = -1;
+    int mockOAuth = -1;
+  };
+
+  explicit ListenerHandoff(QObject *parent = nullptr);
+
+  /**
+   * @brief Receives listening sockets from the process currently serving at path
+   *
+   * Returns false straight away if nothing is, which is the normal case on a first start. bus and
+   * secret are passed on to the old process, see handedOff().
+   */
+  static bool receive(const QString &path, const QString &bus, const QString &secret, Listeners *out);
+
+  /**
+   * @brief Waits at path for a replacement, handing it whatever get() returns when one arrives
+   */
+  bool listen(const QString &path, std::function<Listeners()> get);
+
+signals:
+  /**
+   * @brief Emitted once the sockets have been passed on, after which this process should drain
+   *
+   * bus and secret are what the new process joined its cluster with, either may be empty.
+   */
+  void handedOff(const QString &bus, const QString &secret);
+
+private:
+  static const int RECEIVE_TIMEOUT = 5000;
+  static const int MAX_LISTENERS = 4;
+
+  QLocalServer *m_server;
+  std::function<Listeners()> m_get;
+
+private slots:
+  void handleNewConnection();
+  void readRequest();
+
+};
+
+#endif // LISTENERHANDOFF_H
@@ -0,0 +1,99 @@
+#include "listensocket.h"
+
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+int openReusePortSocket(quint16 port)
+{
+  // Dual-stack like QHostAddress::Any, falling back to IPv4 on hosts without IPv6
+  int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  bool ipv6 = fd != -1;
+  if (!ipv6) {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+      return -1;
+    }
+  }
+
+  int on = 1;
+  int off = 0;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  int r;
+  if (ipv6) {
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    r = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  } else {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    r = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  }
+
+  if (r != 0 || listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+#endif
+
+}
+
+bool listenOnPort(QTcpServer *server, quint16 port, bool reusePort)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+  if (reusePort) {
+    int fd = openReusePortSocket(port);
+    if (fd == -1) {
+      return false;
+    }
+
+    if (!adoptListeningSocket(server, fd)) {
+      close(fd);
+      return false;
+    }
+    return true;
+  }
+#else
+  if (reusePort) {
+    qWarning() << "SO_REUSEPORT is not available on this platform, binding port" << port << "exclusively";
+  }
+#endif
+
+  return server->listen(QHostAddress::Any, port);
+}
+
+bool adoptListeningSocket(QTcpServer *server, int fd)
+{
+  return server->setSocketDescriptor(fd);
+}
+
+int getListeningSocket(const QTcpServer *server)
+{
+  if (!server->isListening()) {
+    return -1;
+  }
+
+  return int(server->socketDescriptor());
+}
@@ -0,0 +1,26 @@
+#ifndef LISTENSOCKET_H
+#define LISTENSOCKET_H
+
+#include <QTcpServer>
+
+/**
+ * @brief Binds a server to a port on every address
+ *
+ * With reusePort, the socket is opened with SO_REUSEPORT so several worker processes can bind the
+ * same port and have the kernel spread new connections between them. This is only available on
+ * platforms that have SO_REUSEPORT, elsewhere it falls back to a normal exclusive bind.
+ */
+bool listenOnPort(QTcpServer *server, quint16 port, bool reusePort);
+
+/**
+ * @brief Makes a server accept on a socket that is already listening, such as one
+ * inherited from the process being replaced, taking ownership of it on success
+ */
+bool adoptListeningSocket(QTcpServer *server, int fd);
+
+/**
+ * @brief Returns the server's listening socket, or -1 if it isn't listening
+ */
+int getListeningSocket(const QTcpServer *server);
+
+#endif // LISTENSOCKET_H
@@ -1,11 +1,26 @@
 #include <iostream>
 #include <QCoreApplication>
+#include <QDir>
+#include <QSocketNotifier>
 #include <QThread>
+#include <QTimer>
 #include <signal.h>
 
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "auth/mockoauthserver.h"
 #include "chatserver.h"
+#include "eventbroker.h"
+#include "httpserver.h"
+#include "listenerhandoff.h"
+#include "metrics.h"
+#include "overlaychannel.h"
 #include "overlaydispatch.h"
 #include "startupconfig.h"
+#include "tracer.h"
+#include "workersupervisor.h"
 
 /**
  * @brief Custom handler for QDebug that prints messages to stderr
@@ -59,13 +74,52 @@ void safeExit(int s)
   qApp->quit();
 }
 
+#ifdef Q_OS_UNIX
+/**
+ * @brief Pipe SIGHUP is forwarded through, since almost nothing is safe to call from the handler
+ */
+static int reloadPipe[2] = {-1, -1};
+
+void requestReload(int s)
+{
+  Q_UNUSED(s)
+
+  char c = 0;
+  ssize_t r = write(reloadPipe[1], &c, 1);
+  Q_UNUSED(r)
+}
+
+/**
+ * @brief Calls reload on the main thread whenever the process receives SIGHUP
+ */
+template <typename Func>
+void onSighup(QObject *context, Func reload)
+{
+  if (pipe(reloadPipe) != 0) {
+    qWarning() << "Failed to create pipe for SIGHUP, config can only be reloaded with !reloadconfig";
+    return;
+  }
+
+  QSocketNotifier *notifier = new QSocketNotifier(reloadPipe[0], QSocketNotifier::Read, context);
+  QObject::connect(notifier, &QSocketNotifier::activated, context, [reload](){
+    char c;
+    ssize_t r = read(reloadPipe[0], &c, 1);
+    Q_UNUSED(r)
+    reload();
+  });
+
+  signal(SIGHUP, requestReload);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
   // Install custom handler for QDebug
   qInstallMessageHandler(dbg);
 
-  // Handle Ctrl+C in a safe way
+  // Handle Ctrl+C in a safe way, and stop the same way when a supervisor or service manager asks
   signal(SIGINT, safeExit);
+  signal(SIGTERM, safeExit);
 
   // Load startup configuration
   if (!CONFIG.load()) {
@@ -73,22 +127,69 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  // Workers get their own ports and files, and share the chat port with each other
+  bool isWorker = WorkerSupervisor::configureWorker();
+
+  // Sized before any threads start, spans are only recorded when this is non-zero
+  TRACER.setCapacity(CONFIG[QStringLiteral("trace_spans")].toInt());
+
   // Create main application event loop
   QCoreApplication a(argc, argv);
 
+  // Optionally spread connections across several processes instead of serving them from this one
+  int workers = CONFIG[QStringLiteral("workers")].toInt();
+  if (workers > 1 && !isWorker) {
+    WorkerSupervisor supervisor(workers);
+    if (!supervisor.start()) {
+      return 1;
+    }
+#ifdef Q_OS_UNIX
+    onSighup(&a, [&supervisor](){
+      supervisor.reloadWorkers();
+    });
+#endif
+    return a.exec();
+  }
+
   // Create threads for chat server and overlay
   QThread chatThread, overlayThread;
 
   // Register overlay message (so it can be sent between QThreads)
   qRegisterMetaType<OverlayMessage>();
 
+  // Lock-free path for overlay messages between the two threads
+  OverlayChannel overlayChannel;
+
+  // Take over the listening sockets of the process being upgraded, if there is one
+  QString handoffPath = CONFIG[QStringLiteral("handoff_socket")].toString();
+
+  // Outside a cluster, the process being upgraded still needs a bus to reach this one while it
+  // drains, so this process runs one of its own for the old one to join
+  if (!handoffPath.isEmpty() && CONFIG[QStringLiteral("cluster_broker")].toString().isEmpty()) {
+    QString bus = QStringLiteral("unix:") + QDir::temp().filePath(QStringLiteral("kcchat-%1.sock").arg(QCoreApplication::applicationPid()));
+    EventBroker *broker = new EventBroker(CONFIG[QStringLiteral("cluster_secret")].toString(), &a);
+    if (broker->listen(bus)) {
+      CONFIG.set(QStringLiteral("cluster_broker"), bus);
+    }
+  }
+
+  ListenerHandoff::Listeners inherited;
+  if (!handoffPath.isEmpty() && ListenerHandoff::receive(handoffPath, CONFIG[QStringLiteral("cluster_broker")].toString(),
+                                                         CONFIG[QStringLiteral("cluster_secret")].toString(), &inherited)) {
+    qDebug() << "Took over listening sockets from the previous process";
+  }
+
   // Create chat server and move to its own thread
   ChatServer dispatch;
+  dispatch.setOverlayChannel(&overlayChannel);
+  dispatch.setInheritedListener(inherited.chat);
   chatThread.start();
   dispatch.moveToThread(&chatThread);
 
   // Create overlay handler and move to its own thread
   OverlayDispatch overlay;
+  overlay.setChannel(&overlayChannel);
+  overlay.setInheritedListener(inherited.overlay);
   overlayThread.start();
   overlay.moveToThread(&overlayThread);
 
@@ -96,7 +197,95 @@ int main(int argc, char *argv[])
   QMetaObject::invokeMethod(&dispatch, &ChatServer::start, Qt::QueuedConnection);
   QMetaObject::invokeMethod(&overlay, &OverlayDispatch::start, Qt::QueuedConnection);
 
-  // Connect signals between chat server and overlay
+  // Optionally stand in for Google's OAuth endpoints for offline load testing
+  MockOAuthServer *mockOAuth = nullptr;
+  if (quint16 mockOAuthPort = CONFIG[QStringLiteral("mock_oauth_port")].toUInt()) {
+    mockOAuth = new MockOAuthServer(&a);
+    mockOAuth->setResponseDelay(CONFIG[QStringLiteral("mock_oauth_delay")].toInt());
+    if (inherited.mockOAuth != -1 && mockOAuth->adoptListeningSocket(inherited.mockOAuth)) {
+      qDebug() << "Accepting mock OAuth requests on port" << mockOAuthPort << "from the previous process";
+    } else if (mockOAuth->listen(mockOAuthPort)) {
+      qDebug() << "Listening for mock OAuth requests on port" << mockOAuthPort;
+    } else {
+      qCritical() << "Failed to bind mock OAuth server to port" << mockOAuthPort;
+    }
+  }
+
+  // Optionally expose metrics for Prometheus, only to the local machine
+  HttpServer *metrics = nullptr;
+  if (quint16 metricsPort = CONFIG[QStringLiteral("metrics_port")].toUInt()) {
+    metrics = new HttpServer(&a);
+    metrics->route(QByteArrayLiteral("GET"), QByteArrayLiteral("/metrics"), [](const HttpServer::Request &){
+      HttpServer::Response r;
+      r.contentType = QByteArrayLiteral("text/plain; version=0.0.4");
+      r.body = METRICS.toPrometheus();
+      return r;
+    });
+    metrics->route(QByteArrayLiteral("GET"), QByteArrayLiteral("/trace"), [](const HttpServer::Request &){
+      HttpServer::Response r;
+      r.contentType = QByteArrayLiteral("application/json");
+      r.body = TRACER.toChromeJson();
+      return r;
+    });
+    if (inherited.metrics != -1 && metrics->adoptListeningSocket(inherited.metrics)) {
+      qDebug() << "Serving metrics on port" << metricsPort << "from the previous process";
+    } else if (metrics->listen(QHostAddress::LocalHost, metricsPort)) {
+      qDebug() << "Serving metrics on port" << metricsPort;
+    } else {
+      qCritical() << "Failed to bind metrics server to port" << metricsPort;
+    }
+  }
+
+  // Hand the listening sockets to the next process started with this config, then drain and exit
+  if (!handoffPath.isEmpty()) {
+    ListenerHandoff *handoff = new ListenerHandoff(&a);
+    handoff->listen(handoffPath, [&dispatch, &overlay, metrics, mockOAuth](){
+      ListenerHandoff::Listeners l;
+      l.chat = dispatch.listeningDescriptor();
+      l.overlay = overlay.listeningDescriptor();
+      l.metrics = metrics ? metrics->listeningDescriptor() : -1;
+      l.mockOAuth = mockOAuth ? mockOAuth->listeningDescriptor() : -1;
+      return l;
+    });
+
+    QObject::connect(handoff, &ListenerHandoff::handedOff, &a, [&dispatch, &overlay, metrics, mockOAuth](const QString &bus, const QString &secret){
+      // The new process answers these from now on, on the same sockets
+      if (metrics) {
+        metrics->close();
+      }
+      if (mockOAuth) {
+        mockOAuth->close();
+      }
+
+      QVariant drainTime = CONFIG[QStringLiteral("drain_time")];
+      int ms = drainTime.isValid() ? drainTime.toInt() : 30000;
+      QMetaObject::invokeMethod(&dispatch, [&dispatch, ms, bus, secret](){
+        dispatch.joinDrainBus(bus, secret);
+        dispatch.drain(ms);
+      }, Qt::QueuedConnection);
+      QMetaObject::invokeMethod(&overlay, &OverlayDispatch::drain, Qt::QueuedConnection);
+    });
+
+    // Give the last closing handshakes a moment to go out
+    QObject::connect(&dispatch, &ChatServer::drained, &a, [isWorker](){
+      QTimer::singleShot(1000, qApp, [isWorker](){
+        // Tells the supervisor not to restart this worker
+        QCoreApplication::exit(isWorker ? WorkerSupervisor::HANDED_OFF_EXIT_CODE : 0);
+      });
+    });
+  }
+
+#ifdef Q_OS_UNIX
+  // Reload live settings on SIGHUP, the same as !reloadconfig
+  onSighup(&a, [&dispatch](){
+    if (CONFIG.reload()) {
+      qDebug() << "Reloaded config.json";
+      QMetaObject::invokeMethod(&dispatch, &ChatServer::applyLiveConfig, Qt::QueuedConnection);
+    }
+  });
+#endif
+
+  // Connect signals between chat server and overlay, used when the channel is unavailable or full
   QObject::connect(&dispatch, &ChatServer::requestOverlayMessage, &overlay, &OverlayDispatch::sendMessage);
 
   // Run main event loop
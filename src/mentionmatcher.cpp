@@ -0,0 +1,122 @@
+#include "mentionmatcher.h"
+
+namespace
+{
+
+/**
+ * @brief Reads the next whitespace-separated word from pos, trimmed of surrounding punctuation
+ */
+bool nextWord(QStringView line, int *pos, QStringView *word)
+{
+  int i = *pos;
+  while (i < line.size() && line.at(i).isSpace()) {
+    i++;
+  }
+
+  if (i == line.size()) {
+    *pos = i;
+    return false;
+  }
+
+  int start = i;
+  while (i < line.size() && !line.at(i).isSpace()) {
+    i++;
+  }
+  *pos = i;
+
+  int end = i;
+  while (start < end && line.at(start).isPunct()) {
+    start++;
+  }
+  while (end > start && line.at(end - 1).isPunct()) {
+    end--;
+  }
+
+  *word = line.mid(start, end - start);
+  return true;
+}
+
+}
+
+void MentionMatcher::addRule(const QString &phrase, int tag)
+{
+  Rule r;
+  r.tag = tag;
+
+  int pos = 0;
+  QStringView word;
+  while (nextWord(phrase, &pos, &word)) {
+    if (!word.isEmpty()) {
+      r.words.append(word.toString());
+    }
+  }
+
+  if (!r.words.isEmpty()) {
+    m_rules.append(r);
+  }
+}
+
+bool MentionMatcher::isMentionAt(QStringView line, int at) const
+{
+  return !m_name.isEmpty()
+      && line.at(at) == '@'
+      && at + 1 + m_name.size() <= line.size()
+      && line.mid(at + 1, m_name.size()).compare(m_name, Qt::CaseInsensitive) == 0;
+}
+
+bool MentionMatcher::isMentioned(QStringView line) const
+{
+  for (int i = 0; i < line.size(); i++) {
+    if (line.at(i) == '@' && isMentionAt(line, i)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+MentionMatcher::Result MentionMatcher::match(QStringView line) const
+{
+  Result result;
+
+  result.leading = !line.isEmpty() && isMentionAt(line, 0);
+  result.mentioned = result.leading || isMentioned(line);
+
+  if (!result.mentioned) {
+    return result;
+  }
+
+  // Walk the words once, trying each rule that would beat the best match found so far
+  int best = m_rules.size();
+  int pos = 0;
+  QStringView word;
+  while (best > 0 && nextWord(line, &pos, &word)) {
+    for (int r = 0; r < best; r++) {
+      const Rule &rule = m_rules.at(r);
+      if (word.compare(rule.words.first(), Qt::CaseInsensitive) != 0) {
+        continue;
+      }
+
+      bool matched = true;
+      int followingPos = pos;
+      QStringView following;
+      for (int w = 1; w < rule.words.size(); w++) {
+        if (!nextWord(line, &followingPos, &following) || following.compare(rule.words.at(w), Qt::CaseInsensitive) != 0) {
+          matched = false;
+          break;
+        }
+      }
+
+      if (matched) {
+        best = r;
+        break;
+      }
+    }
+  }
+
+  if (best < m_rules.size()) {
+    result.tag = m_rules.at(best).tag;
+  }
+
+  return result;
+}
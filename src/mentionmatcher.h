@@ -0,0 +1,60 @@
+#ifndef MENTIONMATCHER_H
+#define MENTIONMATCHER_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+/**
+ * @brief Finds @mentions of the bot and the phrases that trigger its replies
+ *
+ * Everything is prepared when the name or rules are set, so matching a message only walks views
+ * into it and never allocates. Rules are only evaluated for messages that mention the bot.
+ */
+class MentionMatcher
+{
+public:
+  struct Result
+  {
+    // Message contains @name anywhere
+    bool mentioned = false;
+
+    // Message starts with @name
+    bool leading = false;
+
+    // Tag of the first matching rule in the order they were added, or -1 if none matched
+    int tag = -1;
+  };
+
+  MentionMatcher() = default;
+
+  void setName(const QString &name) { m_name = name; }
+  const QString &name() const { return m_name; }
+
+  /**
+   * @brief Adds a rule matching a phrase as a sequence of whole words, ignoring case
+   */
+  void addRule(const QString &phrase, int tag);
+
+  void clearRules() { m_rules.clear(); }
+
+  bool isMentioned(QStringView line) const;
+
+  Result match(QStringView line) const;
+
+private:
+  struct Rule
+  {
+    QVector<QString> words;
+    int tag;
+  };
+
+  bool isMentionAt(QStringView line, int at) const;
+
+  QString m_name;
+
+  QVector<Rule> m_rules;
+
+};
+
+#endif // MENTIONMATCHER_H
@@ -0,0 +1,199 @@
+#include "metrics.h"
+
+Metrics METRICS;
+
+namespace
+{
+
+// 50us to 5s
+const quint64 DURATION_BOUNDS[] = {
+  50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+  1000000000, 2500000000, 5000000000
+};
+
+// 64 to 1M
+const quint64 SIZE_BOUNDS[] = {
+  64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536, 131072, 262144, 524288, 1048576
+};
+
+void appendNumber(QByteArray *out, quint64 v, Histogram::Unit unit)
+{
+  if (unit == Histogram::NANOSECONDS) {
+    out->append(QByteArray::number(double(v) / 1e9, 'g', 9));
+  } else {
+    out->append(QByteArray::number(v));
+  }
+}
+
+void appendSample(QByteArray *out, const char *name, const char *suffix, const QByteArray &labels, const QByteArray &extraLabel)
+{
+  out->append(name);
+  out->append(suffix);
+  if (!labels.isEmpty() || !extraLabel.isEmpty()) {
+    out->append('{');
+    out->append(labels);
+    if (!labels.isEmpty() && !extraLabel.isEmpty()) {
+      out->append(',');
+    }
+    out->append(extraLabel);
+    out->append('}');
+  }
+  out->append(' ');
+}
+
+void writeHeader(QByteArray *out, const char *name, const char *type, const char *help)
+{
+  out->append("# HELP ");
+  out->append(name);
+  out->append(' ');
+  out->append(help);
+  out->append("\n# TYPE ");
+  out->append(name);
+  out->append(' ');
+  out->append(type);
+  out->append('\n');
+}
+
+void writeValue(QByteArray *out, const char *name, const char *type, const char *help, qint64 value)
+{
+  writeHeader(out, name, type, help);
+  out->append(name);
+  out->append(' ');
+  out->append(QByteArray::number(value));
+  out->append('\n');
+}
+
+QByteArray label(const char *key, const char *value)
+{
+  return QByteArray(key) + "=\"" + value + '"';
+}
+
+}
+
+Histogram::Histogram(Unit unit) :
+  m_unit(unit),
+  m_count(0),
+  m_sum(0)
+{
+  if (unit == NANOSECONDS) {
+    m_bounds = DURATION_BOUNDS;
+    m_boundCount = sizeof(DURATION_BOUNDS) / sizeof(quint64);
+  } else {
+    m_bounds = SIZE_BOUNDS;
+    m_boundCount = sizeof(SIZE_BOUNDS) / sizeof(quint64);
+  }
+
+  for (std::atomic<quint64> &b : m_buckets) {
+    b.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::observe(quint64 v)
+{
+  // Few enough buckets that a linear scan beats anything cleverer
+  int i = 0;
+  while (i < m_boundCount && v > m_bounds[i]) {
+    i++;
+  }
+
+  m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(v, std::memory_order_relaxed);
+}
+
+void Histogram::write(QByteArray *out, const char *name, const QByteArray &labels) const
+{
+  // Prometheus buckets are cumulative
+  quint64 cumulative = 0;
+  for (int i = 0; i <= m_boundCount; i++) {
+    cumulative += m_buckets[i].load(std::memory_order_relaxed);
+
+    QByteArray le = "le=\"";
+    if (i == m_boundCount) {
+      le.append("+Inf");
+    } else {
+      appendNumber(&le, m_bounds[i], m_unit);
+    }
+    le.append('"');
+
+    appendSample(out, name, "_bucket", labels, le);
+    out->append(QByteArray::number(cumulative));
+    out->append('\n');
+  }
+
+  appendSample(out, name, "_sum", labels, QByteArray());
+  appendNumber(out, m_sum.load(std::memory_order_relaxed), m_unit);
+  out->append('\n');
+
+  appendSample(out, name, "_count", labels, QByteArray());
+  out->append(QByteArray::number(m_count.load(std::memory_order_relaxed)));
+  out->append('\n');
+}
+
+Metrics::Metrics() :
+  outboundMessageSize(Histogram::SIZE)
+{
+}
+
+QByteArray Metrics::toPrometheus() const
+{
+  QByteArray out;
+  out.reserve(16384);
+
+  writeValue(&out, "kcchat_chat_connections", "gauge", "Open chat WebSocket connections", chatConnections.value());
+  writeValue(&out, "kcchat_overlay_connections", "gauge", "Open overlay WebSocket connections", overlayConnections.value());
+  writeValue(&out, "kcchat_authenticated_users", "gauge", "Distinct users with at least one authenticated connection", authenticatedUsers.value());
+
+  writeHeader(&out, "kcchat_packets_received_total", "counter", "Client packets received by type");
+  for (int i = PACKET_HELLO; i < PACKET_TYPE_COUNT; i++) {
+    appendSample(&out, "kcchat_packets_received_total", "", label("type", getPacketTypeName(static_cast<PacketType>(i))), QByteArray());
+    out.append(QByteArray::number(packetsReceived[i].value()));
+    out.append('\n');
+  }
+
+  writeHeader(&out, "kcchat_packets_throttled_total", "counter", "Client packets dropped by rate limits, by type (all is the per-connection limit)");
+  for (int i = 0; i < PACKET_TYPE_COUNT; i++) {
+    appendSample(&out, "kcchat_packets_throttled_total", "", label("type", getPacketTypeName(static_cast<PacketType>(i))), QByteArray());
+    out.append(QByteArray::number(packetsThrottled[i].value()));
+    out.append('\n');
+  }
+
+  writeValue(&out, "kcchat_packets_malformed_total", "counter", "Client packets that could not be parsed", packetsMalformed.value());
+
+  writeHeader(&out, "kcchat_client_message_seconds", "histogram", "Time spent in each stage of handling a client packet");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    clientMessageStages[i].write(&out, "kcchat_client_message_seconds", label("stage", getStageName(static_cast<Stage>(i))));
+  }
+
+  writeHeader(&out, "kcchat_db_query_seconds", "histogram", "Database query execution time");
+  dbQueries.write(&out, "kcchat_db_query_seconds");
+
+  writeHeader(&out, "kcchat_broadcast_seconds", "histogram", "Time to send one message to every recipient");
+  chatBroadcast.write(&out, "kcchat_broadcast_seconds", label("server", "chat"));
+  overlayBroadcast.write(&out, "kcchat_broadcast_seconds", label("server", "overlay"));
+
+  writeHeader(&out, "kcchat_outbound_message_chars", "histogram", "Size of outbound broadcast messages in UTF-16 code units");
+  outboundMessageSize.write(&out, "kcchat_outbound_message_chars");
+
+  writeValue(&out, "kcchat_overlay_queue_depth", "gauge", "Overlay channel backlog when last drained", overlayQueueDepth.value());
+  writeValue(&out, "kcchat_overlay_channel_fallbacks_total", "counter", "Overlay messages sent as queued signals because the channel was full or unavailable, or earlier ones were still queued", overlayChannelFallbacks.value());
+  writeValue(&out, "kcchat_heartbeat_timeouts_total", "counter", "Chat and overlay connections aborted for not answering a ping", heartbeatTimeouts.value());
+  writeValue(&out, "kcchat_history_page_queries_total", "counter", "History pages that had to be read from the database instead of a room's cache", historyPageQueries.value());
+
+  return out;
+}
+
+const char *Metrics::getStageName(Stage s)
+{
+  switch (s) {
+  case STAGE_PARSE: return "parse";
+  case STAGE_BAN_CHECK: return "ban_check";
+  case STAGE_AUTHENTICATE: return "authenticate";
+  case STAGE_HANDLE: return "handle";
+  case STAGE_COUNT:
+    break;
+  }
+
+  return "";
+}
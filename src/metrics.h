@@ -0,0 +1,152 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include "packettype.h"
+
+/**
+ * @brief Monotonically increasing count, safe to update from any thread
+ */
+class Counter
+{
+public:
+  Counter() : m_value(0) {}
+
+  void add(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+  quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<quint64> m_value;
+
+};
+
+/**
+ * @brief Value that can go up and down, safe to update from any thread
+ */
+class Gauge
+{
+public:
+  Gauge() : m_value(0) {}
+
+  void set(qint64 v) { m_value.store(v, std::memory_order_relaxed); }
+  void add(qint64 n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+  qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<qint64> m_value;
+
+};
+
+/**
+ * @brief Distribution of observations in fixed buckets, safe to update from any thread
+ *
+ * Values are recorded as integers (nanoseconds, or a plain size) so the sum can be kept in an
+ * atomic integer. Durations are converted to seconds for exposition.
+ */
+class Histogram
+{
+public:
+  enum Unit
+  {
+    NANOSECONDS,
+    SIZE
+  };
+
+  explicit Histogram(Unit unit = NANOSECONDS);
+
+  void observe(quint64 v);
+
+  /**
+   * @brief Appends this histogram's samples in Prometheus text format
+   */
+  void write(QByteArray *out, const char *name, const QByteArray &labels = QByteArray()) const;
+
+private:
+  static const int MAX_BUCKETS = 16;
+
+  Unit m_unit;
+  const quint64 *m_bounds;
+  int m_boundCount;
+
+  std::atomic<quint64> m_buckets[MAX_BUCKETS + 1];
+  std::atomic<quint64> m_count;
+  std::atomic<quint64> m_sum;
+
+};
+
+/**
+ * @brief Records the time from construction to destruction into a histogram
+ */
+class HistogramTimer
+{
+public:
+  explicit HistogramTimer(Histogram &h) :
+    m_histogram(h)
+  {
+    m_timer.start();
+  }
+
+  ~HistogramTimer()
+  {
+    m_histogram.observe(m_timer.nsecsElapsed());
+  }
+
+private:
+  Histogram &m_histogram;
+  QElapsedTimer m_timer;
+
+};
+
+/**
+ * @brief Process-wide metrics, exposed in Prometheus text format when metrics_port is set
+ */
+class Metrics
+{
+public:
+  Metrics();
+
+  enum Stage
+  {
+    STAGE_PARSE,
+    STAGE_BAN_CHECK,
+    STAGE_AUTHENTICATE,
+    STAGE_HANDLE,
+    STAGE_COUNT
+  };
+
+  Gauge chatConnections;
+  Gauge overlayConnections;
+  Gauge authenticatedUsers;
+
+  Counter packetsReceived[PACKET_TYPE_COUNT];
+  Counter packetsThrottled[PACKET_TYPE_COUNT];
+  Counter packetsMalformed;
+
+  Histogram clientMessageStages[STAGE_COUNT];
+  Histogram dbQueries;
+
+  Histogram chatBroadcast;
+  Histogram overlayBroadcast;
+  Histogram outboundMessageSize;
+
+  Gauge overlayQueueDepth;
+  Counter overlayChannelFallbacks;
+
+  Counter heartbeatTimeouts;
+
+  Counter historyPageQueries;
+
+  QByteArray toPrometheus() const;
+
+  static const char *getStageName(Stage s);
+
+};
+
+extern Metrics METRICS;
+
+#endif // METRICS_H
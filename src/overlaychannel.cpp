@@ -0,0 +1,85 @@
+#include "overlaychannel.h"
+
+#include <QDebug>
+
+#if defined(Q_OS_LINUX)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+OverlayChannel::OverlayChannel() :
+  m_readFd(-1),
+  m_writeFd(-1)
+{
+#if defined(Q_OS_LINUX)
+  m_readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_writeFd = m_readFd;
+#elif defined(Q_OS_UNIX)
+  int fds[2];
+  if (pipe(fds) == 0) {
+    for (int fd : fds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    m_readFd = fds[0];
+    m_writeFd = fds[1];
+  }
+#endif
+
+  if (m_readFd == -1) {
+    qWarning() << "Failed to create overlay channel wakeup, overlay messages will be queued as signals";
+  }
+}
+
+OverlayChannel::~OverlayChannel()
+{
+#ifdef Q_OS_UNIX
+  if (m_readFd != -1) {
+    close(m_readFd);
+  }
+  if (m_writeFd != -1 && m_writeFd != m_readFd) {
+    close(m_writeFd);
+  }
+#endif
+}
+
+bool OverlayChannel::push(int topic, QString payload)
+{
+  Item item;
+  item.topic = topic;
+  item.payload = std::move(payload);
+
+  if (!isValid() || !m_queue.push(std::move(item))) {
+    return false;
+  }
+
+#if defined(Q_OS_LINUX)
+  // Adds to the counter, so wakeups coalesce until the consumer reads it
+  quint64 one = 1;
+  ssize_t written = write(m_writeFd, &one, sizeof(one));
+  Q_UNUSED(written);
+#elif defined(Q_OS_UNIX)
+  // A full pipe already guarantees a pending wakeup, so a failed write is harmless
+  char one = 1;
+  ssize_t written = write(m_writeFd, &one, sizeof(one));
+  Q_UNUSED(written);
+#endif
+
+  return true;
+}
+
+void OverlayChannel::acknowledge()
+{
+#if defined(Q_OS_LINUX)
+  quint64 count;
+  ssize_t r = read(m_readFd, &count, sizeof(count));
+  Q_UNUSED(r);
+#elif defined(Q_OS_UNIX)
+  char buf[256];
+  while (read(m_readFd, buf, sizeof(buf)) > 0) {
+  }
+#endif
+}
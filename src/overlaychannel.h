@@ -0,0 +1,86 @@
+#ifndef OVERLAYCHANNEL_H
+#define OVERLAYCHANNEL_H
+
+#include <QAtomicInt>
+#include <QString>
+
+#include "spscqueue.h"
+
+/**
+ * @brief One-way channel carrying serialized overlay packets and their topics from the chat thread
+ * to the overlay
+ *
+ * Payloads go through a lock-free ring rather than queued signals, so nothing is allocated per
+ * event beyond the payload itself and the chat thread's backlog of queued events can't delay TTS
+ * commands. The consumer is woken through a file descriptor (eventfd on Linux, a pipe on other
+ * Unix systems) watched by its event loop. Where neither is available, isValid() returns false
+ * and callers should fall back to signals.
+ *
+ * When the ring is full, events go by signal instead. To keep them in order, the consumer drains
+ * the ring before handling each one. The producer also keeps using signals until every event it
+ * sent that way has been handled.
+ */
+class OverlayChannel
+{
+public:
+  OverlayChannel();
+
+  ~OverlayChannel();
+
+  bool isValid() const { return m_readFd != -1; }
+
+  /**
+   * @brief Producer only, returns false if the channel is unusable or full
+   */
+  bool push(int topic, QString payload);
+
+  /**
+   * @brief Producer calls beginFallback() for each event sent by signal instead, consumer calls
+   * endFallback() once it has handled it
+   */
+  void beginFallback() { m_fallbackPending.ref(); }
+  void endFallback() { m_fallbackPending.deref(); }
+  bool isFallingBack() const { return m_fallbackPending.loadAcquire() > 0; }
+
+  /**
+   * @brief Descriptor that becomes readable when payloads are waiting, for a QSocketNotifier
+   */
+  int wakeupDescriptor() const { return m_readFd; }
+
+  /**
+   * @brief Consumer only, clears the wakeup and then pops a payload at a time
+   */
+  void acknowledge();
+  int size() const { return m_queue.size(); }
+
+  bool pop(int *topic, QString *payload)
+  {
+    Item item;
+    if (!m_queue.pop(&item)) {
+      return false;
+    }
+
+    *topic = item.topic;
+    *payload = std::move(item.payload);
+    return true;
+  }
+
+private:
+  static const quint32 CAPACITY = 1024;
+
+  struct Item
+  {
+    int topic = -1;
+    QString payload;
+  };
+
+  SpscQueue<Item, CAPACITY> m_queue;
+
+  int m_readFd;
+  int m_writeFd;
+
+  QAtomicInt m_fallbackPending;
+
+};
+
+#endif // OVERLAYCHANNEL_H
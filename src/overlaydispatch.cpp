@@ -1,13 +1,25 @@
 #include "overlaydispatch.h"
 
-#include <QJsonDocument>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QTimer>
+#include <QUrlQuery>
 
+#include "jsonwriter.h"
+#include "listensocket.h"
+#include "metrics.h"
+#include "packetenvelope.h"
 #include "startupconfig.h"
+#include "tracer.h"
 
 OverlayDispatch::OverlayDispatch(QObject *parent) :
-  QObject(parent)
+  QObject(parent),
+  m_listener(nullptr),
+  m_inheritedListener(-1),
+  m_listeningDescriptor(-1),
+  m_channel(nullptr),
+  m_channelNotifier(nullptr),
+  m_heartbeat(nullptr)
 {
 }
 
@@ -15,47 +27,251 @@ void OverlayDispatch::start()
 {
   const quint16 wssPort = 2001;
 
+  TRACER.setThreadName("overlay");
+
   QSslConfiguration ssl = CONFIG.getSslConfiguration();
 
   m_webSocket = new QWebSocketServer(QStringLiteral("Event Dispatch"), ssl.isNull() ? QWebSocketServer::NonSecureMode : QWebSocketServer::SecureMode, this);
-  m_webSocket->setSslConfiguration(ssl);
+
+  // Accepts for m_webSocket, so connections are admitted before they get to the handshake
+  m_listener = new AdmissionServer(m_webSocket, ssl, this);
+  m_listener->admission().loadConfig();
+  connect(m_listener, &AdmissionServer::rejected, this, [](const QHostAddress &address, AdmissionControl::Verdict v){
+    qWarning() << "Rejected overlay connection from" << address << AdmissionControl::getVerdictName(v);
+  });
+
+  // Created here so its timer runs on this thread
+  m_heartbeat = new HeartbeatMonitor(this);
+  m_heartbeat->loadConfig();
+
+  QVariant logSize = CONFIG[QStringLiteral("overlay_log_size")];
+  if (logSize.isValid()) {
+    m_log.setCapacity(logSize.toInt());
+  }
+
+  if (m_channel && m_channel->isValid()) {
+    // Created here so the notifier belongs to this thread's event loop
+    m_channelNotifier = new QSocketNotifier(m_channel->wakeupDescriptor(), QSocketNotifier::Read, this);
+    connect(m_channelNotifier, &QSocketNotifier::activated, this, &OverlayDispatch::drainChannel);
+  }
+
   connect(m_webSocket, &QWebSocketServer::newConnection, this, &OverlayDispatch::handleNewConnection);
-  if (m_webSocket->listen(QHostAddress::Any, wssPort)) {
+
+  // Only the first worker serves overlays, so every overlay resumes against the same event log
+  QVariant serve = CONFIG[QStringLiteral("serve_overlays")];
+  if (serve.isValid() && !serve.toBool()) {
+    qDebug() << "Leaving overlays to the first worker";
+    return;
+  }
+
+  if (m_inheritedListener != -1 && adoptListeningSocket(m_listener, m_inheritedListener)) {
+    qDebug() << "Accepting overlay connections on port" << wssPort << "from the previous process";
+  } else if (listenOnPort(m_listener, wssPort, CONFIG[QStringLiteral("reuse_port")].toBool())) {
     qDebug() << "Listening for WebSocket event dispatch on port" << wssPort;
   } else {
     qCritical() << "Failed to bind WebSocket server to port" << wssPort;
   }
+  m_listeningDescriptor.storeRelease(getListeningSocket(m_listener));
 }
 
 void OverlayDispatch::stop()
 {
   qDeleteAll(m_clients);
-  m_webSocket->close();
+  m_listener->close();
+}
+
+void OverlayDispatch::drain()
+{
+  m_listener->close();
+
+  // There are only ever a handful of overlays, so they can all go at once
+  const QVector<QWebSocket*> clients = m_clients;
+  for (QWebSocket *s : clients) {
+    s->close(QWebSocketProtocol::CloseCodeGoingAway);
+  }
 }
 
 void OverlayDispatch::sendMessage(const OverlayMessage &msg)
 {
-  if (msg.type() == OverlayMessage::MSG_NONE) {
+  if (m_channelNotifier) {
+    // Anything still in the channel was sent before this
+    drainChannel();
+  }
+
+  if (msg.type() != OverlayMessage::MSG_NONE) {
+    broadcast(msg.topic(), msg.toJson());
+  }
+
+  if (m_channel) {
+    m_channel->endFallback();
+  }
+}
+
+void OverlayDispatch::drainChannel()
+{
+  m_channel->acknowledge();
+  METRICS.overlayQueueDepth.set(m_channel->size());
+
+  int topic;
+  QString payload;
+  while (m_channel->pop(&topic, &payload)) {
+    broadcast(topic, payload);
+  }
+}
+
+void OverlayDispatch::broadcast(int topic, const QString &payload)
+{
+  if (topic < 0 || topic >= OverlayMessage::TOPIC_COUNT) {
+    return;
+  }
+
+  HistogramTimer timer(METRICS.overlayBroadcast);
+  TraceSpan traceSpan("overlay_broadcast");
+
+  QString stamped = m_log.append(topic, payload);
+  for (QWebSocket *s : qAsConst(m_subscribers[topic])) {
+    s->sendTextMessage(stamped);
+  }
+}
+
+void OverlayDispatch::subscribe(QWebSocket *client, OverlayMessage::TopicMask topics)
+{
+  unsubscribe(client);
+
+  m_topics.insert(client, topics);
+  for (int i = 0; i < OverlayMessage::TOPIC_COUNT; i++) {
+    if (topics & (1u << i)) {
+      m_subscribers[i].append(client);
+    }
+  }
+}
+
+void OverlayDispatch::unsubscribe(QWebSocket *client)
+{
+  OverlayMessage::TopicMask topics = m_topics.take(client);
+  for (int i = 0; i < OverlayMessage::TOPIC_COUNT; i++) {
+    if (topics & (1u << i)) {
+      m_subscribers[i].removeOne(client);
+    }
+  }
+}
+
+OverlayMessage::TopicMask OverlayDispatch::parseTopics(const QStringList &names)
+{
+  OverlayMessage::TopicMask topics = 0;
+  for (const QString &n : names) {
+    QString name = n.trimmed();
+    if (name.isEmpty()) {
+      continue;
+    }
+
+    OverlayMessage::TopicMask t = OverlayMessage::getTopicsByName(name);
+    if (t == 0) {
+      qWarning() << "Overlay requested unknown topic" << n;
+    }
+    topics |= t;
+  }
+
+  // Overlays that don't ask for anything in particular get everything
+  return topics ? topics : OverlayMessage::ALL_TOPICS;
+}
+
+void OverlayDispatch::processClientMessage(const QString &s)
+{
+  QWebSocket *client = static_cast<QWebSocket*>(sender());
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+  // Older Qt can't cap messages while they arrive, but they can at least be dropped unread
+  if (s.size() > m_listener->admission().maxMessageSize()) {
+    client->abort();
+    return;
+  }
+#endif
+
+  PacketEnvelope envelope;
+  if (!envelope.parse(s)) {
+    return;
+  }
+
+  if (envelope.type().equals(u"resume")) {
+    processResume(client, envelope.data());
+  } else if (envelope.type().equals(u"subscribe")) {
+    processSubscribe(client, envelope.data());
+  }
+}
+
+void OverlayDispatch::processResume(QWebSocket *client, const QJsonValue &data)
+{
+  if (!m_resumeFrom.contains(client)) {
     return;
   }
 
-  qInfo() << "On-screen alert:" << msg.alertTitle() << "-" << msg.alertSubtitle();
+  // Anything after this was already sent live
+  quint64 connectedAt = m_resumeFrom.take(client);
+
+  QJsonObject o = data.toObject();
+
+  // Sequence numbers from another run of the server don't line up with ours, so replay everything
+  quint64 lastSeq = 0;
+  if (qint64(o.value(QStringLiteral("epoch")).toDouble()) == m_log.epoch()) {
+    lastSeq = quint64(o.value(QStringLiteral("last_seq")).toDouble());
+  }
+
+  bool gapped;
+  const QList<QString> missed = m_log.between(lastSeq, connectedAt, m_topics.value(client), &gapped);
+  if (gapped) {
+    qWarning() << "Overlay" << client << "missed more events than are logged, replaying" << missed.size();
+  }
+
+  for (const QString &event : missed) {
+    client->sendTextMessage(event);
+  }
+}
 
-  QString doc = msg.toJson().toJson();
-  for (QWebSocket *s : qAsConst(m_clients)) {
-    s->sendTextMessage(doc);
+void OverlayDispatch::processSubscribe(QWebSocket *client, const QJsonValue &data)
+{
+  QStringList names;
+  const QJsonArray topics = data.toObject().value(QStringLiteral("topics")).toArray();
+  for (const QJsonValue &t : topics) {
+    names.append(t.toString());
   }
+
+  subscribe(client, parseTopics(names));
 }
 
 void OverlayDispatch::handleNewConnection()
 {
-  QWebSocket *skt = m_webSocket->nextPendingConnection();
+  while (QWebSocket *skt = m_webSocket->nextPendingConnection()) {
+    QHostAddress address = skt->peerAddress();
+
+    m_listener->upgraded(skt);
 
-  connect(skt, &QWebSocket::disconnected, this, &OverlayDispatch::clientDisconnected);
+    connect(skt, &QWebSocket::disconnected, this, &OverlayDispatch::clientDisconnected);
+    connect(skt, &QWebSocket::textMessageReceived, this, &OverlayDispatch::processClientMessage);
 
-  qDebug() << "Overlay" << skt << "connected" << skt->peerAddress();
+    qDebug() << "Overlay" << skt << "connected" << address;
 
-  m_clients.append(skt);
+    m_clients.append(skt);
+    m_heartbeat->add(skt);
+    METRICS.overlayConnections.set(m_clients.size());
+
+    // Overlays can pick topics up front with ?topics=alert,skiptts in the URL, or later with a
+    // subscribe packet
+    QUrlQuery query(skt->requestUrl());
+    QString requested = query.queryItemValue(QStringLiteral("topics"));
+    subscribe(skt, parseTopics(requested.split(',')));
+
+    // Let the overlay know where the log is, so it can ask for anything it missed
+    JsonWriter &w = JsonWriter::threadLocal();
+    w.beginPacket(u"session");
+    w.key(JSON_KEY("epoch"));
+    w.value(m_log.epoch());
+    w.key(JSON_KEY("seq"));
+    w.value(qint64(m_log.lastSequence()));
+    skt->sendTextMessage(w.endPacket());
+
+    m_resumeFrom.insert(skt, m_log.lastSequence());
+  }
 }
 
 void OverlayDispatch::clientDisconnected()
@@ -65,4 +281,11 @@ void OverlayDispatch::clientDisconnected()
   qDebug() << "Overlay" << s << "disconnected" << s->peerAddress();
 
   m_clients.removeOne(s);
+  METRICS.overlayConnections.set(m_clients.size());
+  m_heartbeat->remove(s);
+  m_resumeFrom.remove(s);
+  unsubscribe(s);
+
+  // Its connection counts against the overlay's address until the socket is gone
+  s->deleteLater();
 }
@@ -1,9 +1,16 @@
 #ifndef OVERLAYDISPATCH_H
 #define OVERLAYDISPATCH_H
 
+#include <QAtomicInt>
+#include <QJsonValue>
+#include <QSocketNotifier>
 #include <QWebSocket>
 #include <QWebSocketServer>
 
+#include "admissionserver.h"
+#include "heartbeatmonitor.h"
+#include "overlaychannel.h"
+#include "overlayeventlog.h"
 #include "overlaymessage.h"
 
 class OverlayDispatch : public QObject
@@ -12,23 +19,76 @@ class OverlayDispatch : public QObject
 public:
   OverlayDispatch(QObject *parent = nullptr);
 
+  /**
+   * @brief Set channel to receive pre-serialized messages from, must be called before start()
+   */
+  void setChannel(OverlayChannel *channel) { m_channel = channel; }
+
+  /**
+   * @brief Accept on a listening socket handed over by a previous process instead of binding
+   */
+  void setInheritedListener(int fd) { m_inheritedListener = fd; }
+
+  /**
+   * @brief The overlay port's listening socket once started, safe to call from any thread
+   */
+  int listeningDescriptor() const { return m_listeningDescriptor.loadAcquire(); }
+
 public slots:
   void start();
 
   void stop();
 
+  /**
+   * @brief Stops accepting and closes every overlay, which resume on the replacement process
+   */
+  void drain();
+
   void sendMessage(const OverlayMessage &msg);
 
 private:
+  void broadcast(int topic, const QString &payload);
+
+  void processResume(QWebSocket *client, const QJsonValue &data);
+  void processSubscribe(QWebSocket *client, const QJsonValue &data);
+
+  void subscribe(QWebSocket *client, OverlayMessage::TopicMask topics);
+  void unsubscribe(QWebSocket *client);
+
+  static OverlayMessage::TopicMask parseTopics(const QStringList &names);
+
   QWebSocketServer *m_webSocket;
+  AdmissionServer *m_listener;
+
+  int m_inheritedListener;
+  QAtomicInt m_listeningDescriptor;
+
+  OverlayChannel *m_channel;
+  QSocketNotifier *m_channelNotifier;
 
   QVector<QWebSocket*> m_clients;
 
+  // Sockets subscribed to each topic, so dispatch only touches interested overlays
+  QVector<QWebSocket*> m_subscribers[OverlayMessage::TOPIC_COUNT];
+  QHash<QWebSocket*, OverlayMessage::TopicMask> m_topics;
+
+  HeartbeatMonitor *m_heartbeat;
+
+  OverlayEventLog m_log;
+
+  // Last sequence number each overlay was connected for, removed once it has resumed so each
+  // connection only gets one replay
+  QHash<QWebSocket*, quint64> m_resumeFrom;
+
 private slots:
   void handleNewConnection();
 
   void clientDisconnected();
 
+  void processClientMessage(const QString &s);
+
+  void drainChannel();
+
 };
 
 #endif // OVERLAYDISPATCH_H
@@ -0,0 +1,65 @@
+#include "overlayeventlog.h"
+
+#include <QDateTime>
+
+OverlayEventLog::OverlayEventLog() :
+  m_capacity(256),
+  m_epoch(QDateTime::currentMSecsSinceEpoch()),
+  m_lastSequence(0)
+{
+}
+
+void OverlayEventLog::setCapacity(int capacity)
+{
+  m_capacity = qMax(capacity, 0);
+  while (m_events.size() > m_capacity) {
+    m_events.removeFirst();
+  }
+}
+
+QString OverlayEventLog::append(int topic, const QString &payload)
+{
+  quint64 sequence = ++m_lastSequence;
+
+  // Splice the sequence number in as the first key rather than re-serializing the packet
+  QString stamped;
+  stamped.reserve(payload.size() + 32);
+  stamped.append(QLatin1String("{\"seq\":"));
+  stamped.append(QString::number(sequence));
+  stamped.append(',');
+  stamped.append(payload.constData() + 1, payload.size() - 1);
+
+  if (m_capacity > 0) {
+    if (m_events.size() == m_capacity) {
+      m_events.removeFirst();
+    }
+    m_events.append({sequence, topic, stamped});
+  }
+
+  return stamped;
+}
+
+QList<QString> OverlayEventLog::between(quint64 after, quint64 upTo, OverlayMessage::TopicMask topics, bool *gapped) const
+{
+  QList<QString> events;
+
+  if (gapped) {
+    // The sequence right after theirs must still be in the log, unless they're caught up
+    *gapped = after < upTo && (m_events.isEmpty() || m_events.first().sequence > after + 1);
+  }
+
+  // Events are in order, so walk back from the newest to find where to start
+  int start = m_events.size();
+  while (start > 0 && m_events.at(start - 1).sequence > after) {
+    start--;
+  }
+
+  for (int i = start; i < m_events.size() && m_events.at(i).sequence <= upTo; i++) {
+    const Event &e = m_events.at(i);
+    if (topics & (1u << e.topic)) {
+      events.append(e.payload);
+    }
+  }
+
+  return events;
+}
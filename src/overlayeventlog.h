@@ -0,0 +1,56 @@
+#ifndef OVERLAYEVENTLOG_H
+#define OVERLAYEVENTLOG_H
+
+#include <QList>
+#include <QString>
+
+#include "overlaymessage.h"
+
+/**
+ * @brief Bounded log of sequenced overlay events for replaying to reconnecting overlays
+ *
+ * Sequence numbers start at 1 and only increase for the lifetime of the process. The epoch
+ * identifies the process so an overlay that last saw a previous instance knows its sequence
+ * number means nothing here.
+ */
+class OverlayEventLog
+{
+public:
+  OverlayEventLog();
+
+  void setCapacity(int capacity);
+
+  qint64 epoch() const { return m_epoch; }
+  quint64 lastSequence() const { return m_lastSequence; }
+
+  /**
+   * @brief Stamps a serialized {"type":...} packet with the next sequence number and logs it
+   */
+  QString append(int topic, const QString &payload);
+
+  /**
+   * @brief Returns logged events in the given topics after one sequence number up to and including
+   * another, oldest first
+   *
+   * If the overlay is further behind than the log reaches, everything still logged in that range
+   * is returned and gapped is set.
+   */
+  QList<QString> between(quint64 after, quint64 upTo, OverlayMessage::TopicMask topics, bool *gapped = nullptr) const;
+
+private:
+  struct Event
+  {
+    quint64 sequence;
+    int topic;
+    QString payload;
+  };
+
+  int m_capacity;
+  qint64 m_epoch;
+  quint64 m_lastSequence;
+
+  QList<Event> m_events;
+
+};
+
+#endif // OVERLAYEVENTLOG_H
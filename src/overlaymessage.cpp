@@ -13,36 +13,66 @@ QString OverlayMessage::getTypeName(Type type)
   return QString();
 }
 
-QJsonDocument OverlayMessage::toJson() const
+OverlayMessage::TopicMask OverlayMessage::getTopicsByName(QStringView name)
 {
-  QJsonObject outer;
+  if (name == QStringView(u"alert")) {
+    return 1u << TOPIC_ALERT;
+  } else if (name == QStringView(u"joke")) {
+    return 1u << TOPIC_JOKE;
+  } else if (name == QStringView(u"command")) {
+    return ALL_TOPICS & ~((1u << TOPIC_COMMAND) - 1);
+  }
+
+  for (int i = 0; i < CMD_COUNT; i++) {
+    if (name == QStringView(getCommandName(static_cast<CommandType>(i)))) {
+      return 1u << (TOPIC_COMMAND + i);
+    }
+  }
 
-  outer.insert(QStringLiteral("type"), getTypeName(m_type));
-  outer.insert(QStringLiteral("data"), getDataObject());
+  return 0;
+}
+
+int OverlayMessage::topic() const
+{
+  switch (m_type) {
+  case MSG_ALERT: return TOPIC_ALERT;
+  case MSG_JOKE: return TOPIC_JOKE;
+  case MSG_COMMAND: return TOPIC_COMMAND + m_command;
+  case MSG_NONE:
+    break;
+  }
 
-  return QJsonDocument(outer);
+  return -1;
 }
 
-QJsonObject OverlayMessage::getDataObject() const
+QString OverlayMessage::toJson() const
 {
-  QJsonObject j;
+  JsonWriter &w = JsonWriter::threadLocal();
+  w.beginPacket(getTypeName(m_type));
+  writeData(w);
+  return w.endPacket();
+}
 
+void OverlayMessage::writeData(JsonWriter &w) const
+{
   switch (m_type) {
   case MSG_ALERT:
-    j.insert(QStringLiteral("title"), m_alertTitle);
-    j.insert(QStringLiteral("subtitle"), m_alertSubtitle);
+    w.key(JSON_KEY("title"));
+    w.value(m_alertTitle);
+    w.key(JSON_KEY("subtitle"));
+    w.value(m_alertSubtitle);
     break;
   case MSG_JOKE:
-    j.insert(QStringLiteral("name"), m_jokeName);
+    w.key(JSON_KEY("name"));
+    w.value(m_jokeName);
     break;
   case MSG_COMMAND:
-    j.insert(QStringLiteral("name"), getCommandName(m_command));
+    w.key(JSON_KEY("name"));
+    w.value(getCommandName(m_command));
     break;
   case MSG_NONE:
     break;
   }
-
-  return j;
 }
 
 QString OverlayMessage::getCommandName(CommandType c)
@@ -53,6 +83,8 @@ QString OverlayMessage::getCommandName(CommandType c)
   case CMD_PURGE_TTS: return QStringLiteral("purgetts");
   case CMD_AUTO_TTS: return QStringLiteral("autotts");
   case CMD_NEXT_TTS: return QStringLiteral("nexttts");
+  case CMD_COUNT:
+    break;
   }
 
   return QString();
@@ -1,10 +1,11 @@
 #ifndef OVERLAYMESSAGE_H
 #define OVERLAYMESSAGE_H
 
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QMetaType>
 #include <QString>
+#include <QStringView>
+
+#include "jsonwriter.h"
 
 class OverlayMessage
 {
@@ -21,9 +22,25 @@ public:
     CMD_PAUSE_TTS,
     CMD_PURGE_TTS,
     CMD_AUTO_TTS,
-    CMD_NEXT_TTS
+    CMD_NEXT_TTS,
+
+    CMD_COUNT
+  };
+
+  /**
+   * @brief What overlays can subscribe to, one topic per type with commands split out individually
+   */
+  enum Topic {
+    TOPIC_ALERT,
+    TOPIC_JOKE,
+    TOPIC_COMMAND,
+
+    TOPIC_COUNT = TOPIC_COMMAND + CMD_COUNT
   };
 
+  typedef quint32 TopicMask;
+  static const TopicMask ALL_TOPICS = (1u << TOPIC_COUNT) - 1;
+
   OverlayMessage(Type type = MSG_NONE)
   {
     m_type = type;
@@ -53,7 +70,14 @@ public:
 
   static QString getTypeName(Type type);
 
-  QJsonDocument toJson() const;
+  /**
+   * @brief Returns mask of topics matching a name, "command" matches every command
+   */
+  static TopicMask getTopicsByName(QStringView name);
+
+  int topic() const;
+
+  QString toJson() const;
 
   Type type() const { return m_type; }
 
@@ -70,7 +94,7 @@ public:
   void setCommand(CommandType c) { m_command = c; }
 
 private:
-  QJsonObject getDataObject() const;
+  void writeData(JsonWriter &w) const;
 
   static QString getCommandName(CommandType c);
 
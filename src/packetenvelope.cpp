@@ -0,0 +1,243 @@
+#include "packetenvelope.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+bool PacketEnvelope::parse(QStringView frame)
+{
+  m_frame = frame;
+  m_pos = 0;
+  m_type = m_auth = m_token = m_redirectUri = Field();
+  m_data = QStringView();
+
+  skipWhitespace();
+  if (m_pos >= m_frame.size() || m_frame.at(m_pos) != '{') {
+    return false;
+  }
+  m_pos++;
+
+  skipWhitespace();
+  if (m_pos < m_frame.size() && m_frame.at(m_pos) == '}') {
+    m_pos++;
+    return true;
+  }
+
+  while (m_pos < m_frame.size()) {
+    Field key;
+    if (!parseString(&key)) {
+      return false;
+    }
+
+    skipWhitespace();
+    if (m_pos >= m_frame.size() || m_frame.at(m_pos) != ':') {
+      return false;
+    }
+    m_pos++;
+    skipWhitespace();
+
+    Field *target = nullptr;
+    if (key.equals(u"type")) {
+      target = &m_type;
+    } else if (key.equals(u"auth")) {
+      target = &m_auth;
+    } else if (key.equals(u"token")) {
+      target = &m_token;
+    } else if (key.equals(u"redirect_uri")) {
+      target = &m_redirectUri;
+    }
+
+    if (target && m_pos < m_frame.size() && m_frame.at(m_pos) == '"') {
+      if (!parseString(target)) {
+        return false;
+      }
+    } else {
+      int valueStart = m_pos;
+      if (!skipValue()) {
+        return false;
+      }
+      if (key.equals(u"data")) {
+        m_data = m_frame.mid(valueStart, m_pos - valueStart);
+      }
+    }
+
+    skipWhitespace();
+    if (m_pos >= m_frame.size()) {
+      return false;
+    }
+
+    QChar c = m_frame.at(m_pos);
+    m_pos++;
+    if (c == '}') {
+      return true;
+    } else if (c != ',') {
+      return false;
+    }
+
+    skipWhitespace();
+  }
+
+  return false;
+}
+
+PacketType PacketEnvelope::packetType() const
+{
+  if (m_type.isEscaped()) {
+    return getPacketType(m_type.toString());
+  }
+
+  return getPacketType(m_type.rawView());
+}
+
+QJsonValue PacketEnvelope::data() const
+{
+  if (m_data.isEmpty()) {
+    return QJsonValue(QJsonValue::Undefined);
+  }
+
+  QChar first = m_data.at(0);
+  if (first == '{') {
+    return QJsonDocument::fromJson(m_data.toUtf8()).object();
+  } else if (first == '[') {
+    return QJsonDocument::fromJson(m_data.toUtf8()).array();
+  }
+
+  // QJsonDocument only accepts objects and arrays at the top level, so wrap scalars in one
+  QByteArray wrapped;
+  wrapped.reserve(m_data.size() + 2);
+  wrapped.append('[');
+  wrapped.append(m_data.toUtf8());
+  wrapped.append(']');
+  return QJsonDocument::fromJson(wrapped).array().at(0);
+}
+
+bool PacketEnvelope::parseString(Field *out)
+{
+  if (m_pos >= m_frame.size() || m_frame.at(m_pos) != '"') {
+    return false;
+  }
+  m_pos++;
+
+  int start = m_pos;
+  bool escaped = false;
+
+  while (m_pos < m_frame.size()) {
+    QChar c = m_frame.at(m_pos);
+    if (c == '"') {
+      out->m_raw = m_frame.mid(start, m_pos - start);
+      out->m_escaped = escaped;
+      m_pos++;
+      return true;
+    } else if (c == '\\') {
+      escaped = true;
+      m_pos += 2;
+    } else {
+      m_pos++;
+    }
+  }
+
+  return false;
+}
+
+bool PacketEnvelope::skipValue()
+{
+  if (m_pos >= m_frame.size()) {
+    return false;
+  }
+
+  QChar c = m_frame.at(m_pos);
+
+  if (c == '"') {
+    Field ignored;
+    return parseString(&ignored);
+  }
+
+  if (c == '{' || c == '[') {
+    // Skim over the nested value by counting brackets. This is iterative, so deeply nested input
+    // can't exhaust the stack, and mismatched brackets are left for the full decode to reject.
+    int depth = 0;
+    while (m_pos < m_frame.size()) {
+      c = m_frame.at(m_pos);
+      if (c == '"') {
+        Field ignored;
+        if (!parseString(&ignored)) {
+          return false;
+        }
+        continue;
+      }
+
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        depth--;
+      }
+      m_pos++;
+
+      if (depth == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Number, true, false, or null
+  int start = m_pos;
+  while (m_pos < m_frame.size()) {
+    c = m_frame.at(m_pos);
+    if (c == ',' || c == '}' || c == ']' || c.isSpace()) {
+      break;
+    }
+    m_pos++;
+  }
+  return m_pos > start;
+}
+
+void PacketEnvelope::skipWhitespace()
+{
+  while (m_pos < m_frame.size() && m_frame.at(m_pos).isSpace()) {
+    m_pos++;
+  }
+}
+
+QString PacketEnvelope::Field::toString() const
+{
+  if (!m_escaped) {
+    return m_raw.toString();
+  }
+
+  QString s;
+  s.reserve(m_raw.size());
+
+  for (int i = 0; i < m_raw.size(); i++) {
+    QChar c = m_raw.at(i);
+    if (c != '\\' || i + 1 >= m_raw.size()) {
+      s.append(c);
+      continue;
+    }
+
+    i++;
+    switch (m_raw.at(i).unicode()) {
+    case 'b': s.append('\b'); break;
+    case 'f': s.append('\f'); break;
+    case 'n': s.append('\n'); break;
+    case 'r': s.append('\r'); break;
+    case 't': s.append('\t'); break;
+    case 'u':
+      if (i + 4 < m_raw.size()) {
+        bool ok;
+        ushort u = m_raw.mid(i + 1, 4).toString().toUShort(&ok, 16);
+        if (ok) {
+          s.append(QChar(u));
+        }
+        i += 4;
+      }
+      break;
+    default:
+      // \" \\ \/
+      s.append(m_raw.at(i));
+      break;
+    }
+  }
+
+  return s;
+}
@@ -0,0 +1,77 @@
+#ifndef PACKETENVELOPE_H
+#define PACKETENVELOPE_H
+
+#include <QJsonValue>
+#include <QString>
+#include <QStringView>
+
+#include "packettype.h"
+
+/**
+ * @brief Lightweight parse of the top level of an inbound client packet
+ *
+ * Only pulls out the short string fields needed to route, throttle, and authenticate a packet,
+ * and records where "data" is without decoding it. The frame must outlive the envelope since
+ * fields are views into it. Nested values are only skimmed, so data() is what actually validates
+ * them.
+ */
+class PacketEnvelope
+{
+public:
+  /**
+   * @brief A JSON string value as it appears in the frame, decoded only on request
+   */
+  class Field
+  {
+  public:
+    Field() : m_escaped(false) {}
+
+    bool isEmpty() const { return m_raw.isEmpty(); }
+
+    // Only meaningful for strings without escape sequences, use toString() otherwise
+    QStringView rawView() const { return m_raw; }
+    bool isEscaped() const { return m_escaped; }
+
+    QString toString() const;
+
+    bool equals(QStringView s) const { return m_escaped ? QStringView(toString()) == s : m_raw == s; }
+
+  private:
+    friend class PacketEnvelope;
+
+    QStringView m_raw;
+    bool m_escaped;
+  };
+
+  PacketEnvelope() = default;
+
+  bool parse(QStringView frame);
+
+  const Field &type() const { return m_type; }
+  const Field &auth() const { return m_auth; }
+  const Field &token() const { return m_token; }
+  const Field &redirectUri() const { return m_redirectUri; }
+
+  PacketType packetType() const;
+
+  bool hasData() const { return !m_data.isEmpty(); }
+
+  QJsonValue data() const;
+
+private:
+  bool parseString(Field *out);
+  bool skipValue();
+  void skipWhitespace();
+
+  QStringView m_frame;
+  int m_pos;
+
+  Field m_type;
+  Field m_auth;
+  Field m_token;
+  Field m_redirectUri;
+  QStringView m_data;
+
+};
+
+#endif // PACKETENVELOPE_H
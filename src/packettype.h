@@ -0,0 +1,56 @@
+#ifndef PACKETTYPE_H
+#define PACKETTYPE_H
+
+#include <QStringView>
+
+/**
+ * @brief Classes of inbound client packet that are rate limited separately
+ */
+enum PacketType
+{
+  PACKET_ANY,     // Every packet counts against this, regardless of type
+  PACKET_HELLO,
+  PACKET_STATUS,
+  PACKET_MESSAGE,
+  PACKET_PAYPAL,
+  PACKET_HISTORY,
+  PACKET_OTHER,
+
+  PACKET_TYPE_COUNT
+};
+
+inline PacketType getPacketType(QStringView type)
+{
+  if (type == QStringView(u"message")) {
+    return PACKET_MESSAGE;
+  } else if (type == QStringView(u"status")) {
+    return PACKET_STATUS;
+  } else if (type == QStringView(u"hello")) {
+    return PACKET_HELLO;
+  } else if (type == QStringView(u"paypal")) {
+    return PACKET_PAYPAL;
+  } else if (type == QStringView(u"history")) {
+    return PACKET_HISTORY;
+  }
+
+  return PACKET_OTHER;
+}
+
+inline const char *getPacketTypeName(PacketType type)
+{
+  switch (type) {
+  case PACKET_ANY: return "all";
+  case PACKET_HELLO: return "hello";
+  case PACKET_STATUS: return "status";
+  case PACKET_MESSAGE: return "message";
+  case PACKET_PAYPAL: return "paypal";
+  case PACKET_HISTORY: return "history";
+  case PACKET_OTHER: return "other";
+  case PACKET_TYPE_COUNT:
+    break;
+  }
+
+  return "";
+}
+
+#endif // PACKETTYPE_H
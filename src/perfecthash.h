@@ -0,0 +1,129 @@
+#ifndef PERFECTHASH_H
+#define PERFECTHASH_H
+
+#include <array>
+#include <QStringView>
+
+/**
+ * @brief Compile-time perfect hashing of fixed, case-insensitive ASCII key sets
+ *
+ * build() searches for a seed at compile time under which every key lands in its own slot, so a
+ * lookup is one hash, one slot read, and one string compare to rule out unknown keys.
+ */
+namespace PerfectHash
+{
+
+const quint32 NO_SEED = 0xFFFFFFFF;
+
+template <size_t TableSize>
+struct Table
+{
+  quint32 seed;
+
+  // Index into the key array, or -1 if the slot is empty
+  std::array<qint8, TableSize> slots;
+};
+
+// FNV-1a over ASCII-lowercased input
+constexpr quint32 hash(const char *s, quint32 seed)
+{
+  quint32 h = 2166136261u ^ seed;
+  for (; *s; s++) {
+    char c = *s;
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    h = (h ^ quint8(c)) * 16777619u;
+  }
+  return h;
+}
+
+// Same hash over UTF-16 text, returns false if the text contains non-ASCII (so can't be a key)
+inline bool hash(QStringView s, quint32 seed, quint32 *out)
+{
+  quint32 h = 2166136261u ^ seed;
+  for (QChar c : s) {
+    ushort u = c.unicode();
+    if (u >= 0x80) {
+      return false;
+    }
+    if (u >= 'A' && u <= 'Z') {
+      u += 'a' - 'A';
+    }
+    h = (h ^ u) * 16777619u;
+  }
+  *out = h;
+  return true;
+}
+
+// Case-insensitive comparison of UTF-16 text against an ASCII key
+inline bool equals(QStringView s, const char *key)
+{
+  for (QChar c : s) {
+    ushort u = c.unicode();
+    if (u >= 'A' && u <= 'Z') {
+      u += 'a' - 'A';
+    }
+    char k = *key;
+    if (k >= 'A' && k <= 'Z') {
+      k += 'a' - 'A';
+    }
+    if (k == 0 || u != ushort(k)) {
+      return false;
+    }
+    key++;
+  }
+  return *key == 0;
+}
+
+// Entry can be any type with a `const char *name` member
+template <size_t TableSize, typename Entry, size_t N>
+constexpr Table<TableSize> build(const Entry (&entries)[N])
+{
+  static_assert((TableSize & (TableSize - 1)) == 0, "Table size must be a power of two");
+  static_assert(N < 128, "Too many keys for slot type");
+
+  for (quint32 seed = 0; seed < 10000; seed++) {
+    Table<TableSize> t{seed, {}};
+    for (auto &s : t.slots) {
+      s = -1;
+    }
+
+    bool collision = false;
+    for (size_t i = 0; i < N; i++) {
+      quint32 idx = hash(entries[i].name, seed) & (TableSize - 1);
+      if (t.slots[idx] != -1) {
+        collision = true;
+        break;
+      }
+      t.slots[idx] = qint8(i);
+    }
+
+    if (!collision) {
+      return t;
+    }
+  }
+
+  return Table<TableSize>{NO_SEED, {}};
+}
+
+// Returns the index of `key` in `entries`, or -1 if it isn't one of them
+template <size_t TableSize, typename Entry, size_t N>
+int find(const Table<TableSize> &table, const Entry (&entries)[N], QStringView key)
+{
+  quint32 h;
+  if (!hash(key, table.seed, &h)) {
+    return -1;
+  }
+
+  int index = table.slots[h & (TableSize - 1)];
+  if (index == -1 || !equals(key, entries[index].name)) {
+    return -1;
+  }
+
+  return index;
+}
+
+}
+
+#endif // PERFECTHASH_H
@@ -0,0 +1,67 @@
+#include "responsetable.h"
+
+bool ResponseTable::find(QStringView command, QString *response) const
+{
+  uint h = hash(command);
+
+  for (auto it = m_entries.constFind(h); it != m_entries.cend() && it.key() == h; it++) {
+    if (command.compare(it->command, Qt::CaseInsensitive) == 0) {
+      if (response) {
+        *response = it->response;
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ResponseTable::insert(const QString &command, const QString &response)
+{
+  uint h = hash(command);
+
+  for (auto it = m_entries.find(h); it != m_entries.end() && it.key() == h; it++) {
+    if (QStringView(command).compare(it->command, Qt::CaseInsensitive) == 0) {
+      it->response = response;
+      return;
+    }
+  }
+
+  m_entries.insert(h, {command, response});
+}
+
+bool ResponseTable::remove(QStringView command)
+{
+  uint h = hash(command);
+
+  for (auto it = m_entries.find(h); it != m_entries.end() && it.key() == h; it++) {
+    if (command.compare(it->command, Qt::CaseInsensitive) == 0) {
+      m_entries.erase(it);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+QStringList ResponseTable::commands() const
+{
+  QStringList l;
+  l.reserve(m_entries.size());
+
+  for (const Entry &e : m_entries) {
+    l.append(e.command);
+  }
+
+  return l;
+}
+
+uint ResponseTable::hash(QStringView s)
+{
+  // FNV-1a over case-folded UTF-16
+  uint h = 2166136261u;
+  for (QChar c : s) {
+    h = (h ^ QChar::toCaseFolded(c.unicode())) * 16777619u;
+  }
+  return h;
+}
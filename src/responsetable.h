@@ -0,0 +1,43 @@
+#ifndef RESPONSETABLE_H
+#define RESPONSETABLE_H
+
+#include <QMultiHash>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+/**
+ * @brief Case-insensitive hash table of user-defined command responses
+ *
+ * Lookups hash the case-folded command directly from a view, so finding a response never needs a
+ * lowercased copy of the command.
+ */
+class ResponseTable
+{
+public:
+  ResponseTable() = default;
+
+  bool find(QStringView command, QString *response) const;
+
+  bool contains(QStringView command) const { return find(command, nullptr); }
+
+  void insert(const QString &command, const QString &response);
+
+  bool remove(QStringView command);
+
+  QStringList commands() const;
+
+private:
+  struct Entry
+  {
+    QString command;
+    QString response;
+  };
+
+  static uint hash(QStringView s);
+
+  QMultiHash<uint, Entry> m_entries;
+
+};
+
+#endif // RESPONSETABLE_H
@@ -0,0 +1,83 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <QtGlobal>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer thread and one consumer thread
+ *
+ * Head and tail are free-running counters on separate cache lines, so the two threads only ever
+ * touch each other's counter to check for full/empty.
+ */
+template <typename T, quint32 Capacity>
+class SpscQueue
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  SpscQueue() :
+    m_head(0),
+    m_tail(0)
+  {
+  }
+
+  /**
+   * @brief Producer only, returns false without taking the value if the queue is full
+   */
+  bool push(T &&value)
+  {
+    const quint32 tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+
+    m_slots[tail & MASK] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Consumer only, returns false if the queue is empty
+   */
+  bool pop(T *out)
+  {
+    const quint32 head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    T &slot = m_slots[head & MASK];
+    *out = std::move(slot);
+
+    // Don't let the slot keep anything alive until it's reused
+    slot = T();
+
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Number of queued items, only a snapshot when called while the other thread is active
+   */
+  int size() const
+  {
+    return int(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+  }
+
+  bool isEmpty() const
+  {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+  }
+
+private:
+  static const quint32 MASK = Capacity - 1;
+
+  alignas(64) std::atomic<quint32> m_head;
+  alignas(64) std::atomic<quint32> m_tail;
+  alignas(64) T m_slots[Capacity];
+
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,97 @@
+#include "sqlexec.h"
+
+#include <algorithm>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include "metrics.h"
+#include "tracer.h"
+
+QueryProfiler QUERY_PROFILER;
+
+bool execQuery(QSqlQuery &query)
+{
+  TraceSpan traceSpan("db_query");
+
+  QElapsedTimer timer;
+  timer.start();
+  bool ok = query.exec();
+  qint64 ns = timer.nsecsElapsed();
+
+  METRICS.dbQueries.observe(ns);
+
+  int rows = -1;
+  if (ok) {
+    rows = query.isSelect() ? query.size() : query.numRowsAffected();
+  }
+  QUERY_PROFILER.record(query.lastQuery(), ns, rows, ok);
+
+  return ok;
+}
+
+QueryProfiler::QueryProfiler() :
+  m_slowNs(0)
+{
+}
+
+void QueryProfiler::setSlowThreshold(int ms)
+{
+  QMutexLocker locker(&m_lock);
+  m_slowNs = qMax(0, ms) * qint64(1000000);
+}
+
+void QueryProfiler::record(const QString &sql, qint64 ns, int rows, bool ok)
+{
+  QMutexLocker locker(&m_lock);
+
+  Statement &s = m_statements[sql];
+  if (s.calls == 0) {
+    s.sql = sql;
+  }
+
+  s.calls++;
+  s.totalNs += ns;
+  s.maxNs = qMax(s.maxNs, ns);
+  if (!ok) {
+    s.failures++;
+  } else if (rows < 0) {
+    // Drivers without QSqlDriver::QuerySize report -1 for every SELECT
+    s.rowsKnown = false;
+  } else {
+    s.rows += rows;
+  }
+
+  if (m_slowNs > 0 && ns >= m_slowNs) {
+    s.slow++;
+    locker.unlock();
+
+    QByteArray rowCount = rows < 0 ? QByteArrayLiteral("unknown") : QByteArray::number(rows);
+    qWarning().nospace() << "Slow query (" << ns / 1000000 << " ms, " << rowCount.constData() << " rows): " << sql;
+  }
+}
+
+QVector<QueryProfiler::Statement> QueryProfiler::getStatements() const
+{
+  QVector<Statement> statements;
+
+  {
+    QMutexLocker locker(&m_lock);
+    statements.reserve(m_statements.size());
+    for (const Statement &s : m_statements) {
+      statements.append(s);
+    }
+  }
+
+  std::sort(statements.begin(), statements.end(), [](const Statement &a, const Statement &b){
+    return a.totalNs > b.totalNs;
+  });
+
+  return statements;
+}
+
+void QueryProfiler::reset()
+{
+  QMutexLocker locker(&m_lock);
+  m_statements.clear();
+}
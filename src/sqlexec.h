@@ -0,0 +1,68 @@
+#ifndef SQLEXEC_H
+#define SQLEXEC_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSqlQuery>
+#include <QVector>
+
+/**
+ * @brief Executes a prepared query, recording how long it took
+ *
+ * Use this instead of QSqlQuery::exec() so database time shows up in metrics and statement
+ * statistics.
+ */
+bool execQuery(QSqlQuery &query);
+
+/**
+ * @brief Per-statement database statistics and slow-query log, fed by execQuery()
+ *
+ * Statements are identified by their prepared SQL text, so every execution of the same
+ * statement is aggregated regardless of the values bound to it.
+ */
+class QueryProfiler
+{
+public:
+  struct Statement
+  {
+    QString sql;
+    quint64 calls = 0;
+    quint64 failures = 0;
+    quint64 slow = 0;
+    qint64 rows = 0;
+
+    // False once the driver couldn't say how many rows an execution returned, rows is then a floor
+    bool rowsKnown = true;
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+  };
+
+  QueryProfiler();
+
+  /**
+   * @brief Queries taking at least this long are logged, 0 disables the log
+   */
+  void setSlowThreshold(int ms);
+
+  /**
+   * @brief Rows is the number returned by a SELECT or affected by anything else, -1 if unknown
+   */
+  void record(const QString &sql, qint64 ns, int rows, bool ok);
+
+  /**
+   * @brief Statements sorted by total time spent in them, most expensive first
+   */
+  QVector<Statement> getStatements() const;
+
+  void reset();
+
+private:
+  mutable QMutex m_lock;
+  QHash<QString, Statement> m_statements;
+  qint64 m_slowNs;
+
+};
+
+extern QueryProfiler QUERY_PROFILER;
+
+#endif // SQLEXEC_H
@@ -6,7 +6,48 @@
 
 StartupConfig CONFIG;
 
-bool StartupConfig::load()
+namespace
+{
+
+// Everything ConfigSnapshot::fromMap() reads
+const char *LIVE_KEYS[] = {
+  "bot_name",
+  "bot_color",
+  "max_chat_length",
+  "timezone",
+  "slow_query_ms",
+  "rate_limits"
+};
+
+}
+
+ConfigSnapshot ConfigSnapshot::fromMap(const QMap<QString, QVariant> &config)
+{
+  ConfigSnapshot c;
+
+  c.botName = config.value(QStringLiteral("bot_name")).toString();
+  c.botColor = config.value(QStringLiteral("bot_color")).toString();
+  c.maxChatLength = config.value(QStringLiteral("max_chat_length")).toInt();
+  c.timezone = QTimeZone(config.value(QStringLiteral("timezone")).toByteArray());
+  c.rateLimits = config.value(QStringLiteral("rate_limits")).toMap();
+
+  QVariant slowQueryMs = config.value(QStringLiteral("slow_query_ms"));
+  c.slowQueryMs = slowQueryMs.isValid() ? slowQueryMs.toInt() : 100;
+
+  return c;
+}
+
+StartupConfig::StartupConfig()
+{
+  publish(ConfigSnapshot());
+}
+
+StartupConfig::~StartupConfig()
+{
+  qDeleteAll(m_snapshots);
+}
+
+bool StartupConfig::readFile(QMap<QString, QVariant> *out)
 {
   QFile f(QStringLiteral("config.json"));
   if (!f.open(QFile::ReadOnly)) {
@@ -16,7 +57,7 @@ bool StartupConfig::load()
   QJsonObject d = QJsonDocument::fromJson(f.readAll()).object();
 
   for (auto it = d.constBegin(); it != d.constEnd(); it++) {
-    m_config.insert(it.key(), it.value().toVariant());
+    out->insert(it.key(), it.value().toVariant());
   }
 
   f.close();
@@ -24,6 +65,52 @@ bool StartupConfig::load()
   return true;
 }
 
+bool StartupConfig::load()
+{
+  if (!readFile(&m_config)) {
+    return false;
+  }
+  m_loaded = m_config;
+
+  publish(ConfigSnapshot::fromMap(m_config));
+
+  return true;
+}
+
+bool StartupConfig::reload()
+{
+  QMap<QString, QVariant> config;
+  if (!readFile(&config)) {
+    qCritical() << "Failed to reload config.json";
+    return false;
+  }
+
+  // Compared against the file as it was at startup, since workers override some keys with set()
+  QMap<QString, QVariant> before = m_loaded;
+  QMap<QString, QVariant> after = config;
+  for (const char *key : LIVE_KEYS) {
+    before.remove(QLatin1String(key));
+    after.remove(QLatin1String(key));
+  }
+
+  if (before != after) {
+    qWarning() << "Some changes to config.json only take effect after a restart";
+  }
+
+  publish(ConfigSnapshot::fromMap(config));
+
+  return true;
+}
+
+void StartupConfig::publish(const ConfigSnapshot &snapshot)
+{
+  QMutexLocker locker(&m_reloadLock);
+
+  const ConfigSnapshot *c = new ConfigSnapshot(snapshot);
+  m_snapshots.append(c);
+  m_live.storeRelease(c);
+}
+
 QSslConfiguration StartupConfig::getSslConfiguration() const
 {
   QSslConfiguration s;
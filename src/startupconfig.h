@@ -1,19 +1,58 @@
 #ifndef STARTUPCONFIG_H
 #define STARTUPCONFIG_H
 
+#include <QAtomicPointer>
 #include <QJsonObject>
+#include <QMutex>
 #include <QSslConfiguration>
+#include <QTimeZone>
+#include <QVector>
 
 /**
- * @brief Global read-only config loaded at startup
+ * @brief Typed copy of the settings that can change while the server is running
+ *
+ * Snapshots are never modified once published. A reload publishes a new one, and the old ones are
+ * kept until exit, so a reference from StartupConfig::live() stays valid for as long as the caller
+ * wants to hold on to it.
+ */
+struct ConfigSnapshot
+{
+  QString botName;
+  QString botColor;
+  int maxChatLength = 0;
+  QTimeZone timezone;
+  int slowQueryMs = 100;
+
+  // Raw "rate_limits" object, parsed by ChatServer::loadRateLimits()
+  QVariantMap rateLimits;
+
+  static ConfigSnapshot fromMap(const QMap<QString, QVariant> &config);
+};
+
+/**
+ * @brief Global config loaded at startup
+ *
+ * Values read through operator[] are fixed at startup. The ones in live() are reloaded from
+ * config.json by reload(), and can be read from any thread without locking.
  */
 class StartupConfig
 {
 public:
-  StartupConfig() = default;
+  StartupConfig();
+
+  ~StartupConfig();
 
   bool load();
 
+  /**
+   * @brief Re-reads config.json and publishes a new snapshot for live()
+   *
+   * Changed settings that aren't part of the snapshot are reported but keep their startup value.
+   */
+  bool reload();
+
+  const ConfigSnapshot &live() const { return *m_live.loadAcquire(); }
+
   QSslConfiguration getSslConfiguration() const;
 
   QVariant operator[](const QString &key) const
@@ -21,9 +60,30 @@ public:
     return m_config.value(key);
   }
 
+  /**
+   * @brief Overrides a loaded value, only safe before any other threads have started
+   */
+  void set(const QString &key, const QVariant &value)
+  {
+    m_config.insert(key, value);
+  }
+
 private:
+  static bool readFile(QMap<QString, QVariant> *out);
+
+  void publish(const ConfigSnapshot &snapshot);
+
   QMap<QString, QVariant> m_config;
 
+  // config.json as read by load(), without anything set() since
+  QMap<QString, QVariant> m_loaded;
+
+  QAtomicPointer<const ConfigSnapshot> m_live;
+
+  // Guards reloads against each other and owns every snapshot published so far
+  QMutex m_reloadLock;
+  QVector<const ConfigSnapshot*> m_snapshots;
+
 };
 
 extern StartupConfig CONFIG;
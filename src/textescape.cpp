@@ -0,0 +1,194 @@
+#include "textescape.h"
+
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTESCAPE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+// GCC and Clang can compile an AVX2 kernel per-function and check for it at runtime, other
+// compilers only get the baseline SSE2 one
+#define TEXTESCAPE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace TextEscape
+{
+
+namespace
+{
+
+typedef int (*FindSpecial_t)(const char16_t *s, int length);
+
+struct Kernel
+{
+  FindSpecial_t find;
+  const char *name;
+};
+
+inline bool isSpecial(char16_t c)
+{
+  return c < 0x20 || c == '<' || c == '>' || c == '&' || c == '"' || c == '\\';
+}
+
+int findSpecialScalar(const char16_t *s, int length)
+{
+  for (int i = 0; i < length; i++) {
+    if (isSpecial(s[i])) {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+#ifdef TEXTESCAPE_SSE2
+int findSpecialSse2(const char16_t *s, int length)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i control = _mm_set1_epi16(0x1F);
+  const __m128i lt = _mm_set1_epi16('<');
+  const __m128i gt = _mm_set1_epi16('>');
+  const __m128i amp = _mm_set1_epi16('&');
+  const __m128i quot = _mm_set1_epi16('"');
+  const __m128i backslash = _mm_set1_epi16('\\');
+
+  int i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+
+    // Saturating subtract is zero exactly for units <= 0x1F, which sidesteps the lack of an
+    // unsigned 16-bit compare
+    __m128i m = _mm_cmpeq_epi16(_mm_subs_epu16(v, control), zero);
+    m = _mm_or_si128(m, _mm_cmpeq_epi16(v, lt));
+    m = _mm_or_si128(m, _mm_cmpeq_epi16(v, gt));
+    m = _mm_or_si128(m, _mm_cmpeq_epi16(v, amp));
+    m = _mm_or_si128(m, _mm_cmpeq_epi16(v, quot));
+    m = _mm_or_si128(m, _mm_cmpeq_epi16(v, backslash));
+
+    // Two mask bits per UTF-16 unit
+    uint mask = uint(_mm_movemask_epi8(m));
+    if (mask) {
+      return i + int(qCountTrailingZeroBits(mask) / 2);
+    }
+  }
+
+  return i + findSpecialScalar(s + i, length - i);
+}
+#endif
+
+#ifdef TEXTESCAPE_AVX2
+__attribute__((target("avx2"))) int findSpecialAvx2(const char16_t *s, int length)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i control = _mm256_set1_epi16(0x1F);
+  const __m256i lt = _mm256_set1_epi16('<');
+  const __m256i gt = _mm256_set1_epi16('>');
+  const __m256i amp = _mm256_set1_epi16('&');
+  const __m256i quot = _mm256_set1_epi16('"');
+  const __m256i backslash = _mm256_set1_epi16('\\');
+
+  int i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+
+    __m256i m = _mm256_cmpeq_epi16(_mm256_subs_epu16(v, control), zero);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi16(v, lt));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi16(v, gt));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi16(v, amp));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi16(v, quot));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi16(v, backslash));
+
+    uint mask = uint(_mm256_movemask_epi8(m));
+    if (mask) {
+      return i + int(qCountTrailingZeroBits(mask) / 2);
+    }
+  }
+
+  return i + findSpecialScalar(s + i, length - i);
+}
+#endif
+
+Kernel selectKernel()
+{
+#ifdef TEXTESCAPE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {findSpecialAvx2, "avx2"};
+  }
+#endif
+
+#ifdef TEXTESCAPE_SSE2
+  return {findSpecialSse2, "sse2"};
+#else
+  return {findSpecialScalar, "scalar"};
+#endif
+}
+
+const Kernel &kernel()
+{
+  static const Kernel k = selectKernel();
+  return k;
+}
+
+void appendEscape(QString *out, char16_t c, bool html)
+{
+  static const char HEX[] = "0123456789abcdef";
+
+  switch (c) {
+  case '<': out->append(html ? QLatin1String("&lt;") : QLatin1String("<")); break;
+  case '>': out->append(html ? QLatin1String("&gt;") : QLatin1String(">")); break;
+  case '&': out->append(html ? QLatin1String("&amp;") : QLatin1String("&")); break;
+  case '"': out->append(html ? QLatin1String("&quot;") : QLatin1String("\\\"")); break;
+  case '\\': out->append(QLatin1String("\\\\")); break;
+  case '\b': out->append(QLatin1String("\\b")); break;
+  case '\f': out->append(QLatin1String("\\f")); break;
+  case '\n': out->append(QLatin1String("\\n")); break;
+  case '\r': out->append(QLatin1String("\\r")); break;
+  case '\t': out->append(QLatin1String("\\t")); break;
+  default:
+  {
+    const char escape[] = {'\\', 'u', '0', '0', HEX[(c >> 4) & 0xF], HEX[c & 0xF]};
+    out->append(QLatin1String(escape, sizeof(escape)));
+    break;
+  }
+  }
+}
+
+}
+
+int findSpecial(const char16_t *s, int length)
+{
+  return kernel().find(s, length);
+}
+
+void appendJson(QString *out, QStringView s, bool html)
+{
+  const char16_t *p = reinterpret_cast<const char16_t *>(s.data());
+  const int length = s.size();
+  const FindSpecial_t find = kernel().find;
+
+  // Worst case is every unit expanding, but plain text is the norm so only reserve for that
+  out->reserve(out->size() + length);
+
+  int i = 0;
+  while (true) {
+    int next = i + find(p + i, length - i);
+    out->append(s.data() + i, next - i);
+    if (next == length) {
+      break;
+    }
+
+    appendEscape(out, p[next], html);
+    i = next + 1;
+  }
+}
+
+const char *getKernelName()
+{
+  return kernel().name;
+}
+
+}
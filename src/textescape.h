@@ -0,0 +1,37 @@
+#ifndef TEXTESCAPE_H
+#define TEXTESCAPE_H
+
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief Vectorized scanning and escaping of chat text for HTML inside JSON strings
+ *
+ * Chat text is mostly plain, so the scan for characters that need escaping (<, >, &, ", \ and
+ * control characters) is done 16 (AVX2) or 8 (SSE2) UTF-16 units at a time and everything between
+ * them is copied in bulk. The widest kernel the CPU supports is picked once at startup.
+ */
+namespace TextEscape
+{
+
+/**
+ * @brief Returns the index of the first character that needs escaping, or length if there is none
+ */
+int findSpecial(const char16_t *s, int length);
+
+/**
+ * @brief Appends s to out as the contents of a JSON string, optionally HTML-escaping it first
+ *
+ * With html set, the result is equivalent to escaping QString::toHtmlEscaped() for JSON, without
+ * the intermediate string.
+ */
+void appendJson(QString *out, QStringView s, bool html);
+
+/**
+ * @brief Name of the kernel selected for this CPU, for diagnostics
+ */
+const char *getKernelName();
+
+}
+
+#endif // TEXTESCAPE_H
@@ -0,0 +1,143 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QHash>
+#include <QVector>
+
+/**
+ * @brief Hashed timing wheel for large numbers of coarse deadlines, one per key
+ *
+ * Time is cut into ticks of tickMs and each deadline is filed in the slot for its tick, modulo
+ * the number of slots. Deadlines further out than one revolution share a slot with nearer ones
+ * and are simply skipped until their tick comes around. Scheduling and cancelling are O(1), and
+ * advancing by a tick only looks at the keys in that one slot, so a periodic check of every
+ * connection costs the same per tick no matter how many there are in total.
+ *
+ * Deadlines never fire early, and fire at most one tick late.
+ */
+template <typename Key>
+class TimerWheel
+{
+public:
+  TimerWheel(int slots, qint64 tickMs) :
+    m_slots(slots),
+    m_tickMs(tickMs),
+    m_tick(0)
+  {
+  }
+
+  /**
+   * @brief Sets the wheel's current time, must be called before anything is scheduled
+   */
+  void reset(qint64 now)
+  {
+    m_tick = now / m_tickMs;
+  }
+
+  int size() const { return m_entries.size(); }
+
+  bool contains(const Key &key) const { return m_entries.contains(key); }
+
+  /**
+   * @brief Files key to expire at deadline, replacing any deadline it already had
+   */
+  void schedule(const Key &key, qint64 deadline)
+  {
+    cancel(key);
+
+    qint64 tick = qMax((deadline + m_tickMs - 1) / m_tickMs, m_tick + 1);
+    int slot = int(tick % m_slots.size());
+
+    m_entries.insert(key, {tick, slot, m_slots[slot].size()});
+    m_slots[slot].append(key);
+  }
+
+  void cancel(const Key &key)
+  {
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+      return;
+    }
+
+    int slot = it->slot;
+    int index = it->index;
+    m_entries.erase(it);
+    removeFromSlot(slot, index);
+  }
+
+  /**
+   * @brief Moves the wheel up to now, calling expired(key) for every deadline that has passed
+   *
+   * Expired keys are removed before any callback runs, so callbacks are free to schedule or
+   * cancel anything, including the key they were called for.
+   */
+  template <typename Func>
+  void advance(qint64 now, Func expired)
+  {
+    qint64 target = now / m_tickMs;
+    if (target <= m_tick) {
+      return;
+    }
+
+    // After a long stall every slot only needs visiting once
+    qint64 first = qMax(m_tick + 1, target - m_slots.size() + 1);
+
+    QVector<Key> due;
+    for (qint64 t = first; t <= target; t++) {
+      int slot = int(t % m_slots.size());
+      QVector<Key> &keys = m_slots[slot];
+
+      int i = 0;
+      while (i < keys.size()) {
+        Key key = keys.at(i);
+        auto it = m_entries.find(key);
+        if (it->tick <= target) {
+          m_entries.erase(it);
+          removeFromSlot(slot, i);
+          due.append(key);
+        } else {
+          i++;
+        }
+      }
+    }
+
+    m_tick = target;
+
+    for (const Key &key : qAsConst(due)) {
+      expired(key);
+    }
+  }
+
+private:
+  struct Entry
+  {
+    qint64 tick;
+    int slot;
+    int index;
+  };
+
+  /**
+   * @brief Swaps the last key in the slot into index, keeping its entry pointed at the new spot
+   */
+  void removeFromSlot(int slot, int index)
+  {
+    QVector<Key> &keys = m_slots[slot];
+
+    Key last = keys.last();
+    keys[index] = last;
+    keys.removeLast();
+
+    if (index < keys.size()) {
+      m_entries[last].index = index;
+    }
+  }
+
+  QVector<QVector<Key> > m_slots;
+  QHash<Key, Entry> m_entries;
+
+  qint64 m_tickMs;
+  qint64 m_tick;
+
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,66 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QtGlobal>
+
+/**
+ * @brief Refill rate and capacity of a TokenBucket
+ */
+struct RateLimit
+{
+  // Tokens regained per second
+  double rate;
+
+  // Maximum number of tokens that can be saved up, i.e. the largest burst allowed
+  double burst;
+};
+
+/**
+ * @brief Token bucket rate limiter
+ *
+ * The limit itself is passed in on each call rather than stored, so every connection can share
+ * the same limits and they can be changed without touching each bucket.
+ */
+class TokenBucket
+{
+public:
+  TokenBucket() :
+    m_tokens(-1),
+    m_lastRefill(0)
+  {}
+
+  /**
+   * @brief Take a token if one is available, returns false if the action should be discarded
+   *
+   * `now` is a monotonic time in milliseconds.
+   */
+  bool consume(const RateLimit &limit, qint64 now)
+  {
+    if (limit.rate <= 0) {
+      // Unlimited
+      return true;
+    }
+
+    if (m_tokens < 0) {
+      // First use, start with a full bucket
+      m_tokens = limit.burst;
+    } else {
+      m_tokens = qMin(limit.burst, m_tokens + (now - m_lastRefill) * limit.rate / 1000.0);
+    }
+    m_lastRefill = now;
+
+    if (m_tokens < 1.0) {
+      return false;
+    }
+
+    m_tokens -= 1.0;
+    return true;
+  }
+
+private:
+  double m_tokens;
+  qint64 m_lastRefill;
+
+};
+
+#endif // TOKENBUCKET_H
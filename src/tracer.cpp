@@ -0,0 +1,153 @@
+#include "tracer.h"
+
+#include <QMutexLocker>
+
+Tracer TRACER;
+
+namespace
+{
+
+thread_local quint64 g_currentRequest = 0;
+thread_local int g_currentThread = 0;
+
+std::atomic<int> g_nextThread(1);
+
+void appendMicroseconds(QByteArray *out, qint64 ns)
+{
+  out->append(QByteArray::number(double(ns) / 1000.0, 'f', 3));
+}
+
+void appendCommon(QByteArray *out, const char *name, const char *phase, int thread, qint64 ts)
+{
+  out->append("{\"name\":\"");
+  out->append(name);
+  out->append("\",\"ph\":\"");
+  out->append(phase);
+  out->append("\",\"pid\":1,\"tid\":");
+  out->append(QByteArray::number(thread));
+  out->append(",\"ts\":");
+  appendMicroseconds(out, ts);
+}
+
+}
+
+Tracer::Tracer() :
+  m_capacity(0),
+  m_nextRequest(1),
+  m_written(0)
+{
+  m_clock.start();
+}
+
+void Tracer::setCapacity(int spans)
+{
+  QMutexLocker locker(&m_lock);
+  m_capacity = qMax(0, spans);
+  m_spans.clear();
+  m_spans.resize(m_capacity);
+  m_written = 0;
+}
+
+void Tracer::record(const char *name, quint64 request, qint64 start, qint64 end, bool async)
+{
+  if (!isEnabled()) {
+    return;
+  }
+
+  int thread = currentThread();
+
+  QMutexLocker locker(&m_lock);
+  Span &s = m_spans[int(m_written % quint64(m_capacity))];
+  s.name = name;
+  s.request = request;
+  s.start = start;
+  s.end = end;
+  s.thread = thread;
+  s.async = async;
+  m_written++;
+}
+
+quint64 Tracer::newRequest()
+{
+  if (!isEnabled()) {
+    return 0;
+  }
+
+  return m_nextRequest.fetch_add(1, std::memory_order_relaxed);
+}
+
+quint64 Tracer::currentRequest()
+{
+  return g_currentRequest;
+}
+
+void Tracer::setCurrentRequest(quint64 request)
+{
+  g_currentRequest = request;
+}
+
+void Tracer::setThreadName(const char *name)
+{
+  int thread = currentThread();
+
+  QMutexLocker locker(&m_lock);
+  m_threadNames.append({thread, name});
+}
+
+int Tracer::currentThread()
+{
+  if (g_currentThread == 0) {
+    g_currentThread = g_nextThread.fetch_add(1, std::memory_order_relaxed);
+  }
+  return g_currentThread;
+}
+
+QByteArray Tracer::toChromeJson() const
+{
+  QMutexLocker locker(&m_lock);
+
+  QByteArray out;
+  out.reserve(128 + int(qMin(m_written, quint64(m_capacity))) * 128);
+
+  out.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"kcchat\"}}");
+
+  for (const QPair<int, const char*> &t : m_threadNames) {
+    out.append(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+    out.append(QByteArray::number(t.first));
+    out.append(",\"args\":{\"name\":\"");
+    out.append(t.second);
+    out.append("\"}}");
+  }
+
+  // Oldest first, starting after the newest once the ring has wrapped
+  quint64 count = qMin(m_written, quint64(m_capacity));
+  for (quint64 i = m_written - count; i < m_written; i++) {
+    const Span &s = m_spans.at(int(i % quint64(m_capacity)));
+
+    out.append(',');
+    if (s.async) {
+      // Nestable async begin/end pair, keyed by request so each wait gets its own slice
+      appendCommon(&out, s.name, "b", s.thread, s.start);
+      out.append(",\"cat\":\"async\",\"id\":");
+      out.append(QByteArray::number(s.request));
+      out.append('}');
+
+      out.append(',');
+      appendCommon(&out, s.name, "e", s.thread, s.end);
+      out.append(",\"cat\":\"async\",\"id\":");
+      out.append(QByteArray::number(s.request));
+      out.append('}');
+    } else {
+      appendCommon(&out, s.name, "X", s.thread, s.start);
+      out.append(",\"dur\":");
+      appendMicroseconds(&out, s.end - s.start);
+      out.append(",\"args\":{\"request\":");
+      out.append(QByteArray::number(s.request));
+      out.append("}}");
+    }
+  }
+
+  out.append("]}");
+  return out;
+}
@@ -0,0 +1,132 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+
+/**
+ * @brief Process-wide ring buffer of timed spans, exportable as Chrome trace-event JSON
+ *
+ * Disabled (and close to free) unless setCapacity() is given a non-zero size before any threads
+ * start. Spans are tagged with the request they belong to, so one chat message can be followed
+ * from the raw packet to the broadcast in Perfetto or chrome://tracing. Once the buffer is full
+ * the oldest spans are overwritten.
+ */
+class Tracer
+{
+public:
+  Tracer();
+
+  void setCapacity(int spans);
+
+  bool isEnabled() const { return m_capacity > 0; }
+
+  /**
+   * @brief Nanoseconds since the tracer was created, the timebase for every span
+   */
+  qint64 now() const { return m_clock.nsecsElapsed(); }
+
+  /**
+   * @brief Stores a finished span, name must be a string literal
+   *
+   * Async spans may overlap others on the same thread, such as authentication waiting on the
+   * network, and are exported as a separate track instead of being nested.
+   */
+  void record(const char *name, quint64 request, qint64 start, qint64 end, bool async = false);
+
+  /**
+   * @brief Allocates a new request ID, or returns 0 when tracing is disabled
+   */
+  quint64 newRequest();
+
+  /**
+   * @brief Request that spans started on this thread are attributed to
+   */
+  static quint64 currentRequest();
+  static void setCurrentRequest(quint64 request);
+
+  /**
+   * @brief Names the calling thread in exported traces
+   */
+  void setThreadName(const char *name);
+
+  QByteArray toChromeJson() const;
+
+private:
+  struct Span
+  {
+    const char *name = nullptr;
+    quint64 request = 0;
+    qint64 start = 0;
+    qint64 end = 0;
+    int thread = 0;
+    bool async = false;
+  };
+
+  static int currentThread();
+
+  QElapsedTimer m_clock;
+  int m_capacity;
+
+  std::atomic<quint64> m_nextRequest;
+
+  mutable QMutex m_lock;
+  QVector<Span> m_spans;
+  quint64 m_written;
+  QVector<QPair<int, const char*> > m_threadNames;
+
+};
+
+extern Tracer TRACER;
+
+/**
+ * @brief Records the time from construction to destruction as a span of the current request
+ */
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char *name) :
+    m_name(name),
+    m_start(TRACER.isEnabled() ? TRACER.now() : -1)
+  {
+  }
+
+  ~TraceSpan()
+  {
+    if (m_start != -1) {
+      TRACER.record(m_name, Tracer::currentRequest(), m_start, TRACER.now());
+    }
+  }
+
+private:
+  const char *m_name;
+  qint64 m_start;
+
+};
+
+/**
+ * @brief Attributes spans on this thread to a request until it goes out of scope
+ */
+class TraceRequest
+{
+public:
+  explicit TraceRequest(quint64 request) :
+    m_previous(Tracer::currentRequest())
+  {
+    Tracer::setCurrentRequest(request);
+  }
+
+  ~TraceRequest()
+  {
+    Tracer::setCurrentRequest(m_previous);
+  }
+
+private:
+  quint64 m_previous;
+
+};
+
+#endif // TRACER_H
@@ -0,0 +1,272 @@
+#include "trafficcapture.h"
+
+#include <cstring>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QtEndian>
+
+#include "packetenvelope.h"
+
+namespace
+{
+
+const char MAGIC[] = {'K', 'C', 'C', 'A', 'P'};
+const char VERSION = 1;
+
+// Keeps at most about a second of traffic in the file buffer if the server dies
+const qint64 FLUSH_INTERVAL_US = 1000000;
+
+void appendVarint(QByteArray *out, quint64 v)
+{
+  while (v >= 0x80) {
+    out->append(char(v | 0x80));
+    v >>= 7;
+  }
+  out->append(char(v));
+}
+
+}
+
+TrafficCapture::TrafficCapture() :
+  m_maxBytes(0),
+  m_lastRecordUs(0),
+  m_lastFlushUs(0),
+  m_nextConnection(1)
+{
+}
+
+bool TrafficCapture::open(const QString &filename, qint64 maxBytes)
+{
+  close();
+
+  m_file.setFileName(filename);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qCritical() << "Failed to open capture file" << filename << m_file.errorString();
+    return false;
+  }
+
+  m_maxBytes = maxBytes;
+
+  m_salt.resize(16);
+  QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(m_salt.data()), m_salt.size() / int(sizeof(quint32)));
+
+  m_clock.start();
+  m_lastRecordUs = 0;
+  m_lastFlushUs = 0;
+  m_connections.clear();
+  m_nextConnection = 1;
+
+  QByteArray header(MAGIC, sizeof(MAGIC));
+  header.append(VERSION);
+  uchar start[8];
+  qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), start);
+  header.append(reinterpret_cast<const char*>(start), sizeof(start));
+  m_file.write(header);
+
+  return true;
+}
+
+void TrafficCapture::close()
+{
+  if (m_file.isOpen()) {
+    m_file.close();
+  }
+}
+
+void TrafficCapture::recordConnect(QWebSocket *skt, const QHostAddress &address)
+{
+  if (!isEnabled()) {
+    return;
+  }
+
+  quint32 connection = m_nextConnection++;
+  m_connections.insert(skt, connection);
+
+  QCryptographicHash h(QCryptographicHash::Sha256);
+  h.addData(m_salt);
+  h.addData(address.toString().toUtf8());
+
+  beginRecord(CONNECT, connection);
+  appendVarint(&m_record, qFromLittleEndian<quint32>(h.result().constData()));
+  write();
+}
+
+void TrafficCapture::recordFrame(QWebSocket *skt, const QString &frame)
+{
+  if (!isEnabled()) {
+    return;
+  }
+
+  QByteArray utf8 = pseudonymize(frame).toUtf8();
+
+  beginRecord(FRAME, m_connections.value(skt));
+  appendVarint(&m_record, quint64(utf8.size()));
+  m_record.append(utf8);
+  write();
+}
+
+void TrafficCapture::recordDisconnect(QWebSocket *skt)
+{
+  if (!isEnabled()) {
+    return;
+  }
+
+  beginRecord(DISCONNECT, m_connections.take(skt));
+  write();
+}
+
+QString TrafficCapture::pseudonymize(const QString &frame) const
+{
+  PacketEnvelope envelope;
+  if (!envelope.parse(frame)) {
+    // Anything could be in here, so only its size is kept
+    return frame.contains(QLatin1String("token")) ? QString() : frame;
+  }
+
+  if (envelope.token().isEmpty()) {
+    return frame;
+  }
+
+  QCryptographicHash h(QCryptographicHash::Sha256);
+  h.addData(m_salt);
+  h.addData(envelope.token().toString().toUtf8());
+  QString pseudonym = QStringLiteral("cap_") + QString::fromLatin1(h.result().toHex().left(20));
+
+  QStringView raw = envelope.token().rawView();
+  int start = int(raw.data() - frame.constData());
+
+  QString out = frame;
+  out.replace(start, raw.size(), pseudonym);
+  return out;
+}
+
+void TrafficCapture::beginRecord(Kind kind, quint32 connection)
+{
+  qint64 now = m_clock.nsecsElapsed() / 1000;
+
+  m_record.clear();
+  m_record.append(char(kind));
+  appendVarint(&m_record, quint64(now - m_lastRecordUs));
+  appendVarint(&m_record, connection);
+
+  m_lastRecordUs = now;
+}
+
+void TrafficCapture::write()
+{
+  if (m_file.write(m_record) != m_record.size()) {
+    qCritical() << "Failed to write to capture file, stopping capture:" << m_file.errorString();
+    close();
+    return;
+  }
+
+  if (m_maxBytes > 0 && m_file.pos() >= m_maxBytes) {
+    qWarning() << "Capture file reached its size limit, stopping capture";
+    close();
+    return;
+  }
+
+  if (m_lastRecordUs - m_lastFlushUs >= FLUSH_INTERVAL_US) {
+    m_file.flush();
+    m_lastFlushUs = m_lastRecordUs;
+  }
+}
+
+TrafficCaptureReader::TrafficCaptureReader() :
+  m_startTime(0),
+  m_timeUs(0)
+{
+}
+
+bool TrafficCaptureReader::open(const QString &filename)
+{
+  m_file.setFileName(filename);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  QByteArray header = m_file.read(sizeof(MAGIC) + 1 + 8);
+  if (header.size() != int(sizeof(MAGIC)) + 1 + 8
+      || memcmp(header.constData(), MAGIC, sizeof(MAGIC)) != 0
+      || header.at(sizeof(MAGIC)) != VERSION) {
+    m_file.close();
+    return false;
+  }
+
+  m_startTime = qFromLittleEndian<qint64>(header.constData() + sizeof(MAGIC) + 1);
+  m_timeUs = 0;
+  return true;
+}
+
+bool TrafficCaptureReader::readVarint(quint64 *out)
+{
+  quint64 v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    char c;
+    if (!m_file.getChar(&c)) {
+      return false;
+    }
+
+    v |= quint64(uchar(c) & 0x7F) << shift;
+    if (!(uchar(c) & 0x80)) {
+      *out = v;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TrafficCaptureReader::next(Record *out)
+{
+  char kind;
+  if (!m_file.getChar(&kind)) {
+    return false;
+  }
+
+  quint64 delta, connection;
+  if (!readVarint(&delta) || !readVarint(&connection)) {
+    return false;
+  }
+
+  m_timeUs += qint64(delta);
+
+  out->kind = static_cast<TrafficCapture::Kind>(kind);
+  out->timeUs = m_timeUs;
+  out->connection = quint32(connection);
+  out->address = 0;
+  out->frame.clear();
+
+  switch (out->kind) {
+  case TrafficCapture::CONNECT:
+  {
+    quint64 address;
+    if (!readVarint(&address)) {
+      return false;
+    }
+    out->address = quint32(address);
+    break;
+  }
+  case TrafficCapture::FRAME:
+  {
+    quint64 length;
+    if (!readVarint(&length)) {
+      return false;
+    }
+    QByteArray utf8 = m_file.read(qint64(length));
+    if (quint64(utf8.size()) != length) {
+      return false;
+    }
+    out->frame = QString::fromUtf8(utf8);
+    break;
+  }
+  case TrafficCapture::DISCONNECT:
+    break;
+  default:
+    return false;
+  }
+
+  return true;
+}
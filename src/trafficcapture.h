@@ -0,0 +1,110 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QWebSocket>
+
+/**
+ * @brief Records inbound chat traffic to a compact binary log for later replay
+ *
+ * The log starts with the magic "KCCAP", a version byte and the wall-clock start time (ms since
+ * epoch, 8 bytes little-endian). Each record after that is a kind byte, then varints for the
+ * microseconds since the previous record and the connection number, then:
+ *
+ * - CONNECT: a varint pseudonym of the client address
+ * - FRAME: a varint byte length and the frame as UTF-8
+ * - DISCONNECT: nothing
+ *
+ * Auth tokens are replaced with "cap_" and a salted hash before anything is written. The salt is
+ * random and never stored, so a capture can't be used to log in as anyone, but each user keeps one
+ * consistent pseudonym that the `test` auth module will accept on replay.
+ */
+class TrafficCapture
+{
+public:
+  enum Kind
+  {
+    CONNECT = 1,
+    FRAME = 2,
+    DISCONNECT = 3
+  };
+
+  TrafficCapture();
+
+  bool open(const QString &filename, qint64 maxBytes);
+  void close();
+
+  bool isEnabled() const { return m_file.isOpen(); }
+
+  // Connections rejected on arrival should still be recorded, followed by an immediate disconnect
+  void recordConnect(QWebSocket *skt, const QHostAddress &address);
+  void recordFrame(QWebSocket *skt, const QString &frame);
+  void recordDisconnect(QWebSocket *skt);
+
+  /**
+   * @brief Replaces the frame's auth token with its pseudonym, or drops the frame's contents if
+   * it can't be parsed well enough to find one
+   */
+  QString pseudonymize(const QString &frame) const;
+
+private:
+  void beginRecord(Kind kind, quint32 connection);
+  void write();
+
+  QFile m_file;
+  qint64 m_maxBytes;
+  QByteArray m_salt;
+
+  QElapsedTimer m_clock;
+  qint64 m_lastRecordUs;
+  qint64 m_lastFlushUs;
+
+  QHash<QWebSocket*, quint32> m_connections;
+  quint32 m_nextConnection;
+
+  QByteArray m_record;
+
+};
+
+/**
+ * @brief Sequential reader for logs written by TrafficCapture
+ */
+class TrafficCaptureReader
+{
+public:
+  struct Record
+  {
+    TrafficCapture::Kind kind;
+
+    // Since the start of the capture
+    qint64 timeUs = 0;
+
+    quint32 connection = 0;
+    quint32 address = 0;
+    QString frame;
+  };
+
+  TrafficCaptureReader();
+
+  bool open(const QString &filename);
+
+  qint64 startTime() const { return m_startTime; }
+
+  /**
+   * @brief Returns false at the end of the log, or if it is truncated or corrupt
+   */
+  bool next(Record *out);
+
+private:
+  bool readVarint(quint64 *out);
+
+  QFile m_file;
+  qint64 m_startTime;
+  qint64 m_timeUs;
+
+};
+
+#endif // TRAFFICCAPTURE_H
@@ -3,6 +3,8 @@
 
 #include <QWebSocket>
 
+#include "metrics.h"
+
 /**
  * @brief Convenience class for pairing sockets with their user IDs
  */
@@ -13,7 +15,9 @@ public:
 
   QList<QWebSocket*> sockets() const { return m_socketId.keys(); }
   QList<qint64> authors() const { return m_idSocket.keys(); }
-  QList<QWebSocket*> socketsForAuthor(qint64 author) { return m_idSocket.value(author); }
+  int authorCount() const { return m_idSocket.size(); }
+  bool containsAuthor(qint64 author) const { return m_idSocket.contains(author); }
+  QList<QWebSocket*> socketsForAuthor(qint64 author) const { return m_idSocket.value(author); }
   qint64 authorForSocket (QWebSocket *skt) const { return m_socketId.value(skt); }
 
   bool insertSocket(qint64 author, QWebSocket *skt)
@@ -51,6 +55,9 @@ public:
 
   void broadcastTextMessage(const QString &s)
   {
+    HistogramTimer timer(METRICS.chatBroadcast);
+    METRICS.outboundMessageSize.observe(s.size());
+
     for (auto it = m_socketId.cbegin(); it != m_socketId.cend(); it++) {
       it.key()->sendTextMessage(s);
     }
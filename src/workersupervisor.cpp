@@ -0,0 +1,199 @@
+#include "workersupervisor.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QRandomGenerator>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/prctl.h>
+#endif
+
+#include "eventbroker.h"
+#include "startupconfig.h"
+
+namespace
+{
+
+const char *WORKER_ENV = "KCCHAT_WORKER";
+const char *WORKER_BUS_ENV = "KCCHAT_WORKER_BUS";
+const char *WORKER_SECRET_ENV = "KCCHAT_WORKER_SECRET";
+
+const int STOP_TIMEOUT = 10000;
+
+}
+
+WorkerSupervisor::WorkerSupervisor(int count, QObject *parent) :
+  QObject(parent),
+  m_count(count),
+  m_stopping(false),
+  m_broker(nullptr)
+{
+}
+
+WorkerSupervisor::~WorkerSupervisor()
+{
+  m_stopping = true;
+
+  // Workers stop the same way they do on Ctrl+C
+  for (QProcess *p : qAsConst(m_workers)) {
+    if (p->state() != QProcess::NotRunning) {
+      p->terminate();
+    }
+  }
+
+  for (QProcess *p : qAsConst(m_workers)) {
+    if (!p->waitForFinished(STOP_TIMEOUT)) {
+      qWarning() << "Worker" << p->processId() << "didn't stop in time, killing it";
+      p->kill();
+      p->waitForFinished();
+    }
+  }
+}
+
+bool WorkerSupervisor::start()
+{
+  // Reuse an external broker if nodes on other machines are in the cluster too
+  if (CONFIG[QStringLiteral("cluster_broker")].toString().isEmpty()) {
+    quint32 secret[4];
+    QRandomGenerator::system()->fillRange(secret);
+    m_secret = QString::fromLatin1(QByteArray(reinterpret_cast<const char*>(secret), sizeof(secret)).toHex());
+
+    m_busAddress = QStringLiteral("unix:") + QDir::temp().filePath(QStringLiteral("kcchat-%1.sock").arg(QCoreApplication::applicationPid()));
+
+    m_broker = new EventBroker(m_secret, this);
+    if (!m_broker->listen(m_busAddress)) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < m_count; i++) {
+    QProcess *p = new QProcess(this);
+    p->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &WorkerSupervisor::workerFinished);
+    m_workers.append(p);
+
+    startWorker(i);
+  }
+
+  qDebug() << "Started" << m_count << "worker processes";
+  return true;
+}
+
+void WorkerSupervisor::reloadWorkers()
+{
+#ifdef Q_OS_UNIX
+  for (QProcess *p : qAsConst(m_workers)) {
+    if (p->state() == QProcess::Running) {
+      kill(pid_t(p->processId()), SIGHUP);
+    }
+  }
+#endif
+}
+
+void WorkerSupervisor::startWorker(int index)
+{
+  QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+  env.insert(QLatin1String(WORKER_ENV), QString::number(index));
+  if (!m_busAddress.isEmpty()) {
+    env.insert(QLatin1String(WORKER_BUS_ENV), m_busAddress);
+    env.insert(QLatin1String(WORKER_SECRET_ENV), m_secret);
+  }
+
+  QProcess *p = m_workers.at(index);
+  p->setProcessEnvironment(env);
+  p->start(QCoreApplication::applicationFilePath(), QCoreApplication::arguments().mid(1));
+}
+
+void WorkerSupervisor::workerFinished(int exitCode, QProcess::ExitStatus status)
+{
+  if (m_stopping) {
+    return;
+  }
+
+  int index = m_workers.indexOf(static_cast<QProcess*>(sender()));
+
+  // Workers that handed off to a newer supervisor's workers are done for good
+  if (status == QProcess::NormalExit && exitCode == HANDED_OFF_EXIT_CODE) {
+    qDebug() << "Worker" << index << "handed off and finished";
+
+    bool anyRunning = false;
+    for (QProcess *p : qAsConst(m_workers)) {
+      anyRunning |= p->state() != QProcess::NotRunning;
+    }
+    if (!anyRunning) {
+      qApp->quit();
+    }
+    return;
+  }
+
+  if (status == QProcess::CrashExit) {
+    qCritical() << "Worker" << index << "crashed, restarting";
+  } else {
+    qWarning() << "Worker" << index << "exited with code" << exitCode << "- restarting";
+  }
+
+  QTimer::singleShot(RESTART_DELAY, this, [this, index](){
+    if (!m_stopping) {
+      startWorker(index);
+    }
+  });
+}
+
+bool WorkerSupervisor::configureWorker()
+{
+  QByteArray env = qgetenv(WORKER_ENV);
+  if (env.isEmpty()) {
+    return false;
+  }
+
+  int index = env.toInt();
+
+#ifdef Q_OS_LINUX
+  // Don't outlive the supervisor if it's killed without a chance to stop us
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+
+  CONFIG.set(QStringLiteral("reuse_port"), true);
+
+  QString bus = qEnvironmentVariable(WORKER_BUS_ENV);
+  if (!bus.isEmpty()) {
+    CONFIG.set(QStringLiteral("cluster_broker"), bus);
+    CONFIG.set(QStringLiteral("cluster_secret"), qEnvironmentVariable(WORKER_SECRET_ENV));
+  }
+
+  QString node = CONFIG[QStringLiteral("cluster_node")].toString();
+  if (!node.isEmpty()) {
+    CONFIG.set(QStringLiteral("cluster_node"), QStringLiteral("%1/%2").arg(node, QString::number(index)));
+  }
+
+  // Anything else bound to a fixed port or file needs one per worker
+  if (quint16 metricsPort = CONFIG[QStringLiteral("metrics_port")].toUInt()) {
+    CONFIG.set(QStringLiteral("metrics_port"), metricsPort + index);
+  }
+
+  QString captureFile = CONFIG[QStringLiteral("capture_file")].toString();
+  if (!captureFile.isEmpty()) {
+    CONFIG.set(QStringLiteral("capture_file"), QStringLiteral("%1.%2").arg(captureFile, QString::number(index)));
+  }
+
+  // Each worker hands off to the worker with the same index in the next supervisor
+  QString handoffSocket = CONFIG[QStringLiteral("handoff_socket")].toString();
+  if (!handoffSocket.isEmpty()) {
+    CONFIG.set(QStringLiteral("handoff_socket"), QStringLiteral("%1.%2").arg(handoffSocket, QString::number(index)));
+  }
+
+  if (index > 0) {
+    CONFIG.set(QStringLiteral("mock_oauth_port"), 0);
+
+    // Overlay events reach the first worker over the bus like any other node's
+    CONFIG.set(QStringLiteral("serve_overlays"), false);
+  }
+
+  return true;
+}
@@ -0,0 +1,62 @@
+#ifndef WORKERSUPERVISOR_H
+#define WORKERSUPERVISOR_H
+
+#include <QProcess>
+#include <QVector>
+
+class EventBroker;
+
+/**
+ * @brief Runs the server as several worker processes sharing the chat and overlay ports
+ *
+ * Each worker is this executable started again with KCCHAT_WORKER set. Workers bind their ports
+ * with SO_REUSEPORT so the kernel spreads connections between them, and share chat events over
+ * the cluster event bus. Unless cluster_broker is already configured, the supervisor runs the
+ * broker itself on a private UNIX socket. Workers that exit unexpectedly are restarted.
+ */
+class WorkerSupervisor : public QObject
+{
+  Q_OBJECT
+public:
+  /**
+   * @brief Exit code of a worker that handed off to a newer supervisor's worker and drained
+   *
+   * Any other exit, including a clean one after an external SIGTERM, gets the worker restarted.
+   */
+  static const int HANDED_OFF_EXIT_CODE = 3;
+
+  explicit WorkerSupervisor(int count, QObject *parent = nullptr);
+
+  virtual ~WorkerSupervisor() override;
+
+  bool start();
+
+  /**
+   * @brief Passes SIGHUP on to every worker so they reload config.json
+   */
+  void reloadWorkers();
+
+  /**
+   * @brief Called early in main(), adjusts CONFIG if this process is a worker and returns true
+   */
+  static bool configureWorker();
+
+private:
+  static const int RESTART_DELAY = 1000;
+
+  void startWorker(int index);
+
+  int m_count;
+  QVector<QProcess*> m_workers;
+  bool m_stopping;
+
+  EventBroker *m_broker;
+  QString m_busAddress;
+  QString m_secret;
+
+private slots:
+  void workerFinished(int exitCode, QProcess::ExitStatus status);
+
+};
+
+#endif // WORKERSUPERVISOR_H
@@ -0,0 +1,573 @@
+#include "loadgen.h"
+
+#include <cmath>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+// Large enough that the server skips its history replay on hello
+const char *HELLO_PACKET = "{\"type\":\"hello\",\"data\":{\"last_message\":9007199254740991}}";
+
+const int DRAIN_MS = 2000;
+
+QTextStream &out()
+{
+  static QTextStream s(stdout);
+  return s;
+}
+
+QString formatUs(quint64 us)
+{
+  return QStringLiteral("%1ms").arg(double(us) / 1000.0, 0, 'f', 2);
+}
+
+QString formatLatency(const LatencyHistogram &h)
+{
+  if (h.count() == 0) {
+    return QStringLiteral("no deliveries");
+  }
+
+  return QStringLiteral("p50 %1 p90 %2 p99 %3 p99.9 %4 max %5").arg(
+        formatUs(h.percentile(0.5)),
+        formatUs(h.percentile(0.9)),
+        formatUs(h.percentile(0.99)),
+        formatUs(h.percentile(0.999)),
+        formatUs(h.max()));
+}
+
+/**
+ * @brief Parses "lg <sender> <seq> <sendUs>" out of a chat packet, returns -1 if it isn't ours
+ */
+qint64 parseSendTime(const QString &packet)
+{
+  static const QLatin1String chatPrefix("{\"type\":\"chat\"");
+  static const QLatin1String messageKey("\"message\":\"lg ");
+
+  if (!packet.startsWith(chatPrefix)) {
+    return -1;
+  }
+
+  int start = packet.indexOf(messageKey);
+  if (start == -1) {
+    return -1;
+  }
+  start += messageKey.size();
+
+  int end = packet.indexOf('"', start);
+  if (end == -1) {
+    return -1;
+  }
+
+  int lastSpace = packet.lastIndexOf(' ', end - 1);
+  if (lastSpace < start) {
+    return -1;
+  }
+
+  bool ok;
+  qint64 sendUs = QStringView(packet).mid(lastSpace + 1, end - lastSpace - 1).toString().toLongLong(&ok);
+  return ok ? sendUs : -1;
+}
+
+void raiseDescriptorLimit()
+{
+#ifdef Q_OS_UNIX
+  // Each client is a socket, so the default soft limit of 1024 is nowhere near enough
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+      qWarning() << "Failed to raise open file limit, large client counts may fail to connect";
+    }
+  }
+#endif
+}
+
+}
+
+LatencyHistogram::LatencyHistogram() :
+  m_buckets(BUCKETS, 0),
+  m_count(0),
+  m_max(0)
+{
+}
+
+int LatencyHistogram::bucketOf(quint64 us)
+{
+  if (us < SUB_BUCKETS) {
+    return int(us);
+  }
+
+  int exponent = 63 - qCountLeadingZeroBits(us);
+  int sub = int((us >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+  return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+quint64 LatencyHistogram::lowerBound(int bucket)
+{
+  if (bucket < SUB_BUCKETS) {
+    return quint64(bucket);
+  }
+
+  int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  int sub = bucket % SUB_BUCKETS;
+  return quint64(SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+}
+
+void LatencyHistogram::record(quint64 us)
+{
+  m_buckets[bucketOf(us)]++;
+  m_count++;
+  m_max = qMax(m_max, us);
+}
+
+void LatencyHistogram::clear()
+{
+  m_buckets.fill(0);
+  m_count = 0;
+  m_max = 0;
+}
+
+quint64 LatencyHistogram::percentile(double q) const
+{
+  if (m_count == 0) {
+    return 0;
+  }
+
+  quint64 target = qMax(quint64(1), quint64(std::ceil(q * double(m_count))));
+  quint64 seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += m_buckets.at(i);
+    if (seen >= target) {
+      return qMin(lowerBound(i), m_max);
+    }
+  }
+
+  return m_max;
+}
+
+LoadClient::LoadClient(LoadGenerator *generator, int index, Role role, bool observer) :
+  QObject(generator),
+  m_generator(generator),
+  m_index(index),
+  m_role(role),
+  m_observer(observer),
+  m_connected(false),
+  m_closing(false),
+  m_rate(0),
+  m_seq(0),
+  m_readyUs(0)
+{
+  m_sendTimer.setSingleShot(true);
+  connect(&m_sendTimer, &QTimer::timeout, this, &LoadClient::sendNext);
+  connect(&m_socket, &QWebSocket::connected, this, &LoadClient::connected);
+  connect(&m_socket, &QWebSocket::disconnected, this, &LoadClient::disconnected);
+  connect(&m_socket, &QWebSocket::textMessageReceived, this, &LoadClient::textMessageReceived);
+}
+
+void LoadClient::open(const QUrl &url)
+{
+  m_socket.open(url);
+}
+
+void LoadClient::close()
+{
+  m_closing = true;
+  m_sendTimer.stop();
+
+  m_generator->clientDisconnected(this, m_connected, true);
+  m_connected = false;
+
+  m_socket.disconnect(this);
+  m_socket.close();
+  deleteLater();
+}
+
+void LoadClient::setRate(double rate)
+{
+  m_rate = rate;
+
+  if (m_rate <= 0) {
+    m_sendTimer.stop();
+  } else if (m_connected && !m_sendTimer.isActive()) {
+    scheduleNext();
+  }
+}
+
+void LoadClient::connected()
+{
+  m_connected = true;
+  m_readyUs = m_generator->nowUs();
+  m_socket.sendTextMessage(QLatin1String(HELLO_PACKET));
+  m_generator->clientConnected(this);
+
+  if (m_role == CHATTER && m_rate > 0) {
+    scheduleNext();
+  }
+}
+
+void LoadClient::disconnected()
+{
+  if (m_closing) {
+    return;
+  }
+
+  m_sendTimer.stop();
+  m_generator->clientDisconnected(this, m_connected, false);
+  m_connected = false;
+}
+
+void LoadClient::textMessageReceived(const QString &message)
+{
+  qint64 sendUs = parseSendTime(message);
+  if (sendUs != -1) {
+    if (sendUs >= m_readyUs) {
+      m_generator->messageDelivered(m_observer, m_generator->nowUs() - sendUs);
+    }
+    return;
+  }
+
+  if (message.startsWith(QLatin1String("{\"type\":\"accepted\""))) {
+    m_generator->messageAccepted();
+  } else if (message.startsWith(QLatin1String("{\"type\":\"status\""))) {
+    QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object().value(QStringLiteral("data")).toObject();
+    m_generator->statusReceived(data.value(QStringLiteral("status")).toString());
+  } else if (message.startsWith(QLatin1String("{\"type\":\"servermsg\""))) {
+    m_generator->serverMessageReceived();
+  }
+}
+
+void LoadClient::scheduleNext()
+{
+  // Exponential gaps make each chatter a Poisson process, so chatters don't fall into lockstep
+  double u = 1.0 - QRandomGenerator::global()->generateDouble();
+  int ms = int(-std::log(u) / m_rate * 1000.0);
+  m_sendTimer.start(ms);
+}
+
+void LoadClient::sendNext()
+{
+  if (!m_connected || m_rate <= 0) {
+    return;
+  }
+
+  // Sequence number keeps every message unique so duplicate slow mode never applies
+  m_seq++;
+  m_socket.sendTextMessage(QStringLiteral("{\"type\":\"message\",\"auth\":\"test\",\"token\":\"lg_%1\",\"data\":{\"text\":\"lg %1 %2 %3\"}}").arg(
+                             QString::number(m_index),
+                             QString::number(m_seq),
+                             QString::number(m_generator->nowUs())));
+  m_generator->messageSent();
+
+  scheduleNext();
+}
+
+LoadGenerator::LoadGenerator(const QUrl &url, const QVector<Phase> &phases, int connectRate, int observers, QObject *parent) :
+  QObject(parent),
+  m_url(url),
+  m_phases(phases),
+  m_phaseIndex(-1),
+  m_connectRate(connectRate),
+  m_observerCount(observers),
+  m_phaseStartUs(0),
+  m_lastReportUs(0),
+  m_wantLurkers(0),
+  m_wantChatters(0),
+  m_connected(0),
+  m_observersReady(0),
+  m_sent(0),
+  m_accepted(0),
+  m_delivered(0),
+  m_observerDelivered(0),
+  m_acceptedWhileObserved(0),
+  m_connectFailures(0),
+  m_unexpectedDisconnects(0),
+  m_serverMessages(0),
+  m_intervalSent(0),
+  m_intervalAccepted(0),
+  m_intervalDelivered(0),
+  m_phaseDelivered(0)
+{
+  connect(&m_connectTimer, &QTimer::timeout, this, &LoadGenerator::connectMore);
+  connect(&m_reportTimer, &QTimer::timeout, this, &LoadGenerator::report);
+
+  m_phaseTimer.setSingleShot(true);
+  connect(&m_phaseTimer, &QTimer::timeout, this, &LoadGenerator::nextPhase);
+}
+
+void LoadGenerator::start()
+{
+  m_clock.start();
+  m_connectTimer.start(100);
+  m_reportTimer.start(1000);
+  nextPhase();
+}
+
+void LoadGenerator::clientConnected(LoadClient *c)
+{
+  m_connected++;
+  if (c->isObserver()) {
+    m_observersReady++;
+  }
+}
+
+void LoadGenerator::clientDisconnected(LoadClient *c, bool wasConnected, bool expected)
+{
+  if (wasConnected) {
+    m_connected--;
+    if (c->isObserver()) {
+      m_observersReady--;
+    }
+    if (!expected) {
+      m_unexpectedDisconnects++;
+    }
+  } else if (!expected) {
+    m_connectFailures++;
+  }
+}
+
+void LoadGenerator::messageSent()
+{
+  m_sent++;
+  m_intervalSent++;
+}
+
+void LoadGenerator::messageAccepted()
+{
+  m_accepted++;
+  m_intervalAccepted++;
+
+  // Every observer connected now should see this message
+  m_acceptedWhileObserved += m_observersReady;
+}
+
+void LoadGenerator::messageDelivered(bool observer, qint64 latencyUs)
+{
+  quint64 us = quint64(qMax(qint64(0), latencyUs));
+
+  m_delivered++;
+  m_intervalDelivered++;
+  m_phaseDelivered++;
+  if (observer) {
+    m_observerDelivered++;
+  }
+
+  m_intervalLatency.record(us);
+  m_phaseLatency.record(us);
+  m_totalLatency.record(us);
+}
+
+void LoadGenerator::statusReceived(const QString &status)
+{
+  m_statuses[status]++;
+}
+
+void LoadGenerator::serverMessageReceived()
+{
+  m_serverMessages++;
+}
+
+void LoadGenerator::connectMore()
+{
+  int budget = qMax(1, m_connectRate / 10);
+
+  // Lurkers first, so chatters start talking to a full room
+  while (budget > 0 && m_lurkers.size() < m_wantLurkers) {
+    int index = m_lurkers.size();
+    LoadClient *c = new LoadClient(this, index, LoadClient::LURKER, index < m_observerCount);
+    m_lurkers.append(c);
+    c->open(m_url);
+    budget--;
+  }
+
+  double rate = m_phaseIndex < m_phases.size() ? m_phases.at(m_phaseIndex).rate : 0;
+  while (budget > 0 && m_chatters.size() < m_wantChatters) {
+    LoadClient *c = new LoadClient(this, m_chatters.size(), LoadClient::CHATTER, false);
+    c->setRate(rate);
+    m_chatters.append(c);
+    c->open(m_url);
+    budget--;
+  }
+}
+
+void LoadGenerator::report()
+{
+  qint64 now = nowUs();
+  double seconds = double(now - m_lastReportUs) / 1e6;
+  m_lastReportUs = now;
+
+  if (seconds <= 0) {
+    return;
+  }
+
+  out() << QStringLiteral("[phase %1, %2s] clients %3/%4, sent %5/s, accepted %6/s, delivered %7/s, %8").arg(
+             QString::number(m_phaseIndex + 1),
+             QString::number((now - m_phaseStartUs) / 1000000),
+             QString::number(m_connected),
+             QString::number(m_wantLurkers + m_wantChatters),
+             QString::number(double(m_intervalSent) / seconds, 'f', 1),
+             QString::number(double(m_intervalAccepted) / seconds, 'f', 1),
+             QString::number(double(m_intervalDelivered) / seconds, 'f', 0),
+             formatLatency(m_intervalLatency))
+        << '\n';
+  out().flush();
+
+  m_intervalSent = 0;
+  m_intervalAccepted = 0;
+  m_intervalDelivered = 0;
+  m_intervalLatency.clear();
+}
+
+void LoadGenerator::nextPhase()
+{
+  if (m_phaseIndex >= 0) {
+    printSummary(QStringLiteral("Phase %1").arg(m_phaseIndex + 1), double(nowUs() - m_phaseStartUs) / 1e6);
+  }
+
+  m_phaseIndex++;
+  m_phaseStartUs = nowUs();
+  m_phaseDelivered = 0;
+  m_phaseLatency.clear();
+
+  if (m_phaseIndex == m_phases.size()) {
+    // Stop sending and give in-flight messages time to arrive before counting drops
+    m_connectTimer.stop();
+    m_reportTimer.stop();
+    for (LoadClient *c : qAsConst(m_chatters)) {
+      c->setRate(0);
+    }
+    QTimer::singleShot(DRAIN_MS, this, &LoadGenerator::drained);
+    return;
+  }
+
+  const Phase &p = m_phases.at(m_phaseIndex);
+  m_wantLurkers = p.lurkers;
+  m_wantChatters = p.chatters;
+
+  // Shrink from the end so the observers, the first lurkers, stay connected as long as possible
+  while (m_lurkers.size() > m_wantLurkers) {
+    m_lurkers.takeLast()->close();
+  }
+  while (m_chatters.size() > m_wantChatters) {
+    m_chatters.takeLast()->close();
+  }
+
+  for (LoadClient *c : qAsConst(m_chatters)) {
+    c->setRate(p.rate);
+  }
+
+  out() << QStringLiteral("Phase %1: %2s with %3 lurkers and %4 chatters at %5 messages/s each").arg(
+             QString::number(m_phaseIndex + 1),
+             QString::number(p.seconds),
+             QString::number(p.lurkers),
+             QString::number(p.chatters),
+             QString::number(p.rate))
+        << '\n';
+  out().flush();
+
+  m_phaseTimer.start(p.seconds * 1000);
+}
+
+void LoadGenerator::drained()
+{
+  out() << "\nTotals\n"
+        << "  messages sent: " << m_sent << '\n'
+        << "  messages accepted: " << m_accepted << " (" << (m_sent - qMin(m_sent, m_accepted)) << " throttled or rejected)\n"
+        << "  deliveries: " << m_delivered << '\n'
+        << "  dropped at observers: " << (m_acceptedWhileObserved - qMin(m_acceptedWhileObserved, m_observerDelivered))
+        << " of " << m_acceptedWhileObserved << '\n'
+        << "  connect failures: " << m_connectFailures << '\n'
+        << "  unexpected disconnects: " << m_unexpectedDisconnects << '\n'
+        << "  server messages (slow mode etc.): " << m_serverMessages << '\n';
+
+  for (auto i = m_statuses.constBegin(); i != m_statuses.constEnd(); i++) {
+    out() << "  status \"" << i.key() << "\": " << i.value() << '\n';
+  }
+
+  out() << "  latency: " << formatLatency(m_totalLatency) << '\n';
+  out().flush();
+
+  for (LoadClient *c : qAsConst(m_lurkers)) {
+    c->close();
+  }
+  for (LoadClient *c : qAsConst(m_chatters)) {
+    c->close();
+  }
+  m_lurkers.clear();
+  m_chatters.clear();
+
+  emit finished();
+}
+
+void LoadGenerator::printSummary(const QString &title, double seconds)
+{
+  out() << title << ": delivered " << QString::number(double(m_phaseDelivered) / qMax(seconds, 0.001), 'f', 0)
+        << "/s, " << formatLatency(m_phaseLatency) << '\n';
+  out().flush();
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("kcchat-loadgen"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QStringLiteral("Generates chat load against a kcchat server with test_auth enabled"));
+  parser.addHelpOption();
+
+  QCommandLineOption urlOption(QStringLiteral("url"), QStringLiteral("Chat server URL."), QStringLiteral("url"), QStringLiteral("ws://localhost:2002"));
+  QCommandLineOption lurkersOption(QStringLiteral("lurkers"), QStringLiteral("Clients that only say hello and listen."), QStringLiteral("n"), QStringLiteral("1000"));
+  QCommandLineOption chattersOption(QStringLiteral("chatters"), QStringLiteral("Authenticated clients that send messages."), QStringLiteral("n"), QStringLiteral("50"));
+  QCommandLineOption rateOption(QStringLiteral("rate"), QStringLiteral("Messages per second per chatter."), QStringLiteral("rate"), QStringLiteral("0.5"));
+  QCommandLineOption durationOption(QStringLiteral("duration"), QStringLiteral("Seconds to run."), QStringLiteral("seconds"), QStringLiteral("60"));
+  QCommandLineOption phaseOption(QStringLiteral("phase"), QStringLiteral("A phase of a scripted run, may be repeated. Overrides the single-phase options."), QStringLiteral("seconds:lurkers:chatters:rate"));
+  QCommandLineOption connectRateOption(QStringLiteral("connect-rate"), QStringLiteral("New connections per second, keep under the server's accept_rate."), QStringLiteral("n"), QStringLiteral("40"));
+  QCommandLineOption observersOption(QStringLiteral("observers"), QStringLiteral("Lurkers that count dropped messages."), QStringLiteral("n"), QStringLiteral("100"));
+
+  parser.addOptions({urlOption, lurkersOption, chattersOption, rateOption, durationOption, phaseOption, connectRateOption, observersOption});
+  parser.process(a);
+
+  QVector<LoadGenerator::Phase> phases;
+  const QStringList phaseSpecs = parser.values(phaseOption);
+  for (const QString &spec : phaseSpecs) {
+    QStringList parts = spec.split(':');
+    if (parts.size() != 4) {
+      qCritical() << "Invalid phase" << spec << "- expected seconds:lurkers:chatters:rate";
+      return 1;
+    }
+
+    LoadGenerator::Phase p;
+    p.seconds = parts.at(0).toInt();
+    p.lurkers = parts.at(1).toInt();
+    p.chatters = parts.at(2).toInt();
+    p.rate = parts.at(3).toDouble();
+    phases.append(p);
+  }
+
+  if (phases.isEmpty()) {
+    LoadGenerator::Phase p;
+    p.seconds = parser.value(durationOption).toInt();
+    p.lurkers = parser.value(lurkersOption).toInt();
+    p.chatters = parser.value(chattersOption).toInt();
+    p.rate = parser.value(rateOption).toDouble();
+    phases.append(p);
+  }
+
+  raiseDescriptorLimit();
+
+  LoadGenerator generator(QUrl(parser.value(urlOption)), phases, qMax(1, parser.value(connectRateOption).toInt()), parser.value(observersOption).toInt());
+  QObject::connect(&generator, &LoadGenerator::finished, &a, &QCoreApplication::quit, Qt::QueuedConnection);
+  generator.start();
+
+  return a.exec();
+}
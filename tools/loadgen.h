@@ -0,0 +1,200 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+#include <QWebSocket>
+
+class LoadGenerator;
+
+/**
+ * @brief Latency distribution with roughly 6% precision over microseconds to hours
+ *
+ * Each power of two is split into 16 linear sub-buckets, so recording is a couple of shifts and
+ * an increment no matter how many deliveries are measured.
+ */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void record(quint64 us);
+
+  void clear();
+
+  quint64 count() const { return m_count; }
+  quint64 max() const { return m_max; }
+
+  /**
+   * @brief Lower bound of the bucket holding the given quantile (0 to 1)
+   */
+  quint64 percentile(double q) const;
+
+private:
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int BUCKETS = 64 * SUB_BUCKETS;
+
+  static int bucketOf(quint64 us);
+  static quint64 lowerBound(int bucket);
+
+  QVector<quint64> m_buckets;
+  quint64 m_count;
+  quint64 m_max;
+
+};
+
+/**
+ * @brief One simulated chat client
+ *
+ * Lurkers only send hello and listen. Chatters also authenticate through the server's `test` auth
+ * module and send messages at a Poisson-distributed rate, each stamped with the sender and send
+ * time so every receiver can measure publish-to-receive latency.
+ */
+class LoadClient : public QObject
+{
+  Q_OBJECT
+public:
+  enum Role
+  {
+    LURKER,
+    CHATTER
+  };
+
+  LoadClient(LoadGenerator *generator, int index, Role role, bool observer);
+
+  void open(const QUrl &url);
+  void close();
+
+  Role role() const { return m_role; }
+  bool isObserver() const { return m_observer; }
+  bool isConnected() const { return m_connected; }
+
+  /**
+   * @brief Messages per second for chatters, 0 stops sending
+   */
+  void setRate(double rate);
+
+private slots:
+  void connected();
+  void disconnected();
+  void textMessageReceived(const QString &message);
+  void sendNext();
+
+private:
+  void scheduleNext();
+
+  LoadGenerator *m_generator;
+  int m_index;
+  Role m_role;
+  bool m_observer;
+  bool m_connected;
+  bool m_closing;
+
+  QWebSocket m_socket;
+  QTimer m_sendTimer;
+  double m_rate;
+  quint32 m_seq;
+
+  // Messages sent before this client said hello are history replay, not live deliveries
+  qint64 m_readyUs;
+
+};
+
+/**
+ * @brief Runs phases of lurkers and chatters against a server and reports what it saw
+ */
+class LoadGenerator : public QObject
+{
+  Q_OBJECT
+public:
+  struct Phase
+  {
+    int seconds = 60;
+    int lurkers = 1000;
+    int chatters = 50;
+    double rate = 0.5;
+  };
+
+  LoadGenerator(const QUrl &url, const QVector<Phase> &phases, int connectRate, int observers, QObject *parent = nullptr);
+
+  void start();
+
+  /**
+   * @brief Microseconds on the clock shared by every client's send and receive stamps
+   */
+  qint64 nowUs() const { return m_clock.nsecsElapsed() / 1000; }
+
+  // Called by clients
+  void clientConnected(LoadClient *c);
+  void clientDisconnected(LoadClient *c, bool wasConnected, bool expected);
+  void messageSent();
+  void messageAccepted();
+  void messageDelivered(bool observer, qint64 latencyUs);
+  void statusReceived(const QString &status);
+  void serverMessageReceived();
+
+signals:
+  void finished();
+
+private slots:
+  void connectMore();
+  void report();
+  void nextPhase();
+  void drained();
+
+private:
+  void printSummary(const QString &title, double seconds);
+
+  QUrl m_url;
+  QVector<Phase> m_phases;
+  int m_phaseIndex;
+  int m_connectRate;
+  int m_observerCount;
+
+  QElapsedTimer m_clock;
+  qint64 m_phaseStartUs;
+  qint64 m_lastReportUs;
+
+  QVector<LoadClient*> m_lurkers;
+  QVector<LoadClient*> m_chatters;
+  int m_wantLurkers;
+  int m_wantChatters;
+
+  QTimer m_connectTimer;
+  QTimer m_reportTimer;
+  QTimer m_phaseTimer;
+
+  int m_connected;
+  int m_observersReady;
+
+  // Totals over the whole run
+  quint64 m_sent;
+  quint64 m_accepted;
+  quint64 m_delivered;
+  quint64 m_observerDelivered;
+  quint64 m_acceptedWhileObserved;
+  quint64 m_connectFailures;
+  quint64 m_unexpectedDisconnects;
+  quint64 m_serverMessages;
+  QHash<QString, quint64> m_statuses;
+
+  // Since the last report
+  quint64 m_intervalSent;
+  quint64 m_intervalAccepted;
+  quint64 m_intervalDelivered;
+  LatencyHistogram m_intervalLatency;
+
+  // Since the current phase started
+  quint64 m_phaseDelivered;
+  LatencyHistogram m_phaseLatency;
+
+  LatencyHistogram m_totalLatency;
+
+};
+
+#endif // LOADGEN_H
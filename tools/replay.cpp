@@ -0,0 +1,269 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTextStream>
+#include <QTimer>
+#include <QWebSocket>
+
+#include "packetenvelope.h"
+#include "trafficcapture.h"
+
+namespace
+{
+
+const int DRAIN_MS = 2000;
+
+QTextStream &out()
+{
+  static QTextStream s(stdout);
+  return s;
+}
+
+}
+
+/**
+ * @brief One captured connection, holding its frames until the socket is open
+ */
+class ReplayConnection : public QObject
+{
+  Q_OBJECT
+public:
+  ReplayConnection(const QUrl &url, QObject *parent) :
+    QObject(parent),
+    m_connected(false)
+  {
+    connect(&m_socket, &QWebSocket::connected, this, &ReplayConnection::connected);
+    connect(&m_socket, &QWebSocket::disconnected, this, &ReplayConnection::disconnected);
+    m_socket.open(url);
+  }
+
+  void send(const QString &frame)
+  {
+    if (m_connected) {
+      m_socket.sendTextMessage(frame);
+    } else {
+      m_pending.append(frame);
+    }
+  }
+
+  void close()
+  {
+    m_socket.disconnect(this);
+    m_socket.close();
+    deleteLater();
+  }
+
+signals:
+  void failed();
+
+private slots:
+  void connected()
+  {
+    m_connected = true;
+    for (const QString &frame : qAsConst(m_pending)) {
+      m_socket.sendTextMessage(frame);
+    }
+    m_pending.clear();
+  }
+
+  void disconnected()
+  {
+    if (!m_connected) {
+      emit failed();
+    }
+    m_connected = false;
+  }
+
+private:
+  QWebSocket m_socket;
+  bool m_connected;
+  QStringList m_pending;
+
+};
+
+/**
+ * @brief Plays a capture back at a multiple of its original speed
+ */
+class Replayer : public QObject
+{
+  Q_OBJECT
+public:
+  Replayer(const QUrl &url, double speed, bool rewriteAuth, QObject *parent = nullptr) :
+    QObject(parent),
+    m_url(url),
+    m_speed(speed),
+    m_rewriteAuth(rewriteAuth),
+    m_havePending(false),
+    m_connections(0),
+    m_frames(0),
+    m_orphanFrames(0),
+    m_connectFailures(0),
+    m_maxLagUs(0)
+  {
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &Replayer::pump);
+  }
+
+  bool open(const QString &filename)
+  {
+    if (!m_reader.open(filename)) {
+      return false;
+    }
+
+    m_havePending = m_reader.next(&m_pending);
+    return true;
+  }
+
+  void start()
+  {
+    m_clock.start();
+    pump();
+  }
+
+signals:
+  void finished();
+
+private slots:
+  void pump()
+  {
+    qint64 now = m_clock.nsecsElapsed() / 1000;
+
+    while (m_havePending) {
+      qint64 due = qint64(double(m_pending.timeUs) / m_speed);
+      if (due > now) {
+        m_timer.start(int((due - now + 999) / 1000));
+        return;
+      }
+
+      m_maxLagUs = qMax(m_maxLagUs, now - due);
+      apply(m_pending);
+      m_havePending = m_reader.next(&m_pending);
+    }
+
+    QTimer::singleShot(DRAIN_MS, this, &Replayer::drained);
+  }
+
+  void drained()
+  {
+    for (ReplayConnection *c : qAsConst(m_open)) {
+      c->close();
+    }
+    m_open.clear();
+
+    out() << "Replayed " << m_connections << " connections and " << m_frames << " frames in "
+          << QString::number(double(m_clock.elapsed()) / 1000.0, 'f', 1) << "s\n"
+          << "  frames from connections opened before the capture started: " << m_orphanFrames << '\n'
+          << "  connect failures: " << m_connectFailures << '\n'
+          << "  worst scheduling lag: " << QString::number(double(m_maxLagUs) / 1000.0, 'f', 2) << "ms\n";
+    out().flush();
+
+    emit finished();
+  }
+
+private:
+  void apply(const TrafficCaptureReader::Record &r)
+  {
+    switch (r.kind) {
+    case TrafficCapture::CONNECT:
+    {
+      ReplayConnection *c = new ReplayConnection(m_url, this);
+      connect(c, &ReplayConnection::failed, this, [this](){
+        m_connectFailures++;
+      });
+      m_open.insert(r.connection, c);
+      m_connections++;
+      break;
+    }
+    case TrafficCapture::FRAME:
+      if (ReplayConnection *c = m_open.value(r.connection)) {
+        c->send(m_rewriteAuth ? rewriteAuth(r.frame) : r.frame);
+        m_frames++;
+      } else {
+        m_orphanFrames++;
+      }
+      break;
+    case TrafficCapture::DISCONNECT:
+      if (ReplayConnection *c = m_open.take(r.connection)) {
+        c->close();
+      }
+      break;
+    }
+  }
+
+  /**
+   * @brief Points authenticated frames at the server's test module, which accepts the pseudonyms
+   */
+  static QString rewriteAuth(const QString &frame)
+  {
+    PacketEnvelope envelope;
+    if (!envelope.parse(frame) || envelope.auth().isEmpty() || envelope.auth().equals(u"test")) {
+      return frame;
+    }
+
+    QStringView raw = envelope.auth().rawView();
+    QString out = frame;
+    out.replace(int(raw.data() - frame.constData()), raw.size(), QStringLiteral("test"));
+    return out;
+  }
+
+  QUrl m_url;
+  double m_speed;
+  bool m_rewriteAuth;
+
+  TrafficCaptureReader m_reader;
+  TrafficCaptureReader::Record m_pending;
+  bool m_havePending;
+
+  QElapsedTimer m_clock;
+  QTimer m_timer;
+
+  QHash<quint32, ReplayConnection*> m_open;
+
+  quint64 m_connections;
+  quint64 m_frames;
+  quint64 m_orphanFrames;
+  quint64 m_connectFailures;
+  qint64 m_maxLagUs;
+
+};
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("kcchat-replay"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QStringLiteral("Replays a kcchat traffic capture against a server with test_auth enabled"));
+  parser.addHelpOption();
+  parser.addPositionalArgument(QStringLiteral("capture"), QStringLiteral("Capture file written by the server's capture_file option."));
+
+  QCommandLineOption urlOption(QStringLiteral("url"), QStringLiteral("Chat server URL."), QStringLiteral("url"), QStringLiteral("ws://localhost:2002"));
+  QCommandLineOption speedOption(QStringLiteral("speed"), QStringLiteral("Playback speed from 1 to 50 times the original."), QStringLiteral("factor"), QStringLiteral("1"));
+  QCommandLineOption keepAuthOption(QStringLiteral("keep-auth"), QStringLiteral("Send the captured auth module instead of switching to test."));
+
+  parser.addOptions({urlOption, speedOption, keepAuthOption});
+  parser.process(a);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.size() != 1) {
+    parser.showHelp(1);
+  }
+
+  double speed = qBound(1.0, parser.value(speedOption).toDouble(), 50.0);
+
+  Replayer replayer(QUrl(parser.value(urlOption)), speed, !parser.isSet(keepAuthOption));
+  if (!replayer.open(args.first())) {
+    qCritical() << "Failed to read capture" << args.first();
+    return 1;
+  }
+
+  QObject::connect(&replayer, &Replayer::finished, &a, &QCoreApplication::quit, Qt::QueuedConnection);
+  replayer.start();
+
+  return a.exec();
+}
+
+#include "replay.moc"